@@ -29,6 +29,8 @@ typedef int mode_t;
 struct dirent {
     char d_name[NAME_MAX+1];
     unsigned int d_fsize;
+    unsigned short d_fdate; // FAT format modification date and time, 0 when not known
+    unsigned short d_ftime;
     bool d_isdir;
 };
 
@@ -0,0 +1,137 @@
+#!/usr/bin/env python
+"""\
+Upload a file to Smoothie over USB serial, UART or telnet with upload -b
+
+The file is sent as blocks with a crc, several in flight at once, and is
+resumed with -r after an interrupted upload. Smoothie keeps running while
+the file is received.
+"""
+
+from __future__ import print_function
+import sys
+import argparse
+import socket
+import base64
+import zlib
+import os
+import re
+import time
+
+parser = argparse.ArgumentParser(description='Upload a file to Smoothie with the block upload protocol.')
+parser.add_argument('file', type=argparse.FileType('rb'),
+        help='filename to be uploaded')
+parser.add_argument('device',
+        help='Smoothie serial device, or IP address to use telnet')
+parser.add_argument('-o','--output',
+        help='Set output filename, default is /sd/ and the name of the file')
+parser.add_argument('-r','--resume',action='store_true',
+        help='resume an interrupted upload')
+parser.add_argument('-w','--window',type=int,
+        help='blocks in flight, default 4 for serial and 8 for telnet')
+parser.add_argument('-b','--block',type=int,
+        help='block size, default 128 for serial and 72 for telnet as its lines are shorter')
+parser.add_argument('-v','--verbose',action='store_true',
+        help='Show the protocol exchange')
+parser.add_argument('-q','--quiet',action='store_true',
+        help='suppress all output to terminal')
+
+args = parser.parse_args()
+
+f = args.file
+output = args.output
+if output == None :
+    output= "/sd/" + os.path.basename(f.name)
+filesize= os.path.getsize(f.name)
+
+telnet= not os.path.exists(args.device)
+window= args.window or (8 if telnet else 4)
+blocksize= args.block or (72 if telnet else 128)
+
+class Link:
+    def __init__(self):
+        if telnet:
+            self.s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            self.s.connect((args.device, 23))
+            self.s.settimeout(2.0)
+        else:
+            import serial
+            self.s = serial.Serial(args.device, 115200, timeout=2.0)
+        self.buf = b''
+
+    def write(self, line):
+        if args.verbose: print("SND: " + line.strip())
+        data= line.encode('ascii')
+        if telnet: self.s.sendall(data)
+        else: self.s.write(data)
+
+    # returns the next reply as (type, arguments) or None on a timeout, anything else is skipped
+    def reply(self):
+        while True:
+            while b'\n' not in self.buf:
+                try:
+                    d= self.s.recv(1024) if telnet else self.s.read(self.s.in_waiting or 1)
+                except socket.timeout:
+                    d= b''
+                if not d: return None
+                self.buf += d
+            ln, self.buf= self.buf.split(b'\n', 1)
+            ln= ln.decode('ascii', 'replace').strip()
+            if args.verbose: print("RSP: " + ln)
+            m= re.search(r'#([sadnf]) ?(.*)', ln)
+            if m: return (m.group(1), m.group(2))
+
+link= Link()
+link.write("\n")
+time.sleep(0.5)
+link.buf= b''
+
+link.write("upload -b " + ("-r " if args.resume else "") + output + "\n")
+r= link.reply()
+while r != None and r[0] != 's' and r[0] != 'f': r= link.reply()
+if r == None or r[0] == 'f':
+    print("Failed to start upload: " + (r[1] if r else "no reply"))
+    sys.exit(1)
+
+start, maxblock= [int(x) for x in r[1].split()]
+blocksize= min(blocksize, maxblock)
+if start > filesize:
+    print("The file on the sd card is bigger than this one")
+    sys.exit(1)
+if not args.quiet : print("Uploading " + f.name + " as " + output + " size: " + str(filesize) + (" from " + str(start) if start > 0 else ""))
+
+acked= start    # everything before this has been received
+sent= start     # next byte to send
+t0= time.time()
+while True:
+    while sent < filesize and sent - acked < window * blocksize:
+        f.seek(sent)
+        data= f.read(blocksize)
+        link.write("#b %d %08x %s\n" % (sent, zlib.crc32(data) & 0xffffffff, base64.b64encode(data).decode('ascii')))
+        sent += len(data)
+
+    if acked == filesize:
+        link.write("#e %d\n" % filesize)
+
+    r= link.reply()
+    if r == None:
+        # nothing for a while so resend everything not acked
+        sent= acked
+        continue
+
+    t, a= r
+    if t == 'a':
+        acked= max(acked, int(a))
+    elif t == 'n':
+        acked= sent= int(a)
+    elif t == 'd':
+        break
+    elif t == 'f':
+        print("Upload failed: " + a)
+        sys.exit(1)
+
+    if not args.quiet and not args.verbose: print(str(acked) + "/" + str(filesize) + "\r", end='')
+
+f.close()
+if not args.quiet :
+    dt= time.time() - t0
+    print("Upload complete in %1.1f seconds, %d bytes/sec" % (dt, (filesize - start) / dt if dt > 0 else 0))
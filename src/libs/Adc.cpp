@@ -10,14 +10,23 @@
 #include "libs/Kernel.h"
 #include "libs/Pin.h"
 #include "libs/ADC/adc.h"
-#include "libs/Pin.h"
-#include "libs/Median.h"
+#include "Config.h"
+#include "ConfigValue.h"
+#include "checksumm.h"
+#include "platform_memory.h"
 
 #include <cstring>
-#include <algorithm>
 
 #include "mbed.h"
 
+#define adc_dma_enable_checksum CHECKSUM("adc_dma_enable")
+
+// GPDMA channel used to capture conversions, the SD card uses 6 and 7
+#define ADC_DMA_CHANNEL LPC_GPDMACH5
+#define ADC_DMA_CHANNEL_BIT (1 << 5)
+// DMA requests captured between interrupts
+#define ADC_DMA_REQUESTS 4
+
 // This is an interface to the mbed.org ADC library you can find in libs/ADC/adc.h
 // TODO : Having the same name is confusing, should change that
 
@@ -28,6 +37,25 @@ static void sample_isr(int chan, uint32_t value)
     Adc::instance->new_sample(chan, value);
 }
 
+static void dma_isr()
+{
+    if(LPC_GPDMA->DMACIntTCStat & ADC_DMA_CHANNEL_BIT) {
+        LPC_GPDMA->DMACIntTCClear = ADC_DMA_CHANNEL_BIT;
+        Adc::instance->dma_done();
+    }
+    LPC_GPDMA->DMACIntErrClr = ADC_DMA_CHANNEL_BIT;
+}
+
+// the capture buffer is two halves of ADC_DMA_REQUESTS copies of the eight channel data registers,
+// there is a linked list item per copy as each one starts again at ADDR0
+// these are read by the GPDMA so have to be in AHB SRAM
+struct Adc::dma_t {
+    struct {
+        uint32_t src, dst, next, control;
+    } lli[2 * ADC_DMA_REQUESTS];
+    uint32_t buffer[2][ADC_DMA_REQUESTS][8];
+};
+
 Adc::Adc()
 {
     instance = this;
@@ -36,6 +64,13 @@ Adc::Adc()
     const uint32_t sample_rate= 1000; // 1KHz sample rate
     this->adc = new mbed::ADC(sample_rate, 8);
     this->adc->append(sample_isr);
+
+    memset(channels, 0, sizeof(channels));
+    dma= nullptr;
+    dma_half= 0;
+    if(THEKERNEL->config->value(adc_dma_enable_checksum)->by_default(false)->as_bool()) {
+        dma= (dma_t *)AHB0.alloc(sizeof(dma_t));
+    }
 }
 
 /*
@@ -57,22 +92,113 @@ void Adc::enable_pin(Pin *pin)
 {
     PinName pin_name = this->_pin_to_pinname(pin);
     int channel = adc->_pin_to_channel(pin_name);
-    memset(sample_buffers[channel], 0, sizeof(sample_buffers[0]));
+    if(channel < num_channels) memset(&channels[channel], 0, sizeof(channels[0]));
 
     this->adc->burst(1);
     this->adc->setup(pin_name, 1);
+    // the channel interrupt enable also makes the DMA requests
     this->adc->interrupt_state(pin_name, 1);
+
+    if(dma != nullptr) {
+        NVIC_DisableIRQ(ADC_IRQn);
+        start_dma();
+    }
 }
 
-// Keeps the last 8 values for each channel
-// This is called in an ISR, so sample_buffers needs to be accessed atomically
+// Copies all the channel data registers on each DMA request
+// The request is held while the DONE bit of any enabled channel is set, and a channel's DONE bit is only
+// cleared by reading its own ADDRn, reading ADGDR just clears the global one. So capturing ADGDR alone would
+// leave the request asserted and the DMA would run continuously re-reading the same result.
+void Adc::start_dma()
+{
+    if(LPC_GPDMA->DMACEnbldChns & ADC_DMA_CHANNEL_BIT) return; // already running
+
+    LPC_SC->PCONP |= (1 << 29); // power up the GPDMA
+    LPC_GPDMA->DMACConfig = 1;  // enable, little endian
+    LPC_GPDMA->DMACIntTCClear = ADC_DMA_CHANNEL_BIT;
+    LPC_GPDMA->DMACIntErrClr = ADC_DMA_CHANNEL_BIT;
+
+    // 8 words in one burst of 8 incrementing both addresses, interrupt at the end of each half
+    const uint32_t control= 8 | (2 << 12) | (2 << 15) | (2 << 18) | (2 << 21) | (1UL << 26) | (1UL << 27);
+    const int n= 2 * ADC_DMA_REQUESTS;
+    for (int i = 0; i < n; ++i) {
+        dma->lli[i].src= (uint32_t)&LPC_ADC->ADDR0;
+        dma->lli[i].dst= (uint32_t)dma->buffer[i / ADC_DMA_REQUESTS][i % ADC_DMA_REQUESTS];
+        dma->lli[i].next= (uint32_t)&dma->lli[(i + 1) % n];
+        dma->lli[i].control= control | ((i % ADC_DMA_REQUESTS == ADC_DMA_REQUESTS - 1) ? (1UL << 31) : 0);
+    }
+    dma_half= 0;
+
+    ADC_DMA_CHANNEL->DMACCSrcAddr= dma->lli[0].src;
+    ADC_DMA_CHANNEL->DMACCDestAddr= dma->lli[0].dst;
+    ADC_DMA_CHANNEL->DMACCLLI= dma->lli[0].next;
+    ADC_DMA_CHANNEL->DMACCControl= dma->lli[0].control;
+
+    NVIC_SetVector(DMA_IRQn, (uint32_t)&dma_isr);
+    NVIC_EnableIRQ(DMA_IRQn);
+
+    ADC_DMA_CHANNEL->DMACCConfig= 1 | (4 << 1) | (2 << 11) | (1 << 15); // enable, from the ADC, peripheral to memory, terminal count interrupt
+}
+
+// called from the DMA interrupt when half the capture buffer has been filled
+void Adc::dma_done()
+{
+    uint32_t (*b)[8]= dma->buffer[dma_half];
+    dma_half ^= 1;
+    for (int i = 0; i < ADC_DMA_REQUESTS; ++i) {
+        // only the channels whose DONE bit was set have a new conversion
+        for (int chan = 0; chan < num_channels; ++chan) {
+            if(b[i][chan] & (1UL << 31)) new_sample(chan, b[i][chan]);
+        }
+    }
+}
+
+// This is called in an ISR, read() only needs the sum which is updated in one go
 void Adc::new_sample(int chan, uint32_t value)
 {
-    // Shuffle down and add new value to the end
-    if(chan < num_channels) {
-        memmove(&sample_buffers[chan][0], &sample_buffers[chan][1], sizeof(sample_buffers[0]) - sizeof(sample_buffers[0][0]));
-        sample_buffers[chan][num_samples - 1] = (value >> 4) & 0xFFF; // the 12 bit ADC reading
+    if(chan >= num_channels) return;
+
+    channels[chan].add((value >> 4) & 0xFFF); // the 12 bit ADC reading
+}
+
+// Replaces the oldest reading with a new one
+void Adc::channel_t::add(uint16_t v)
+{
+    uint16_t old= ring[head];
+    ring[head]= v;
+    if(++head >= num_samples) head= 0;
+
+    // find the oldest reading in the sorted ones
+    uint16_t *s= sorted;
+    int i= 0, n= num_samples;
+    while(n > 0) {
+        int h= n / 2;
+        if(s[i + h] < old) {
+            i += h + 1;
+            n -= h + 1;
+        } else {
+            n= h;
+        }
+    }
+
+    // move the readings between it and where the new one goes along by one,
+    // only those in the middle half change the sum
+    const int lo= num_samples / 4, hi= num_samples - num_samples / 4;
+    int32_t delta= 0;
+    if(v > old) {
+        for (; i < num_samples - 1 && s[i + 1] < v; ++i) {
+            if(i >= lo && i < hi) delta += s[i + 1] - s[i];
+            s[i]= s[i + 1];
+        }
+    } else {
+        for (; i > 0 && s[i - 1] > v; --i) {
+            if(i >= lo && i < hi) delta += s[i - 1] - s[i];
+            s[i]= s[i - 1];
+        }
     }
+    if(i >= lo && i < hi) delta += v - s[i];
+    s[i]= v;
+    sum += delta;
 }
 
 //#define USE_MEDIAN_FILTER
@@ -82,26 +208,18 @@ unsigned int Adc::read(Pin *pin)
     PinName p = this->_pin_to_pinname(pin);
     int channel = adc->_pin_to_channel(p);
 
-    uint16_t median_buffer[num_samples];
-    // needs atomic access TODO maybe be able to use std::atomic here or some lockless mutex
-    __disable_irq();
-    memcpy(median_buffer, sample_buffers[channel], sizeof(median_buffer));
-    __enable_irq();
+    if(channel >= num_channels) return 0;
 
 #ifdef USE_MEDIAN_FILTER
-    // returns the median value of the last 8 samples
-    return median_buffer[quick_median(median_buffer, num_samples)];
+    // returns the median value of the last num_samples samples
+    return channels[channel].sorted[num_samples / 2];
 
 #elif defined(OVERSAMPLE)
     // Oversample to get 2 extra bits of resolution
-    // weed out top and bottom worst values then oversample the rest
+    // weed out top and bottom worst values then oversample the rest, new_sample() keeps the sum of the rest
     // put into a 4 element moving average and return the average of the last 4 oversampled readings
     static uint16_t ave_buf[num_channels][4] =  { {0} };
-    std::sort(median_buffer, median_buffer + num_samples);
-    uint32_t sum = 0;
-    for (int i = num_samples / 4; i < (num_samples - (num_samples / 4)); ++i) {
-        sum += median_buffer[i];
-    }
+    uint32_t sum = channels[channel].sum;
     // this slows down the rate of change a little bit
     ave_buf[channel][3]= ave_buf[channel][2];
     ave_buf[channel][2]= ave_buf[channel][1];
@@ -110,13 +228,8 @@ unsigned int Adc::read(Pin *pin)
     return roundf((ave_buf[channel][0]+ave_buf[channel][1]+ave_buf[channel][2]+ave_buf[channel][3])/4.0F);
 
 #else
-    // sort the 8 readings and return the average of the middle 4
-    std::sort(median_buffer, median_buffer + num_samples);
-    int sum = 0;
-    for (int i = num_samples / 4; i < (num_samples - (num_samples / 4)); ++i) {
-        sum += median_buffer[i];
-    }
-    return sum / (num_samples / 2);
+    // the average of the middle 4 of the 8 readings
+    return channels[channel].sum / (num_samples / 2);
 
 #endif
 }
@@ -32,6 +32,7 @@ public:
 
     static Adc *instance;
     void new_sample(int chan, uint32_t value);
+    void dma_done();
     // return the maximum ADC value, base is 12bits 4095.
 #ifdef OVERSAMPLE
     int get_max_value() const { return 4095 << OVERSAMPLE;}
@@ -39,19 +40,35 @@ public:
     int get_max_value() const { return 4095;}
 #endif
 
-private:
-    PinName _pin_to_pinname(Pin *pin);
-    mbed::ADC *adc;
-
-    static const int num_channels= 6;
 #ifdef OVERSAMPLE
     // we need 4^n sample to oversample and we get double that to filter out spikes
     static const int num_samples= powf(4, OVERSAMPLE)*2;
 #else
     static const int num_samples= 8;
 #endif
-    // buffers storing the last num_samples readings for each channel
-    uint16_t sample_buffers[num_channels][num_samples];
+    // the last num_samples readings for a channel in the order they arrived and the same readings sorted,
+    // each new reading replaces the oldest in both and the sum of the middle half of the sorted ones is kept up to date
+    struct channel_t {
+        uint16_t ring[num_samples];
+        uint16_t sorted[num_samples];
+        uint32_t sum;
+        uint8_t head;
+
+        void add(uint16_t v);
+    };
+
+private:
+    PinName _pin_to_pinname(Pin *pin);
+    void start_dma();
+    mbed::ADC *adc;
+
+    static const int num_channels= 6;
+    channel_t channels[num_channels];
+
+    // when set the conversions are captured by the GPDMA and handled a burst at a time instead of one interrupt each
+    struct dma_t;
+    dma_t *dma;
+    uint8_t dma_half;
 };
 
 #endif
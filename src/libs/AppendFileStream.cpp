@@ -3,10 +3,9 @@
 
 int AppendFileStream::puts(const char *str)
 {
-    FILE *fd= fopen(this->fn, "a");
-    if(fd == NULL) return 0;
+    if(!writer.is_open() && !writer.open(this->fn, "a")) return 0;
 
-    int n= fwrite(str, 1, strlen(str), fd);
-    fclose(fd);
+    int n= strlen(str);
+    if(!writer.write(str, n)) return 0;
     return n;
 }
@@ -2,17 +2,20 @@
 #define _APPENDFILESTREAM_H_
 
 #include "StreamOutput.h"
+#include "FileWriter.h"
 #include "string.h"
 #include "stdlib.h"
 
+// appends everything written to it to the file, which is opened on the first write and closed when deleted
 class AppendFileStream : public StreamOutput {
     public:
-        AppendFileStream(const char *filename) { fn= strdup(filename); }
-        virtual ~AppendFileStream(){ free(fn); }
+        AppendFileStream(const char *filename) : writer(1024) { fn= strdup(filename); }
+        virtual ~AppendFileStream(){ writer.close(); free(fn); }
         int puts(const char*);
 
     private:
         char *fn;
+        FileWriter writer;
 };
 
 #endif
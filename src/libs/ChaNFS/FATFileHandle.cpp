@@ -9,6 +9,11 @@
 #include "ff.h"
 #include "FATFileSystem.h"
 
+// items in the first link map tried, enough for a file in up to four fragments
+#define LINKMAP_INITIAL_ITEMS 10
+// largest link map allowed (1KB), a file in more fragments than this keeps using the normal seek
+#define LINKMAP_MAX_ITEMS 256
+
 namespace mbed {
 
 #if FFSDEBUG_ENABLED
@@ -32,11 +37,13 @@ static const char *FR_ERRORS[] = {
 
 FATFileHandle::FATFileHandle(FIL_t fh) {
     _fh = fh;
+    _linkmap_tried = false;
 }
     
 int FATFileHandle::close() {
     FFSDEBUG("close\n");
     int retval = f_close(&_fh);
+    free(_fh.cltbl);
     delete this;
     return retval;
 }
@@ -74,6 +81,10 @@ off_t FATFileHandle::lseek(off_t position, int whence) {
     } else if(whence==SEEK_CUR) {
         position += _fh.fptr;
     }
+    if((DWORD)position != _fh.fptr && !_linkmap_tried && !(_fh.flag & FA_WRITE)) {
+        // the first real seek on a read only file maps its clusters, after that seeks do not touch the FAT
+        create_linkmap();
+    }
     FRESULT res = f_lseek(&_fh, position);
     if(res) {
         FFSDEBUG("lseek failed (%d, %s)\n", res, FR_ERRORS[res]);
@@ -94,6 +105,32 @@ int FATFileHandle::fsync() {
     return 0;
 }
 
+bool FATFileHandle::create_linkmap() {
+    _linkmap_tried = true;
+    DWORD n = LINKMAP_INITIAL_ITEMS;
+    for(;;) {
+        DWORD *tbl = (DWORD *)malloc(n * sizeof(DWORD));
+        if(tbl == NULL) return false;
+        tbl[0] = n;
+        _fh.cltbl = tbl;
+        FRESULT res = f_lseek(&_fh, CREATE_LINKMAP);
+        if(res == FR_OK) {
+            FFSDEBUG("linkmap uses %lu items\n", tbl[0]);
+            return true;
+        }
+
+        // on FR_NOT_ENOUGH_CORE the first item holds the size the map needs, so try once more at that size
+        DWORD needed = tbl[0];
+        _fh.cltbl = 0;
+        free(tbl);
+        if(res != FR_NOT_ENOUGH_CORE || needed <= n || needed > LINKMAP_MAX_ITEMS) {
+            FFSDEBUG("linkmap failed (%d, %lu items)\n", res, needed);
+            return false;
+        }
+        n = needed;
+    }
+}
+
 off_t FATFileHandle::flen() {
     FFSDEBUG("flen\n");
     return _fh.fsize;
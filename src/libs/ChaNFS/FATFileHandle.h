@@ -24,7 +24,11 @@ public:
 
 protected:
 
+    // builds the cluster link map of a read only file so seeks no longer follow the FAT chain
+    bool create_linkmap();
+
     FIL_t _fh;
+    bool _linkmap_tried;
 
 };
 
@@ -52,6 +52,18 @@ public:
     virtual int disk_status() { return 0; }
     virtual int disk_read(char *buffer, int sector) = 0;
     virtual int disk_write(const char *buffer, int sector) = 0;
+    virtual int disk_read_sectors(char *buffer, int sector, int count) {
+        for(int i = 0; i < count; i++) {
+            if(disk_read(buffer + i * 512, sector + i)) return 1;
+        }
+        return 0;
+    }
+    virtual int disk_write_sectors(const char *buffer, int sector, int count) {
+        for(int i = 0; i < count; i++) {
+            if(disk_write(buffer + i * 512, sector + i)) return 1;
+        }
+        return 0;
+    }
     virtual int disk_sync() { return 0; }
     virtual int disk_sectors() = 0;
 
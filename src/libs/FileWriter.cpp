@@ -0,0 +1,113 @@
+#include "FileWriter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTOR_SIZE 512
+
+FileWriter::FileWriter(size_t size)
+{
+    fd= nullptr;
+    n= 0;
+    pos= 0;
+    this->size= (size < SECTOR_SIZE) ? SECTOR_SIZE : size & ~(SECTOR_SIZE - 1);
+    buf= (char *)malloc(this->size);
+}
+
+FileWriter::~FileWriter()
+{
+    close();
+    free(buf);
+}
+
+bool FileWriter::open(const char *filename, const char *mode)
+{
+    close();
+    if(buf == nullptr) return false;
+
+    fd= fopen(filename, mode);
+    if(fd == nullptr) return false;
+
+    // we do our own buffering so writes reach FatFS in whole sectors
+    setvbuf(fd, nullptr, _IONBF, 0);
+
+    fseek(fd, 0, SEEK_END);
+    pos= ftell(fd);
+    if(pos < 0) pos= 0;
+    n= 0;
+    return true;
+}
+
+bool FileWriter::write(const void *data, size_t len)
+{
+    if(fd == nullptr) return false;
+
+    const char *p= (const char *)data;
+    while(len > 0) {
+        if(n >= size && !write_out(false)) return false;
+        size_t c= size - n;
+        if(c > len) c= len;
+        memcpy(&buf[n], p, c);
+        n += c;
+        p += c;
+        len -= c;
+    }
+    return true;
+}
+
+// write the buffer up to the last sector boundary in the file, or everything if all is set
+bool FileWriter::write_out(bool all)
+{
+    size_t c= all ? n : n - ((pos + n) % SECTOR_SIZE);
+    if(c == 0) return true;
+
+    if(fwrite(buf, 1, c, fd) != c) {
+        fclose(fd);
+        fd= nullptr;
+        return false;
+    }
+
+    pos += c;
+    n -= c;
+    if(n > 0) memmove(buf, &buf[c], n);
+    return true;
+}
+
+bool FileWriter::flush()
+{
+    if(fd == nullptr) return false;
+    if(!write_out(true)) return false;
+    return fflush(fd) == 0;
+}
+
+bool FileWriter::close()
+{
+    if(fd == nullptr) return false;
+    bool ok= write_out(true);
+    if(fd != nullptr && fclose(fd) != 0) ok= false;
+    fd= nullptr;
+    return ok;
+}
+
+extern "C" void *new_file_writer(const char *filename, const char *mode)
+{
+    FileWriter *w= new FileWriter();
+    if(!w->open(filename, mode)) {
+        delete w;
+        return nullptr;
+    }
+    return w;
+}
+
+extern "C" int file_writer_write(void *w, const void *data, size_t len)
+{
+    return ((FileWriter *)w)->write(data, len) ? 1 : 0;
+}
+
+// closes the file, returns 0 if anything failed to be written
+extern "C" int delete_file_writer(void *w)
+{
+    bool ok= ((FileWriter *)w)->close();
+    delete (FileWriter *)w;
+    return ok ? 1 : 0;
+}
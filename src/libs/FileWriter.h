@@ -0,0 +1,45 @@
+#ifndef _FILEWRITER_H_
+#define _FILEWRITER_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+#include <stdio.h>
+
+// Buffers writes to a file and passes them to FatFS in whole sectors aligned to the file position
+// so most of the data goes straight to the card with multiple block writes instead of through the FIL sector buffer.
+// Nothing is guaranteed to be on the card until flush() or close()
+class FileWriter {
+    public:
+        FileWriter(size_t size= 2048);
+        ~FileWriter();
+
+        // mode is as for fopen, "w" or "a"
+        bool open(const char *filename, const char *mode);
+        bool is_open() const { return fd != nullptr; }
+        // the file position the next write goes to
+        long tell() const { return pos + n; }
+        bool write(const void *data, size_t len);
+        bool put(char c) { if(n >= size && !write_out(false)) return false; buf[n++]= c; return true; }
+        bool flush();
+        bool close();
+
+    private:
+        bool write_out(bool all);
+
+        FILE *fd;
+        char *buf;
+        size_t size;  // buffer size, a multiple of the sector size
+        size_t n;     // bytes in the buffer
+        long pos;     // file position of the start of the buffer
+};
+
+#else
+
+extern void *new_file_writer(const char *filename, const char *mode);
+extern int file_writer_write(void *w, const void *data, size_t len);
+extern int delete_file_writer(void *w);
+
+#endif // __cplusplus
+
+#endif
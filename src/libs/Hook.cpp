@@ -5,4 +5,11 @@ extern "C"{
 
 // Hook is just a glorified FPointer
 
-Hook::Hook(){}
+Hook::Hook(){
+    interval = 0;
+    deadline = 0;
+    overruns = 0;
+    index = -1;
+    detaching = false;
+    dropped = false;
+}
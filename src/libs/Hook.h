@@ -7,8 +7,12 @@
 class Hook : public FPointer {
     public:
         Hook();
-        int     interval;
-        int     countdown;
+        uint32_t interval;      // timer ticks between calls
+        uint32_t deadline;      // timer count of the next call
+        uint32_t overruns;      // times a call was late enough that the one after it was missed
+        int16_t  index;         // position in the SlowTicker schedule, -1 if not in it
+        volatile bool detaching; // set by SlowTicker::detach, the interrupt drops it from the schedule without calling it
+        volatile bool dropped;   // set by the interrupt once it has, the hook can then be deleted
 };
 
 #endif
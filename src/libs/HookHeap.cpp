@@ -0,0 +1,59 @@
+#include "HookHeap.h"
+#include "Hook.h"
+
+static inline bool due_before(const Hook *a, const Hook *b)
+{
+    return (int32_t)(a->deadline - b->deadline) < 0;
+}
+
+bool HookHeap::push(Hook *hook)
+{
+    if(count >= max_hooks) return false;
+    hook->index = count;
+    heap[count++] = hook;
+    sift_up(hook->index);
+    return true;
+}
+
+Hook *HookHeap::pop()
+{
+    Hook *hook = heap[0];
+    hook->index = -1;
+    if(--count > 0) {
+        heap[0] = heap[count];
+        heap[0]->index = 0;
+        sift_down(0);
+    }
+    return hook;
+}
+
+void HookHeap::swap(int a, int b)
+{
+    Hook *h = heap[a];
+    heap[a] = heap[b];
+    heap[b] = h;
+    heap[a]->index = a;
+    heap[b]->index = b;
+}
+
+void HookHeap::sift_up(int i)
+{
+    while(i > 0) {
+        int parent = (i - 1) / 2;
+        if(!due_before(heap[i], heap[parent])) break;
+        swap(i, parent);
+        i = parent;
+    }
+}
+
+void HookHeap::sift_down(int i)
+{
+    for(;;) {
+        int first = i, child = 2 * i + 1;
+        if(child < count && due_before(heap[child], heap[first])) first = child;
+        if(child + 1 < count && due_before(heap[child + 1], heap[first])) first = child + 1;
+        if(first == i) break;
+        swap(i, first);
+        i = first;
+    }
+}
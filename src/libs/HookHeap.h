@@ -0,0 +1,35 @@
+#ifndef HOOKHEAP_H
+#define HOOKHEAP_H
+
+#include <stdint.h>
+
+class Hook;
+
+// Min-heap of hooks by deadline, used by the SlowTicker to find the hook due first
+// deadlines are compared by their difference so the timer count can wrap
+class HookHeap {
+    public:
+        HookHeap() : count(0) {}
+
+        // returns false if the heap is full
+        bool push(Hook *hook);
+        // the hook due first, the heap must not be empty
+        Hook *top() const { return heap[0]; }
+        // call after changing the deadline of the top hook
+        void update_top() { sift_down(0); }
+        // removes the top hook, the heap must not be empty
+        Hook *pop();
+        int size() const { return count; }
+
+        static const int max_hooks= 64;
+
+    private:
+        void sift_up(int i);
+        void sift_down(int i);
+        void swap(int a, int b);
+
+        Hook *heap[max_hooks];
+        int count;
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "InputShaper.h"
+#include "platform_memory.h"
+
+#include <math.h>
+#include <string.h>
+
+// vibration tolerance used by the EI shaper
+#define EI_VIBRATION_TOLERANCE 0.05F
+
+InputShaper::InputShaper(uint16_t size)
+{
+    // the queue of delayed steps lives in AHB0
+    events= (uint32_t *)AHB0.alloc(size * sizeof(uint32_t));
+    this->size= (events == nullptr) ? 0 : size;
+    type= NONE;
+    frequency= 0;
+    damping= 0;
+    n_impulses= 0;
+    now= 0;
+    flush();
+}
+
+InputShaper::~InputShaper()
+{
+    if(events != nullptr) AHB0.dealloc(events);
+}
+
+int InputShaper::calculate(TYPE type, float frequency, float damping, float amplitudes[max_impulses], float times[max_impulses])
+{
+    if(type == NONE || frequency <= 0 || damping < 0 || damping >= 1) return 0;
+
+    float df= sqrtf(1.0F - damping * damping);
+    float k= expf(-damping * M_PI / df);
+    float td= 1.0F / (frequency * df); // damped period of the resonance
+
+    int n;
+    switch(type) {
+        case ZV:
+            amplitudes[0]= 1;
+            amplitudes[1]= k;
+            times[0]= 0;
+            times[1]= 0.5F * td;
+            n= 2;
+            break;
+
+        case ZVD:
+            amplitudes[0]= 1;
+            amplitudes[1]= 2 * k;
+            amplitudes[2]= k * k;
+            times[0]= 0;
+            times[1]= 0.5F * td;
+            times[2]= td;
+            n= 3;
+            break;
+
+        case EI:
+            amplitudes[0]= 0.25F * (1 + EI_VIBRATION_TOLERANCE);
+            amplitudes[1]= 0.5F * (1 - EI_VIBRATION_TOLERANCE) * k;
+            amplitudes[2]= amplitudes[0] * k * k;
+            times[0]= 0;
+            times[1]= 0.5F * td;
+            times[2]= td;
+            n= 3;
+            break;
+
+        default:
+            return 0;
+    }
+
+    // normalize so the shaped move travels the same distance
+    float sum= 0;
+    for (int i = 0; i < n; ++i) sum += amplitudes[i];
+    for (int i = 0; i < n; ++i) amplitudes[i] /= sum;
+
+    return n;
+}
+
+uint16_t InputShaper::needed_size(TYPE type, float frequency, float damping, float step_rate)
+{
+    float a[max_impulses], t[max_impulses];
+    int n= calculate(type, frequency, damping, a, t);
+    if(n == 0) return 0;
+
+    // every step pushed in the last impulse delay is still held, plus a little for rounding
+    float steps= ceilf(step_rate * t[n - 1] * 1.1F) + 1;
+    return (steps > 65535) ? 65535 : steps;
+}
+
+InputShaper::TYPE InputShaper::type_from_string(const char *str)
+{
+    if(strcasecmp(str, "zv") == 0) return ZV;
+    if(strcasecmp(str, "zvd") == 0) return ZVD;
+    if(strcasecmp(str, "ei") == 0) return EI;
+    return NONE;
+}
+
+const char *InputShaper::type_to_string(TYPE type)
+{
+    switch(type) {
+        case ZV: return "zv";
+        case ZVD: return "zvd";
+        case EI: return "ei";
+        default: return "none";
+    }
+}
+
+bool InputShaper::set_parameters(TYPE type, float frequency, float damping, float tick_frequency)
+{
+    float a[max_impulses], t[max_impulses];
+    int n= calculate(type, frequency, damping, a, t);
+    if(n == 0 || size == 0) {
+        this->type= NONE;
+        n_impulses= 0;
+        return type == NONE;
+    }
+
+    // convert to 16.16 fixed point and make sure the total is exactly one step so no steps are lost
+    int32_t total= 0;
+    for (int i = 0; i < n; ++i) {
+        delay[i]= lroundf(t[i] * tick_frequency);
+        if(i < n - 1) {
+            amplitude[i]= lroundf(a[i] * ONE);
+            total += amplitude[i];
+        } else {
+            amplitude[i]= ONE - total;
+        }
+    }
+
+    this->type= type;
+    this->frequency= frequency;
+    this->damping= damping;
+    n_impulses= n;
+    flush();
+    return true;
+}
+
+void InputShaper::flush()
+{
+    head= tail= 0;
+    for (int i = 0; i < max_impulses; ++i) read_i[i]= 0;
+    acc= 0;
+}
+
+// a step has been requested on this tick, the first impulse is always at time zero so is applied immediately
+void InputShaper::push(bool dir)
+{
+    uint32_t event= (now & TICK_MASK) | (dir ? DIR_BIT : 0);
+
+    uint16_t h= next(head);
+    if(h == tail) {
+        // queue is full so apply all the remaining impulses of the oldest step now, this loses some shaping but never loses a step
+        for (int k = 1; k < n_impulses; ++k) {
+            if(read_i[k] == tail) {
+                apply(k, events[tail]);
+                read_i[k]= next(tail);
+            }
+        }
+        tail= next(tail);
+    }
+
+    events[head]= event;
+    head= h;
+    apply(0, event);
+}
+
+// called every step tick, returns 1 for a step in the positive direction, -1 for a step in the negative direction and 0 for no step
+int InputShaper::tick()
+{
+    ++now;
+
+    // apply each delayed impulse of the steps whose time has come
+    for (int k = 1; k < n_impulses; ++k) {
+        while(read_i[k] != head && ((now - events[read_i[k]]) & TICK_MASK) >= delay[k]) {
+            apply(k, events[read_i[k]]);
+            read_i[k]= next(read_i[k]);
+        }
+    }
+    if(n_impulses > 0) tail= read_i[n_impulses - 1];
+
+    if(acc >= ONE) {
+        acc -= ONE;
+        return 1;
+    }
+
+    if(acc <= -ONE) {
+        acc += ONE;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Resonance cancelling input shaper for one actuator.
+// Each step issued by the step ticker is convolved with a short train of impulses (ZV, ZVD or EI)
+// and the resulting fractional steps are accumulated and output as whole steps on later ticks.
+class InputShaper {
+    public:
+        enum TYPE { NONE, ZV, ZVD, EI };
+        static const int max_impulses= 3;
+
+        InputShaper(uint16_t size);
+        ~InputShaper();
+
+        // calculates the impulse amplitudes and times in seconds, returns the number of impulses
+        static int calculate(TYPE type, float frequency, float damping, float amplitudes[max_impulses], float times[max_impulses]);
+        // the number of delayed steps the shaper needs to hold at the given maximum step rate
+        static uint16_t needed_size(TYPE type, float frequency, float damping, float step_rate);
+        static TYPE type_from_string(const char *str);
+        static const char *type_to_string(TYPE type);
+
+        // must only be called when the shaper is empty
+        bool set_parameters(TYPE type, float frequency, float damping, float tick_frequency);
+        uint16_t get_size() const { return size; }
+        TYPE get_type() const { return type; }
+        float get_frequency() const { return frequency; }
+        float get_damping() const { return damping; }
+
+        // called from the step ticker ISR
+        void push(bool dir);
+        int tick();
+        void defer(int step) { acc += (step > 0) ? ONE : -ONE; }
+        void flush();
+        bool is_empty() const { return head == tail && acc < ONE && acc > -ONE; }
+
+    private:
+        static const int32_t ONE= (1<<16); // 16.16 fixed point step
+        static const uint32_t TICK_MASK= 0x7FFFFFFF;
+        static const uint32_t DIR_BIT= 0x80000000;
+
+        uint16_t next(uint16_t i) const { return (i + 1 == size) ? 0 : i + 1; }
+        void apply(int k, uint32_t event) { acc += (event & DIR_BIT) ? -amplitude[k] : amplitude[k]; }
+
+        uint32_t *events; // tick of each queued step with the direction in bit 31
+        uint16_t size;
+        volatile uint16_t head;
+        volatile uint16_t tail;
+        uint16_t read_i[max_impulses]; // next event to apply for each impulse
+
+        int32_t amplitude[max_impulses];
+        uint32_t delay[max_impulses];
+        volatile int32_t acc;
+        uint32_t now;
+
+        float frequency;
+        float damping;
+        TYPE type;
+        uint8_t n_impulses;
+};
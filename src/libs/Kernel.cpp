@@ -45,6 +45,7 @@
 
 #define base_stepping_frequency_checksum            CHECKSUM("base_stepping_frequency")
 #define microseconds_per_step_pulse_checksum        CHECKSUM("microseconds_per_step_pulse")
+#define microseconds_dir_setup_time_checksum        CHECKSUM("microseconds_dir_setup_time")
 #define disable_leds_checksum                       CHECKSUM("leds_disable")
 #define grbl_mode_checksum                          CHECKSUM("grbl_mode")
 #define feed_hold_enable_checksum                   CHECKSUM("enable_feed_hold")
@@ -157,10 +158,12 @@ Kernel::Kernel()
     // Configure the step ticker
     this->base_stepping_frequency = this->config->value(base_stepping_frequency_checksum)->by_default(100000)->as_number();
     float microseconds_per_step_pulse = this->config->value(microseconds_per_step_pulse_checksum)->by_default(1)->as_number();
+    float microseconds_dir_setup_time = this->config->value(microseconds_dir_setup_time_checksum)->by_default(1)->as_number();
 
     // Configure the step ticker
     this->step_ticker->set_frequency( this->base_stepping_frequency );
     this->step_ticker->set_unstep_time( microseconds_per_step_pulse );
+    this->step_ticker->set_dir_setup_time( microseconds_dir_setup_time );
 
     // Core modules
     this->add_module( this->conveyor       = new Conveyor()      );
@@ -25,10 +25,24 @@ extern "C" {
     };
 
     static uint32_t _previous_state[5];
+    static uint32_t _previous_pinsel[10];
 
     static LPC_GPIO_TypeDef* io;
     static int i;
 
+    // the function select bits in PINSELn of the pins set on debug, each PINSEL register is half a port
+    static uint32_t pinsel_mask(int n)
+    {
+        uint32_t pins = (_set_high_on_debug[n / 2] | _set_low_on_debug[n / 2]) >> ((n % 2) * 16);
+        uint32_t mask = 0;
+        for (int p = 0; p < 16; p++)
+        {
+            if (pins & (1 << p))
+                mask |= 3 << (p * 2);
+        }
+        return mask;
+    }
+
     void __mriPlatform_EnteringDebuggerHook()
     {
         for (i = 0; i < 5; i++)
@@ -41,10 +55,24 @@ extern "C" {
             io->FIOSET   = _set_high_on_debug[i];
             io->FIOCLR   = _set_low_on_debug[i];
         }
+
+        // a pin driven by a peripheral such as PWM1 ignores the GPIO registers, so make them GPIO while debugging
+        for (i = 0; i < 10; i++)
+        {
+            volatile uint32_t *pinsel = &LPC_PINCON->PINSEL0 + i;
+            _previous_pinsel[i] = *pinsel;
+            *pinsel &= ~pinsel_mask(i);
+        }
     }
 
     void __mriPlatform_LeavingDebuggerHook()
     {
+        for (i = 0; i < 10; i++)
+        {
+            volatile uint32_t *pinsel = &LPC_PINCON->PINSEL0 + i;
+            *pinsel = (*pinsel & ~pinsel_mask(i)) | (_previous_pinsel[i] & pinsel_mask(i));
+        }
+
         for (i = 0; i < 5; i++)
         {
             io           = (LPC_GPIO_TypeDef*) (LPC_GPIO_BASE + (0x20 * i));
@@ -196,6 +196,9 @@ LPC17XX_Ethernet::LPC17XX_Ethernet()
     instance = this;
 
     up = false;
+
+    memset(&rx_stats, 0, sizeof(rx_stats));
+    memset(&tx_stats, 0, sizeof(tx_stats));
 }
 
 void LPC17XX_Ethernet::on_module_loaded()
@@ -220,6 +223,17 @@ void LPC17XX_Ethernet::on_idle(void*)
 
 void LPC17XX_Ethernet::on_second_tick(void *) {
     check_interface();
+    update_rate(rx_stats);
+    update_rate(tx_stats);
+}
+
+void LPC17XX_Ethernet::update_rate(net_stats_t& s)
+{
+    uint32_t p = s.packets, b = s.bytes;
+    s.packets_per_sec = p - s.last_packets;
+    s.bytes_per_sec = b - s.last_bytes;
+    s.last_packets = p;
+    s.last_bytes = b;
 }
 
 void LPC17XX_Ethernet::check_interface()
@@ -388,6 +402,8 @@ bool LPC17XX_Ethernet::_receive_frame(void *packet, int *size)
         if(len <= *size) { // check against recieving buffer length
             memcpy(packet, rxbuf.buf[i], len);
             *size= len;
+            rx_stats.packets++;
+            rx_stats.bytes += len;
         }else{
             // discard frame that is too big for input buffer
             DEBUG_PRINTF("WARNING: Discarded ethernet frame that is too big: %08lX, %d - %d\n", stat->Info, len, *size);
@@ -424,10 +440,14 @@ bool LPC17XX_Ethernet::can_read_packet()
     return (LPC_EMAC->RxProduceIndex != LPC_EMAC->RxConsumeIndex);
 }
 
+// returns the frame in place in the rx descriptor buffer, it belongs to the caller until release_read_packet()
 int LPC17XX_Ethernet::read_packet(uint8_t** buf)
 {
     *buf = rxbuf.buf[LPC_EMAC->RxConsumeIndex];
-    return rxbuf.rxstat[LPC_EMAC->RxConsumeIndex].Info & EMAC_RINFO_SIZE;
+    int len = (rxbuf.rxstat[LPC_EMAC->RxConsumeIndex].Info & EMAC_RINFO_SIZE) + 1; // the size field is one less than the length
+    rx_stats.packets++;
+    rx_stats.bytes += len;
+    return len;
 }
 
 void LPC17XX_Ethernet::release_read_packet(uint8_t*)
@@ -459,6 +479,8 @@ int LPC17XX_Ethernet::write_packet(uint8_t* buf, int size)
 
     LPC_EMAC->TxProduceIndex = r;
 
+    tx_stats.packets++;
+    tx_stats.bytes += size;
     return size;
 }
 
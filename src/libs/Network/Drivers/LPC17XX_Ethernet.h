@@ -11,8 +11,9 @@
 // SMSC 8720A special control/status register
 #define EMAC_PHY_REG_SCSR 0x1F
 
-#define LPC17XX_MAX_PACKET 600
-#define LPC17XX_TXBUFS     4
+// descriptor buffers hold a whole frame (EMAC_ETH_MAX_FLEN) so uIP can work on received frames in place
+#define LPC17XX_MAX_PACKET 1536
+#define LPC17XX_TXBUFS     3
 #define LPC17XX_RXBUFS     4
 
 typedef struct {
@@ -32,6 +33,16 @@ typedef struct {
     packet_desc txdesc[LPC17XX_TXBUFS];
 } _txbuf_t;
 
+// frame counters, the totals and the rates over the last second
+typedef struct {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t packets_per_sec;
+    uint32_t bytes_per_sec;
+    uint32_t last_packets;
+    uint32_t last_bytes;
+} net_stats_t;
+
 class LPC17XX_Ethernet;
 
 class LPC17XX_Ethernet : public Module, public NetworkInterface
@@ -70,6 +81,9 @@ public:
     NET_PAYLOAD get_payload_buffer(NET_PACKET);
     void        set_payload_length(NET_PACKET, int);
 
+    const net_stats_t& get_rx_stats() const { return rx_stats; }
+    const net_stats_t& get_tx_stats() const { return tx_stats; }
+
     static LPC17XX_Ethernet* instance;
 
 private:
@@ -77,6 +91,10 @@ private:
     static _txbuf_t txbuf;
 
     void check_interface();
+    static void update_rate(net_stats_t& s);
+
+    net_stats_t rx_stats;
+    net_stats_t tx_stats;
 };
 
 #endif /* _LPC17XX_ETHERNET_H */
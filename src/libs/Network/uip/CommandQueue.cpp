@@ -3,19 +3,26 @@
 #include "stdio.h"
 #include "string.h"
 #include "stdlib.h"
+#include <new>
 
 #include "Kernel.h"
 #include "libs/SerialMessage.h"
 #include "CallbackStream.h"
+#include "platform_memory.h"
 
 static CommandQueue *command_queue_instance;
 CommandQueue *CommandQueue::instance = NULL;
 
+#define ALIGN4(n) (((n) + 3) & ~3)
 
 CommandQueue::CommandQueue()
 {
     command_queue_instance = this;
     null_stream= &(StreamOutput::NullStream);
+    // the arena and response buffers are allocated when the network is enabled, so nothing is taken when it is disabled
+    arena= NULL;
+    head= tail= n= 0;
+    responses= NULL;
 }
 
 CommandQueue* CommandQueue::getInstance()
@@ -31,31 +38,85 @@ extern "C" {
     }
 }
 
+// copy the command into the arena, returns false if there is no room
+bool CommandQueue::arena_add(const char *cmd, StreamOutput *pstream)
+{
+    if(arena == NULL) allocate();
+    if(arena == NULL) return false;
+
+    size_t len= strlen(cmd) + 1;
+    uint16_t need= ALIGN4(sizeof(entry_t) + len);
+
+    if(n == 0) {
+        head= tail= 0;
+    } else if(head == tail) {
+        return false; // full
+    }
+
+    if(head >= tail) {
+        // free space is from head to the end and from the start to tail
+        if(need > ARENA_SIZE - head) {
+            if(need > tail) return false;
+            // mark the wrap if there is room for a header, otherwise pop wraps when it sees the space is too small for one
+            if(ARENA_SIZE - head >= (int)sizeof(entry_t)) ((entry_t *)&arena[head])->size= 0;
+            head= 0;
+        }
+    } else if(need > tail - head) {
+        return false;
+    }
+
+    entry_t *e= (entry_t *)&arena[head];
+    e->pstream= pstream;
+    e->size= need;
+    memcpy(&arena[head + sizeof(entry_t)], cmd, len);
+    head += need;
+    if(head >= ARENA_SIZE) head= 0;
+    n++;
+    return true;
+}
+
 int CommandQueue::add(const char *cmd, StreamOutput *pstream)
 {
-    cmd_t c= {strdup(cmd), pstream==NULL?null_stream:pstream};
-    q.push(c);
+    StreamOutput *s= pstream==NULL?null_stream:pstream;
+
+    // once a command has gone to the overflow everything goes there until it drains, to keep the order
+    if(overflow.size() > 0 || !arena_add(cmd, s)) {
+        cmd_t c= {strdup(cmd), s};
+        overflow.push(c);
+    }
+
     if(pstream != NULL) {
         // count how many times this is on the queue
-        CallbackStream *s= static_cast<CallbackStream *>(pstream);
-        s->inc();
+        CallbackStream *cs= static_cast<CallbackStream *>(pstream);
+        cs->inc();
     }
-    return q.size();
+    return size();
 }
 
 // pops the next command off the queue and submits it.
 bool CommandQueue::pop()
 {
-    if (q.size() == 0) return false;
+    struct SerialMessage message;
 
-    cmd_t c= q.pop();
-    char *cmd= c.str;
+    if(n > 0) {
+        if(ARENA_SIZE - tail < (int)sizeof(entry_t) || ((entry_t *)&arena[tail])->size == 0) tail= 0;
+        entry_t *e= (entry_t *)&arena[tail];
+        message.message = &arena[tail + sizeof(entry_t)];
+        message.stream = e->pstream;
+        tail += e->size;
+        if(tail >= ARENA_SIZE) tail= 0;
+        if(--n == 0) head= tail= 0;
 
-    struct SerialMessage message;
-    message.message = cmd;
-    message.stream = c.pstream;
+    } else if(overflow.size() > 0) {
+        cmd_t c= overflow.pop();
+        message.message = c.str;
+        message.stream = c.pstream;
+        free(c.str);
+
+    } else {
+        return false;
+    }
 
-    free(cmd);
     THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message );
 
     if(message.stream != null_stream) {
@@ -66,3 +127,132 @@ bool CommandQueue::pop()
     }
     return true;
 }
+
+void CommandQueue::allocate()
+{
+    if(arena == NULL) {
+        arena= (char *)AHB0.alloc(ARENA_SIZE);
+        if(arena == NULL) arena= (char *)malloc(ARENA_SIZE);
+    }
+
+    if(responses == NULL) {
+        responses= (ResponseBuffer *)AHB0.alloc(RESPONSE_BUFFERS * sizeof(ResponseBuffer));
+        if(responses != NULL) {
+            for (int i = 0; i < RESPONSE_BUFFERS; ++i) {
+                new(&responses[i]) ResponseBuffer();
+                responses[i].in_use= false;
+                responses[i].pooled= true;
+            }
+        }
+    }
+}
+
+ResponseBuffer *CommandQueue::new_response_buffer()
+{
+    if(responses == NULL) allocate();
+
+    if(responses != NULL) {
+        for (int i = 0; i < RESPONSE_BUFFERS; ++i) {
+            if(!responses[i].in_use) {
+                responses[i].reset();
+                responses[i].in_use= true;
+                return &responses[i];
+            }
+        }
+    }
+
+    // all in use so use the heap
+    ResponseBuffer *rb= new ResponseBuffer();
+    rb->in_use= true;
+    rb->pooled= false;
+    return rb;
+}
+
+void CommandQueue::delete_response_buffer(ResponseBuffer *rb)
+{
+    if(rb == NULL) return;
+    if(rb->pooled) rb->in_use= false;
+    else delete rb;
+}
+
+// adds the whole string or nothing, a string too big to ever fit is truncated so it can not stall forever
+bool ResponseBuffer::put(const char *str)
+{
+    int l= strlen(str);
+    if(l > SIZE - len) {
+        if(len > 0) return false;
+        l= SIZE;
+    }
+
+    int h= tail + len;
+    if(h >= SIZE) h -= SIZE;
+    for (int i = 0; i < l; ++i) {
+        data[h]= str[i];
+        if(++h >= SIZE) h= 0;
+    }
+    len += l;
+    return true;
+}
+
+// copies up to n bytes from the start without removing them
+int ResponseBuffer::peek(char *buf, int n) const
+{
+    if(n > len) n= len;
+    int t= tail;
+    for (int i = 0; i < n; ++i) {
+        buf[i]= data[t];
+        if(++t >= SIZE) t= 0;
+    }
+    return n;
+}
+
+void ResponseBuffer::consume(int n)
+{
+    if(n > len) n= len;
+    tail += n;
+    if(tail >= SIZE) tail -= SIZE;
+    len -= n;
+}
+
+// c accessibility for httpd
+extern "C" {
+    void *new_response_buffer()
+    {
+        return command_queue_instance->new_response_buffer();
+    }
+
+    void delete_response_buffer(void *rb)
+    {
+        command_queue_instance->delete_response_buffer((ResponseBuffer *)rb);
+    }
+
+    int response_buffer_put(void *rb, const char *str)
+    {
+        return ((ResponseBuffer *)rb)->put(str) ? 1 : 0;
+    }
+
+    void response_buffer_end(void *rb)
+    {
+        ((ResponseBuffer *)rb)->end();
+    }
+
+    int response_buffer_size(void *rb)
+    {
+        return ((ResponseBuffer *)rb)->size();
+    }
+
+    int response_buffer_ended(void *rb)
+    {
+        return ((ResponseBuffer *)rb)->get_ended();
+    }
+
+    int response_buffer_peek(void *rb, char *buf, int n)
+    {
+        return ((ResponseBuffer *)rb)->peek(buf, n);
+    }
+
+    void response_buffer_consume(void *rb, int n)
+    {
+        ((ResponseBuffer *)rb)->consume(n);
+    }
+}
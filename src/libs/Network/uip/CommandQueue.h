@@ -5,9 +5,34 @@
 
 #include "fifo.h"
 #include <string>
+#include <stdint.h>
 
 class StreamOutput;
 
+// the results of commands waiting to be sent on a connection, kept back to back so several can go in one packet
+class ResponseBuffer
+{
+public:
+    ResponseBuffer() { reset(); }
+    bool put(const char *str);
+    void end() { ended++; }
+    int size() const { return len; }
+    int get_ended() const { return ended; }
+    int peek(char *buf, int n) const;
+    void consume(int n);
+
+private:
+    friend class CommandQueue;
+    static const int SIZE= 512;
+    void reset() { tail= len= ended= 0; }
+
+    char data[SIZE];
+    uint16_t tail, len;
+    uint16_t ended; // number of commands that have finished
+    bool in_use;
+    bool pooled;
+};
+
 class CommandQueue
 {
 public:
@@ -15,19 +40,48 @@ public:
     ~CommandQueue();
     bool pop();
     int add(const char* cmd, StreamOutput *pstream);
-    int size() {return q.size();}
+    int size() {return n + overflow.size();}
     static CommandQueue* getInstance();
+    // takes the arena and response buffers from AHB0 now, before the SD cache has what is left
+    void allocate();
+
+    ResponseBuffer *new_response_buffer();
+    void delete_response_buffer(ResponseBuffer *rb);
 
 private:
+    // commands are stored in the arena as this header followed by the string, each padded to a multiple of 4
+    typedef struct { StreamOutput *pstream; uint16_t size; } entry_t;
     typedef struct {char* str; StreamOutput *pstream; } cmd_t;
-    Fifo<cmd_t> q;
+    static const int ARENA_SIZE= 1024;
+    static const int RESPONSE_BUFFERS= 4;
+
+    bool arena_add(const char *cmd, StreamOutput *pstream);
+
+    char *arena;
+    uint16_t head, tail; // offsets into the arena
+    uint16_t n;          // commands in the arena
+    Fifo<cmd_t> overflow; // strdup'd commands that did not fit in the arena
+    ResponseBuffer *responses;
     static CommandQueue *instance;
     StreamOutput *null_stream;
 };
 
-#else
+extern "C" {
+#endif
 
-extern int network_add_command(const char * cmd, void *pstream);
+int network_add_command(const char * cmd, void *pstream);
+
+void *new_response_buffer();
+void delete_response_buffer(void *rb);
+int response_buffer_put(void *rb, const char *str);
+void response_buffer_end(void *rb);
+int response_buffer_size(void *rb);
+int response_buffer_ended(void *rb);
+int response_buffer_peek(void *rb, char *buf, int n);
+void response_buffer_consume(void *rb, int n);
+
+#ifdef __cplusplus
+}
 #endif
 
 #endif
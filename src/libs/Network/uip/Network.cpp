@@ -17,12 +17,14 @@
 #include "NetworkPublicAccess.h"
 #include "checksumm.h"
 #include "ConfigValue.h"
+#include "platform_memory.h"
 
 #include "uip.h"
 #include "telnetd.h"
 #include "webserver.h"
 #include "dhcpc.h"
 #include "sftpd.h"
+#include "gcodestream.h"
 
 #ifndef NOPLAN9
 #include "plan9.h"
@@ -32,15 +34,22 @@
 
 #define BUF ((struct uip_eth_hdr *)&uip_buf[0])
 
+#if UIP_CONF_ZERO_COPY
+static_assert(LPC17XX_MAX_PACKET >= UIP_BUFSIZE + 4, "uIP works in the ethernet rx buffers so they must be as big as uip_buf");
+#endif
+
 #define network_enable_checksum CHECKSUM("enable")
 #define network_webserver_checksum CHECKSUM("webserver")
 #define network_telnet_checksum CHECKSUM("telnet")
 #define network_plan9_checksum CHECKSUM("plan9")
+#define network_gcode_stream_checksum CHECKSUM("gcode_stream")
+#define network_port_checksum CHECKSUM("port")
 #define network_mac_override_checksum CHECKSUM("mac_override")
 #define network_ip_address_checksum CHECKSUM("ip_address")
 #define network_hostname_checksum CHECKSUM("hostname")
 #define network_ip_gateway_checksum CHECKSUM("ip_gateway")
 #define network_ip_mask_checksum CHECKSUM("ip_mask")
+#define network_tcp_send_buffers_checksum CHECKSUM("tcp_send_buffers")
 
 extern "C" void uip_log(char *m)
 {
@@ -57,6 +66,9 @@ Network::Network()
     sftpd= NULL;
     hostname = NULL;
     plan9_enabled= false;
+    gcode_stream_enabled= false;
+    gcode_stream_port= 0;
+    tcp_send_buffers= 0;
     command_q= CommandQueue::getInstance();
 }
 
@@ -129,9 +141,13 @@ void Network::on_module_loaded()
         return;
     }
 
+    command_q->allocate();
+
     webserver_enabled = THEKERNEL->config->value( network_checksum, network_webserver_checksum, network_enable_checksum )->by_default(false)->as_bool();
     telnet_enabled = THEKERNEL->config->value( network_checksum, network_telnet_checksum, network_enable_checksum )->by_default(false)->as_bool();
     plan9_enabled = THEKERNEL->config->value( network_checksum, network_plan9_checksum, network_enable_checksum )->by_default(false)->as_bool();
+    gcode_stream_enabled = THEKERNEL->config->value( network_checksum, network_gcode_stream_checksum, network_enable_checksum )->by_default(false)->as_bool();
+    gcode_stream_port = THEKERNEL->config->value( network_checksum, network_gcode_stream_checksum, network_port_checksum )->by_default(2000)->as_int();
     string mac = THEKERNEL->config->value( network_checksum, network_mac_override_checksum )->by_default("")->as_string();
     if (mac.size() == 17 ) { // parse mac address
         if (!parse_ip_str(mac, mac_address, 6, 16, ':')) {
@@ -188,6 +204,11 @@ void Network::on_module_loaded()
         }
     }
 
+#if UIP_TCP_SNDBUFS > 0
+    int n= THEKERNEL->config->value( network_checksum, network_tcp_send_buffers_checksum )->by_default(2)->as_int();
+    tcp_send_buffers= n < 0 ? 0 : n > UIP_TCP_SNDBUFS ? UIP_TCP_SNDBUFS : n;
+#endif
+
     THEKERNEL->add_module( ethernet );
     THEKERNEL->slow_ticker->attach( 100, this, &Network::tick );
 
@@ -210,15 +231,20 @@ void Network::on_get_public_data(void* argument) {
 
     }else if(pdr->second_element_is(get_ipconfig_checksum)) {
         // NOTE caller must free the returned string when done
-        char buf[200];
+        char buf[320];
         int n1= snprintf(buf,             sizeof(buf),         "IP Addr: %d.%d.%d.%d\n", ipaddr[0], ipaddr[1], ipaddr[2], ipaddr[3]);
         int n2= snprintf(&buf[n1],       sizeof(buf)-n1,       "IP GW: %d.%d.%d.%d\n", ipgw[0], ipgw[1], ipgw[2], ipgw[3]);
         int n3= snprintf(&buf[n1+n2],    sizeof(buf)-n1-n2,    "IP mask: %d.%d.%d.%d\n", ipmask[0], ipmask[1], ipmask[2], ipmask[3]);
         int n4= snprintf(&buf[n1+n2+n3], sizeof(buf)-n1-n2-n3, "MAC Address: %02X:%02X:%02X:%02X:%02X:%02X\n",
             mac_address[0], mac_address[1], mac_address[2], mac_address[3], mac_address[4], mac_address[5]);
-        char *str = (char *)malloc(n1+n2+n3+n4+1);
-        memcpy(str, buf, n1+n2+n3+n4);
-        str[n1+n2+n3+n4]= '\0';
+        const net_stats_t& rx= ethernet->get_rx_stats();
+        const net_stats_t& tx= ethernet->get_tx_stats();
+        int n5= snprintf(&buf[n1+n2+n3+n4], sizeof(buf)-n1-n2-n3-n4, "Rx: %lu packets/sec, %lu bytes/sec (%lu packets, %lu bytes)\nTx: %lu packets/sec, %lu bytes/sec (%lu packets, %lu bytes)\nMSS: %d\n",
+            rx.packets_per_sec, rx.bytes_per_sec, rx.packets, rx.bytes, tx.packets_per_sec, tx.bytes_per_sec, tx.packets, tx.bytes, UIP_TCP_MSS);
+        int n= n1+n2+n3+n4+n5;
+        char *str = (char *)malloc(n+1);
+        memcpy(str, buf, n);
+        str[n]= '\0';
         pdr->set_data_ptr(str);
         pdr->set_taken();
     }
@@ -235,12 +261,28 @@ void Network::on_idle(void *argument)
 {
     if (!ethernet->isUp()) return;
 
+#if UIP_CONF_ZERO_COPY
+    if (ethernet->can_read_packet() && ethernet->can_write_packet()) {
+        // work on the frame in place in the rx descriptor buffer, any reply is built there too
+        uint8_t *frame;
+        int len= ethernet->read_packet(&frame);
+        if(len <= UIP_BUFSIZE + 4) {
+            uip_buf= frame;
+            uip_len= len;
+            this->handlePacket();
+            uip_buf= uip_default_buf;
+        }
+        ethernet->release_read_packet(frame);
+
+    } else {
+#else
     int len= sizeof(uip_buf); // set maximum size
     if (ethernet->_receive_frame(uip_buf, &len)) {
         uip_len = len;
         this->handlePacket();
 
     } else {
+#endif
 
         if (timer_expired(&periodic_timer)) { /* no packet but periodic_timer time out (0.1s)*/
             timer_reset(&periodic_timer);
@@ -290,6 +332,10 @@ void Network::on_idle(void *argument)
             uip_arp_timer();
         }
     }
+
+    if (gcode_stream_enabled) GcodeStream::get_instance()->on_idle();
+
+    poll_connections();
 }
 
 void Network::setup_servers()
@@ -314,6 +360,12 @@ void Network::setup_servers()
     }
 #endif
 
+    if (gcode_stream_enabled) {
+        // Initialize the raw gcode streaming server
+        GcodeStream::init(gcode_stream_port);
+        printf("Gcode stream initialized on port %d\n", gcode_stream_port);
+    }
+
     // sftpd service, which is lazily created on reciept of first packet
     uip_listen(HTONS(115));
 }
@@ -359,6 +411,20 @@ void Network::init(void)
     // Initialize the uIP TCP/IP stack.
     uip_init();
 
+#if UIP_TCP_SNDBUFS > 0
+    // each send buffer holds two full segments, they come from AHB1 first as that is mostly unused, then AHB0
+    const size_t sndbuf_size= 2 * UIP_TCP_MSS;
+    int nsndbufs= 0;
+    for (int i = 0; i < tcp_send_buffers; i++) {
+        u8_t *buf= (u8_t *)AHB1.alloc(sndbuf_size);
+        if(buf == NULL) buf= (u8_t *)AHB0.alloc(sndbuf_size);
+        if(buf == NULL) break;
+        uip_sndbuf_add(buf, sndbuf_size);
+        nsndbufs++;
+    }
+    if(nsndbufs < tcp_send_buffers) printf("Only room for %d TCP send buffers\n", nsndbufs);
+#endif
+
     uip_setethaddr(mac_address);
 
     if (!use_dhcp) { // manual setup of ip
@@ -395,11 +461,19 @@ void Network::on_main_loop(void *argument)
     // issue one comamnd per iteration of main loop like USB serial does
     command_q->pop();
 
+    // the raw stream feeds several lines per iteration
+    if (gcode_stream_enabled) GcodeStream::get_instance()->on_main_loop();
 }
 
 // select between webserver and telnetd server
 extern "C" void app_select_appcall(void)
 {
+    // the gcode stream port is configurable so can't be a case
+    if (theNetwork->gcode_stream_enabled && uip_conn->lport == HTONS(theNetwork->gcode_stream_port)) {
+        GcodeStream::appcall();
+        return;
+    }
+
     switch (uip_conn->lport) {
         case HTONS(80):
             if (theNetwork->webserver_enabled) httpd_appcall();
@@ -447,6 +521,13 @@ extern "C" void tcpip_output()
 }
 void network_device_send()
 {
+#if UIP_TCP_SNDBUFS > 0
+    // a connection with a send buffer already has more than one segment in flight, so does not need splitting to get an ack
+    if(uip_sndbuf_inuse(uip_conn)) {
+        tcpip_output();
+        return;
+    }
+#endif
     uip_split_output();
     //tcpip_output();
 }
@@ -457,6 +538,35 @@ void network_device_send()
 }
 #endif
 
+// let connections that have something to send do it now rather than on the next periodic poll
+void Network::poll_connections()
+{
+#if UIP_TCP_SNDBUFS > 0
+    // connections with room in their send buffer can queue another segment
+    for (int i = 0; i < UIP_CONNS && ethernet->can_write_packet(); i++) {
+        if (uip_sndbuf_pollable(&uip_conns[i])) {
+            uip_poll_conn(&uip_conns[i]);
+            if (uip_len > 0) {
+                uip_arp_out();
+                network_device_send();
+            }
+        }
+    }
+#endif
+
+    // the gcode stream has replies to send or can reopen its receive window
+    if (gcode_stream_enabled && ethernet->can_write_packet()) {
+        struct uip_conn *conn= GcodeStream::get_instance()->get_poll_conn();
+        if (conn != NULL) {
+            uip_poll_conn(conn);
+            if (uip_len > 0) {
+                uip_arp_out();
+                network_device_send();
+            }
+        }
+    }
+}
+
 void Network::handlePacket(void)
 {
     if (uip_len > 0) {  /* received packet */
@@ -28,7 +28,9 @@ public:
         bool telnet_enabled:1;
         bool plan9_enabled:1;
         bool use_dhcp:1;
+        bool gcode_stream_enabled:1;
     };
+    uint16_t gcode_stream_port;
 
 
 private:
@@ -36,6 +38,7 @@ private:
     void setup_servers();
     uint32_t tick(uint32_t dummy);
     void handlePacket();
+    void poll_connections();
 
     CommandQueue *command_q;
     LPC17XX_Ethernet *ethernet;
@@ -47,6 +50,7 @@ private:
     uint8_t ipaddr[4];
     uint8_t ipmask[4];
     uint8_t ipgw[4];
+    uint8_t tcp_send_buffers;
 };
 
 #endif
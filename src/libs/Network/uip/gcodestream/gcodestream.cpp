@@ -0,0 +1,242 @@
+#include "gcodestream.h"
+
+#include "uip.h"
+#include "Kernel.h"
+#include "Conveyor.h"
+#include "SerialMessage.h"
+#include "StreamOutputPool.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <string>
+
+//#define DEBUG_PRINTF(...)
+#define DEBUG_PRINTF ::printf
+
+GcodeStream *GcodeStream::instance= nullptr;
+
+GcodeStream::GcodeStream()
+{
+    conn= nullptr;
+    nlines= 0;
+    linelen= 0;
+    sent= 0;
+    query= false;
+    halt= false;
+}
+
+// static
+void GcodeStream::init(uint16_t port)
+{
+    if(instance == nullptr) instance= new GcodeStream();
+    uip_listen(HTONS(port));
+}
+
+void GcodeStream::open(struct uip_conn *c)
+{
+    DEBUG_PRINTF("GcodeStream: connected\n");
+    conn= c;
+    // lines still waiting from a previous connection are kept, they are complete as close() ends any partial line
+    txbuf.tail= txbuf.head= 0;
+    sent= 0;
+    THEKERNEL->streams->append_stream(this);
+}
+
+void GcodeStream::close()
+{
+    DEBUG_PRINTF("GcodeStream: closed\n");
+    // a file that does not end with a newline still has its last line executed
+    if(linelen > 0 && rxbuf.size() < rxbuf.capacity()) {
+        rxbuf.push_back('\n');
+        ++nlines;
+    }
+    linelen= 0;
+    conn= nullptr;
+    THEKERNEL->streams->remove_stream(this);
+}
+
+// there must be room for a whole segment as uIP has acked the data before we see it
+bool GcodeStream::has_room()
+{
+    return rxbuf.capacity() - rxbuf.size() >= UIP_RECEIVE_WINDOW && !THECONVEYOR->is_queue_full();
+}
+
+void GcodeStream::acked()
+{
+    while(sent > 0) {
+        txbuf.delete_tail();
+        --sent;
+    }
+}
+
+void GcodeStream::newdata()
+{
+    const char *p= (const char *)uip_appdata;
+    for (u16_t i = 0; i < uip_datalen(); ++i) {
+        char c= p[i];
+        if(c == '?') {
+            query= true;
+            continue;
+        }
+        if(c == 'X'-'A'+1) { // ^X
+            halt= true;
+            continue;
+        }
+
+        // convert CR to NL (for host OSs that don't send NL)
+        if(c == '\r') c= '\n';
+        if(rxbuf.size() >= rxbuf.capacity()) {
+            // should not happen as the window is closed before the ring can fill
+            DEBUG_PRINTF("GcodeStream: receive overflow\n");
+            break;
+        }
+        rxbuf.push_back(c);
+        if(c == '\n') {
+            ++nlines;
+            linelen= 0;
+        } else if(++linelen >= MAX_LINE_LENGTH) {
+            // break up over long lines so a line without a newline can never fill the ring
+            if(rxbuf.size() < rxbuf.capacity()) {
+                rxbuf.push_back('\n');
+                ++nlines;
+            }
+            linelen= 0;
+        }
+    }
+
+    // close the receive window until there is room again
+    if(!has_room()) uip_stop();
+}
+
+void GcodeStream::senddata(bool rexmit)
+{
+    // anything already sent is resent as is when uIP asks for a retransmit, nothing new is sent until it is acked,
+    // otherwise send as much as fits in a segment
+    int n= sent;
+    if(n > 0) {
+        if(!rexmit) return;
+    } else {
+        n= txbuf.size();
+        if(n > uip_mss()) n= uip_mss();
+        if(n == 0) return;
+    }
+
+    char *p= (char *)uip_appdata;
+    int k= txbuf.tail;
+    for (int i = 0; i < n; ++i) {
+        p[i]= txbuf.buffer[k];
+        k= txbuf.next_block_index(k);
+    }
+    sent= n;
+    uip_send(uip_appdata, n);
+}
+
+// static
+void GcodeStream::appcall(void)
+{
+    GcodeStream *gs= instance;
+
+    if(uip_connected()) {
+        if(gs->conn != nullptr) {
+            // only one streaming connection at a time
+            DEBUG_PRINTF("GcodeStream: already connected, refusing\n");
+            uip_abort();
+            return;
+        }
+        gs->open(uip_conn);
+    }
+
+    if(uip_conn != gs->conn) {
+        // a refused connection
+        if(!(uip_closed() || uip_aborted() || uip_timedout())) uip_abort();
+        return;
+    }
+
+    if(uip_closed() || uip_aborted() || uip_timedout()) {
+        // a FIN can carry the last segment of the data, it has already been acked so it must be queued before closing
+        if(uip_newdata()) gs->newdata();
+        gs->close();
+        return;
+    }
+
+    if(uip_acked()) {
+        gs->acked();
+    }
+
+    if(uip_newdata()) {
+        gs->newdata();
+    }
+
+    if(uip_poll() && uip_stopped(uip_conn) && gs->has_room()) {
+        // reopen the window, uip_restart flags newdata so uIP sends the window update
+        uip_restart();
+    }
+
+    if(uip_rexmit() || uip_newdata() || uip_acked() || uip_connected() || uip_poll()) {
+        gs->senddata(uip_rexmit());
+    }
+}
+
+// the connection if it has replies waiting or its window can be reopened, so it can be polled straight away
+struct uip_conn *GcodeStream::get_poll_conn()
+{
+    if(conn == nullptr) return nullptr;
+    if((sent == 0 && txbuf.size() > 0) || (uip_stopped(conn) && has_room())) return conn;
+    return nullptr;
+}
+
+void GcodeStream::on_idle()
+{
+    if(halt) {
+        halt= false;
+        THEKERNEL->call_event(ON_HALT, nullptr);
+    }
+
+    if(query && conn != nullptr) {
+        // only reply if it fits, as puts would call on_idle to wait for room
+        std::string q= THEKERNEL->get_query_string();
+        if(txbuf.capacity() - txbuf.size() >= (int)q.size()) {
+            query= false;
+            puts(q.c_str());
+        }
+    }
+}
+
+// execute several lines per pass, stopping while the planner queue is full so the main loop does not block on it
+void GcodeStream::on_main_loop()
+{
+    for (int i = 0; i < MAX_LINES_PER_PASS && nlines > 0; ++i) {
+        if(THECONVEYOR->is_queue_full()) break;
+
+        std::string received;
+        received.reserve(32);
+        char c;
+        while(true) {
+            rxbuf.pop_front(c);
+            if(c == '\n') break;
+            received += c;
+        }
+        --nlines;
+        if(received.empty()) continue;
+
+        struct SerialMessage message;
+        message.message= received;
+        message.stream= this;
+        THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+    }
+}
+
+int GcodeStream::puts(const char *str)
+{
+    int len= strlen(str);
+    for (int i = 0; i < len; ++i) {
+        // wait for the network to send some of what is queued
+        while(conn != nullptr && txbuf.size() >= txbuf.capacity()) {
+            THEKERNEL->call_event(ON_IDLE);
+        }
+        // if the connection has gone just pretend we sent it
+        if(conn == nullptr) break;
+        txbuf.push_back(str[i]);
+    }
+    return len;
+}
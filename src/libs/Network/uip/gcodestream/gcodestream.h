@@ -0,0 +1,72 @@
+#ifndef __GCODESTREAM_H__
+#define __GCODESTREAM_H__
+
+/*
+ * Raw TCP G-code streaming
+ *
+ * Every line received on the port is executed as if it came in on the USB
+ * serial, and the replies are sent back on the same connection. Only one
+ * connection is served at a time.
+ *
+ * Lines are assembled straight into a fixed receive ring and several are
+ * executed on each pass of the main loop. When the ring does not have room
+ * for another full segment, or the planner queue is full, the TCP receive
+ * window is closed so the sender waits instead of data being dropped.
+ *
+ * How to use it:
+ *
+ *   1. Add "network.gcode_stream.enable true" to the config, the port is set
+ *      with network.gcode_stream.port and defaults to 2000
+ *   2. Stream with something like "nc $ip 2000 < file.g"
+ */
+
+#include "StreamOutput.h"
+#include "RingBuffer.h"
+
+#include <stdint.h>
+
+struct uip_conn;
+
+class GcodeStream : public StreamOutput
+{
+public:
+    GcodeStream();
+
+    static void init(uint16_t port);
+    static void appcall(void);
+    static GcodeStream *get_instance() { return instance; }
+
+    void on_idle();
+    void on_main_loop();
+    struct uip_conn *get_poll_conn();
+
+    int puts(const char *str);
+
+private:
+    static GcodeStream *instance;
+
+    // the most lines executed on one pass of the main loop
+    static const int MAX_LINES_PER_PASS= 8;
+    static const int MAX_LINE_LENGTH= 256;
+
+    void open(struct uip_conn *c);
+    void close();
+    void acked();
+    void newdata();
+    void senddata(bool rexmit);
+    bool has_room();
+
+    struct uip_conn *conn;
+    RingBuffer<char, 4096> rxbuf;
+    RingBuffer<char, 1024> txbuf;
+    uint16_t nlines; // complete lines in rxbuf
+    uint16_t linelen; // length of the line being received
+    uint16_t sent;   // bytes at the tail of txbuf waiting to be acked
+
+    struct {
+        bool query:1;
+        bool halt:1;
+    };
+};
+
+#endif
@@ -102,9 +102,39 @@ typedef unsigned short uip_stats_t;
 /**
  * uIP buffer size.
  *
+ * 1514 is a full ethernet frame which gives a TCP MSS of 1460, it must
+ * not be bigger than the ethernet rx descriptor buffers (LPC17XX_MAX_PACKET).
+ *
  * \hideinitializer
  */
-#define UIP_CONF_BUFFER_SIZE     400
+#ifndef UIP_CONF_BUFFER_SIZE
+#define UIP_CONF_BUFFER_SIZE     1514
+#endif
+
+/**
+ * Zero copy receive.
+ *
+ * When set uip_buf is a pointer and received frames are processed in
+ * place in the ethernet rx descriptor buffers, otherwise each frame is
+ * copied into the uip_buf array.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_CONF_ZERO_COPY
+#define UIP_CONF_ZERO_COPY       1
+#endif
+
+/**
+ * Number of TCP send buffers.
+ *
+ * Connections with a send buffer keep several segments in flight,
+ * Network allocates the buffers themselves from AHB RAM.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_CONF_TCP_SNDBUFS
+#define UIP_CONF_TCP_SNDBUFS     4
+#endif
 
 #define UIP_CONF_BROADCAST 1
 
@@ -149,7 +179,9 @@ extern "C" void app_select_appcall(void);
 extern void app_select_appcall(void);
 #endif
 
+#ifndef UIP_APPCALL
 #define UIP_APPCALL app_select_appcall
+#endif
 typedef void* uip_tcp_appstate_t;
 
 /* Here we include the header file for the application(s) we use in
@@ -152,8 +152,14 @@ struct uip_eth_addr uip_ethaddr = {{0, 0, 0, 0, 0, 0}};
 #endif
 
 #ifndef UIP_CONF_EXTERNAL_BUFFER
+#if UIP_CONF_ZERO_COPY
+u8_t uip_default_buf[UIP_BUFSIZE + 4] __attribute__ ((section ("AHBSRAM1")));   /* The packet buffer used when
+                    there is no received frame to work on. */
+u8_t *uip_buf = uip_default_buf;
+#else
 u8_t uip_buf[UIP_BUFSIZE + 4] __attribute__ ((section ("AHBSRAM1")));   /* The packet buffer that contains
                     incoming packets. */
+#endif /* UIP_CONF_ZERO_COPY */
 #endif /* UIP_CONF_EXTERNAL_BUFFER */
 
 void *uip_appdata;               /* The uip_appdata pointer points to
@@ -190,6 +196,23 @@ struct uip_udp_conn *uip_udp_conn;
 struct uip_udp_conn uip_udp_conns[UIP_UDP_CONNS]  __attribute__ ((section ("AHBSRAM1")));
 #endif /* UIP_UDP */
 
+#if UIP_TCP_SNDBUFS > 0
+/* A send buffer holds the data a connection has in flight, starting
+   at snd_nxt, so several segments can be unacknowledged at once. */
+struct uip_sndbuf {
+    u8_t *data;
+    u16_t size;
+    u16_t wnd;               /* The window last advertised by the peer. */
+    struct uip_conn *conn;   /* The connection using the buffer. */
+    u8_t ackpend;            /* The application has not yet been told its
+                    last segment was acknowledged. */
+    u8_t closepend;          /* The application closed the connection
+                    while data was still in flight. */
+};
+static struct uip_sndbuf uip_sndbufs[UIP_TCP_SNDBUFS];
+static u8_t uip_sndbufs_n;
+#endif /* UIP_TCP_SNDBUFS > 0 */
+
 static u16_t ipid;           /* Ths ipid variable is an increasing
                 number that is used for the IP ID
                 field. */
@@ -403,7 +426,13 @@ uip_init(void)
     }
     for (c = 0; c < UIP_CONNS; ++c) {
         uip_conns[c].tcpstateflags = UIP_CLOSED;
+#if UIP_TCP_SNDBUFS > 0
+        uip_conns[c].sndbuf = 0;
+#endif /* UIP_TCP_SNDBUFS > 0 */
     }
+#if UIP_TCP_SNDBUFS > 0
+    uip_sndbufs_n = 0;
+#endif /* UIP_TCP_SNDBUFS > 0 */
 #if UIP_ACTIVE_OPEN
     lastport = 1024;
 #endif /* UIP_ACTIVE_OPEN */
@@ -699,10 +728,126 @@ uip_add_rcv_nxt(u16_t n)
     uip_conn->rcv_nxt[3] = uip_acc32[3];
 }
 /*---------------------------------------------------------------------------*/
+static void
+uip_rtt_estimate(struct uip_conn *conn)
+{
+    signed char m;
+    m = conn->rto - conn->timer;
+    /* This is taken directly from VJs original code in his paper */
+    m = m - (conn->sa >> 3);
+    conn->sa += m;
+    if (m < 0) {
+        m = -m;
+    }
+    m = m - (conn->sv >> 2);
+    conn->sv += m;
+    conn->rto = (conn->sa >> 3) + conn->sv;
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP_SNDBUFS > 0
+u8_t
+uip_sndbuf_add(u8_t *buf, u16_t size)
+{
+    struct uip_sndbuf *sb;
+
+    if (buf == NULL || size < UIP_TCP_MSS || uip_sndbufs_n >= UIP_TCP_SNDBUFS) {
+        return 0;
+    }
+    sb = &uip_sndbufs[uip_sndbufs_n++];
+    sb->data = buf;
+    sb->size = size;
+    sb->conn = NULL;
+    return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the send buffer of a connection, buffers are only used in
+   the ESTABLISHED state. */
+static struct uip_sndbuf *
+uip_sndbuf_of(struct uip_conn *conn)
+{
+    struct uip_sndbuf *sb;
+
+    if (conn->sndbuf == 0 ||
+        (conn->tcpstateflags & UIP_TS_MASK) != UIP_ESTABLISHED) {
+        return NULL;
+    }
+    sb = &uip_sndbufs[conn->sndbuf - 1];
+    return sb->conn == conn ? sb : NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Gives a newly established connection a free send buffer, if there
+   is one. */
+static void
+uip_sndbuf_attach(struct uip_conn *conn, u16_t wnd)
+{
+    struct uip_sndbuf *sb;
+
+    conn->sndbuf = 0;
+    for (c = 0; c < uip_sndbufs_n; ++c) {
+        sb = &uip_sndbufs[c];
+        if (sb->conn == NULL || sb->conn == conn || uip_sndbuf_of(sb->conn) != sb) {
+            sb->conn = conn;
+            sb->wnd = wnd;
+            sb->ackpend = 0;
+            sb->closepend = 0;
+            conn->sndbuf = c + 1;
+            return;
+        }
+    }
+}
+/*---------------------------------------------------------------------------*/
+/* Checks if the application may send another segment. The buffer must
+   have room for a full initial MSS, so it never overflows whatever the
+   current MSS, and the data in flight must fit in the peer's window.
+   With nothing in flight one segment may always be sent, which also
+   probes a zero window. */
+static u8_t
+uip_sndbuf_ready(struct uip_sndbuf *sb, struct uip_conn *conn)
+{
+    u16_t limit;
+
+    if (conn->len == 0) {
+        return 1;
+    }
+    if (sb->size - conn->len < conn->initialmss) {
+        return 0;
+    }
+    limit = sb->wnd < sb->size ? sb->wnd : sb->size;
+    return limit >= conn->len + conn->mss;
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+uip_sndbuf_pollable(struct uip_conn *conn)
+{
+    struct uip_sndbuf *sb = uip_sndbuf_of(conn);
+
+    return sb != NULL && sb->ackpend && !sb->closepend && uip_sndbuf_ready(sb, conn);
+}
+/*---------------------------------------------------------------------------*/
+u8_t
+uip_sndbuf_inuse(struct uip_conn *conn)
+{
+    return uip_sndbuf_of(conn) != NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* The number of bytes a is ahead of b in sequence space. */
+static uint32_t
+uip_seqdiff(const u8_t *a, const u8_t *b)
+{
+    return (((uint32_t)a[0] << 24) | ((uint32_t)a[1] << 16) | ((uint32_t)a[2] << 8) | a[3]) -
+           (((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3]);
+}
+#endif /* UIP_TCP_SNDBUFS > 0 */
+/*---------------------------------------------------------------------------*/
 void
 uip_process(u8_t flag)
 {
     register struct uip_conn *uip_connr = uip_conn;
+#if UIP_TCP_SNDBUFS > 0
+    struct uip_sndbuf *sb = NULL;
+    u16_t sndoff = 0;
+    u8_t sndrexmit = 0;
+#endif /* UIP_TCP_SNDBUFS > 0 */
 
 #if UIP_UDP
     if (flag == UIP_UDP_SEND_CONN) {
@@ -715,6 +860,14 @@ uip_process(u8_t flag)
     /* Check if we were invoked because of a poll request for a
        particular connection. */
     if (flag == UIP_POLL_REQUEST) {
+#if UIP_TCP_SNDBUFS > 0
+        /* Connections with a send buffer may be polled with data in
+           flight. */
+        sb = uip_sndbuf_of(uip_connr);
+        if (sb != NULL) {
+            goto sndbuf_poll;
+        }
+#endif /* UIP_TCP_SNDBUFS > 0 */
         if ((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
             !uip_outstanding(uip_connr)) {
             uip_flags = UIP_POLL;
@@ -803,6 +956,19 @@ uip_process(u8_t flag)
 #endif /* UIP_ACTIVE_OPEN */
 
                         case UIP_ESTABLISHED:
+#if UIP_TCP_SNDBUFS > 0
+                            /* With a send buffer the oldest segment is resent
+                               from the buffer, without the application. */
+                            sb = uip_sndbuf_of(uip_connr);
+                            if (sb != NULL) {
+sndbuf_rexmit:
+                                uip_slen = uip_connr->len < uip_connr->mss ? uip_connr->len : uip_connr->mss;
+                                memcpy(uip_sappdata, sb->data, uip_slen);
+                                uip_len = uip_slen + UIP_TCPIP_HLEN;
+                                BUF->flags = TCP_ACK | TCP_PSH;
+                                goto tcp_send_noopts;
+                            }
+#endif /* UIP_TCP_SNDBUFS > 0 */
                             /* In the ESTABLISHED state, we call upon the application
                                    to do the actual retransmit after which we jump into
                                    the code for sending out the packet (the apprexmit
@@ -819,7 +985,19 @@ uip_process(u8_t flag)
 
                     }
                 }
+#if UIP_TCP_SNDBUFS > 0
+                sb = uip_sndbuf_of(uip_connr);
+                if (sb != NULL) {
+                    goto sndbuf_poll;
+                }
+#endif /* UIP_TCP_SNDBUFS > 0 */
             } else if ((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+#if UIP_TCP_SNDBUFS > 0
+                sb = uip_sndbuf_of(uip_connr);
+                if (sb != NULL) {
+                    goto sndbuf_poll;
+                }
+#endif /* UIP_TCP_SNDBUFS > 0 */
                 /* If there was no need for a retransmission, we poll the
                        application for new data. */
                 uip_flags = UIP_POLL;
@@ -828,6 +1006,31 @@ uip_process(u8_t flag)
             }
         }
         goto drop;
+
+#if UIP_TCP_SNDBUFS > 0
+sndbuf_poll:
+        /* Once everything in flight is acknowledged a pending close
+           sends its FIN. */
+        if (sb->closepend) {
+            if (uip_connr->len == 0) {
+                goto tcp_send_close;
+            }
+            goto drop;
+        }
+        /* Poll the application if it may send another segment, telling
+           it about the acknowledgement it has been waiting for. */
+        if (!uip_sndbuf_ready(sb, uip_connr)) {
+            goto drop;
+        }
+        uip_flags = UIP_POLL;
+        if (sb->ackpend) {
+            sb->ackpend = 0;
+            uip_flags |= UIP_ACKDATA;
+        }
+        uip_slen = 0;
+        UIP_APPCALL();
+        goto appsend;
+#endif /* UIP_TCP_SNDBUFS > 0 */
     }
 #if UIP_UDP
     if (flag == UIP_UDP_TIMER) {
@@ -1408,6 +1611,9 @@ tcp_send_synack:
 found:
     uip_conn = uip_connr;
     uip_flags = 0;
+#if UIP_TCP_SNDBUFS > 0
+    sb = uip_sndbuf_of(uip_connr);
+#endif /* UIP_TCP_SNDBUFS > 0 */
     /* We do a very naive form of TCP reset processing; we just accept
        any RST and kill our connection. We should in fact check if the
        sequence number of this reset is wihtin our advertised window
@@ -1445,6 +1651,35 @@ found:
        data. If so, we update the sequence number, reset the length of
        the outstanding data, calculate RTT estimations, and reset the
        retransmission timer. */
+#if UIP_TCP_SNDBUFS > 0
+    if ((BUF->flags & TCP_ACK) && uip_outstanding(uip_connr) && sb != NULL) {
+        /* With a send buffer any ack for part of the data in flight
+           releases that much of the buffer. The application is told
+           about acknowledgements further down. */
+        uint32_t acked = uip_seqdiff(BUF->ackno, uip_connr->snd_nxt);
+        if (acked > 0 && acked <= uip_connr->len) {
+            uip_add32(uip_connr->snd_nxt, acked);
+            uip_connr->snd_nxt[0] = uip_acc32[0];
+            uip_connr->snd_nxt[1] = uip_acc32[1];
+            uip_connr->snd_nxt[2] = uip_acc32[2];
+            uip_connr->snd_nxt[3] = uip_acc32[3];
+            uip_connr->len -= acked;
+            memmove(sb->data, sb->data + acked, uip_connr->len);
+
+            /* Only estimate the RTT when everything has been acked, as
+               the timer is restarted by every ack. */
+            if (uip_connr->nrtx == 0 && uip_connr->len == 0) {
+                uip_rtt_estimate(uip_connr);
+            }
+            /* An ack that follows a retransmission but leaves data in
+               flight means the next segment was probably lost too, so it
+               is resent straight away. */
+            sndrexmit = uip_connr->nrtx > 0 && uip_connr->len > 0;
+            uip_connr->timer = uip_connr->rto;
+            uip_connr->nrtx = 0;
+        }
+    } else
+#endif /* UIP_TCP_SNDBUFS > 0 */
     if ((BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
         uip_add32(uip_connr->snd_nxt, uip_connr->len);
 
@@ -1461,18 +1696,7 @@ found:
 
             /* Do RTT estimation, unless we have done retransmissions. */
             if (uip_connr->nrtx == 0) {
-                signed char m;
-                m = uip_connr->rto - uip_connr->timer;
-                /* This is taken directly from VJs original code in his paper */
-                m = m - (uip_connr->sa >> 3);
-                uip_connr->sa += m;
-                if (m < 0) {
-                    m = -m;
-                }
-                m = m - (uip_connr->sv >> 2);
-                uip_connr->sv += m;
-                uip_connr->rto = (uip_connr->sa >> 3) + uip_connr->sv;
-
+                uip_rtt_estimate(uip_connr);
             }
             /* Set the acknowledged flag. */
             uip_flags = UIP_ACKDATA;
@@ -1500,6 +1724,10 @@ found:
                 uip_connr->tcpstateflags = UIP_ESTABLISHED;
                 uip_flags = UIP_CONNECTED;
                 uip_connr->len = 0;
+#if UIP_TCP_SNDBUFS > 0
+                uip_sndbuf_attach(uip_connr, ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1]);
+                sb = uip_sndbuf_of(uip_connr);
+#endif /* UIP_TCP_SNDBUFS > 0 */
                 if (uip_len > 0) {
                     uip_flags |= UIP_NEWDATA;
                     uip_add_rcv_nxt(uip_len);
@@ -1558,6 +1786,10 @@ found:
                 uip_add_rcv_nxt(1);
                 uip_flags = UIP_CONNECTED | UIP_NEWDATA;
                 uip_connr->len = 0;
+#if UIP_TCP_SNDBUFS > 0
+                uip_sndbuf_attach(uip_connr, ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1]);
+                sb = uip_sndbuf_of(uip_connr);
+#endif /* UIP_TCP_SNDBUFS > 0 */
                 uip_len = 0;
                 uip_slen = 0;
                 UIP_APPCALL();
@@ -1651,6 +1883,35 @@ tcp_send_finack:
             }
             uip_connr->mss = tmp16;
 
+#if UIP_TCP_SNDBUFS > 0
+            if (sb != NULL) {
+                sb->wnd = ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1];
+
+                if (sndrexmit && !(uip_flags & UIP_NEWDATA)) {
+                    goto sndbuf_rexmit;
+                }
+
+                /* After a close the application is not called again, the
+                   FIN goes out once the buffer has drained. */
+                if (sb->closepend) {
+                    if (uip_connr->len == 0) {
+                        goto tcp_send_close;
+                    }
+                    if (uip_flags & UIP_NEWDATA) {
+                        goto tcp_send_ack;
+                    }
+                    goto drop;
+                }
+
+                /* The application sees its last segment as acknowledged
+                   once there is room to send another one. */
+                if (sb->ackpend && uip_sndbuf_ready(sb, uip_connr)) {
+                    sb->ackpend = 0;
+                    uip_flags |= UIP_ACKDATA;
+                }
+            }
+#endif /* UIP_TCP_SNDBUFS > 0 */
+
             /* If this packet constitutes an ACK for outstanding data (flagged
                by the UIP_ACKDATA flag, we should call the application since it
                might want to send more data. If the incoming packet had data
@@ -1682,6 +1943,15 @@ appsend:
 
                 if (uip_flags & UIP_CLOSE) {
                     uip_slen = 0;
+#if UIP_TCP_SNDBUFS > 0
+                    if (sb != NULL && uip_connr->len > 0) {
+                        /* Send the FIN when the buffered data has been
+                           acknowledged. */
+                        sb->closepend = 1;
+                        goto apprexmit;
+                    }
+tcp_send_close:
+#endif /* UIP_TCP_SNDBUFS > 0 */
                     uip_connr->len = 1;
                     uip_connr->tcpstateflags = UIP_FIN_WAIT_1;
                     uip_connr->nrtx = 0;
@@ -1690,6 +1960,26 @@ appsend:
                 }
 
                 /* If uip_slen > 0, the application has data to be sent. */
+#if UIP_TCP_SNDBUFS > 0
+                if (uip_slen > 0 && sb != NULL) {
+                    if (sb->ackpend) {
+                        /* The application has not been told its last
+                           segment was acknowledged so this is a retransmit,
+                           which has already been done from the buffer. */
+                        uip_slen = 0;
+                    } else {
+                        /* Copy the segment to the end of the data in flight,
+                           uip_sndbuf_ready() made sure there is room. */
+                        if (uip_slen > uip_connr->mss) {
+                            uip_slen = uip_connr->mss;
+                        }
+                        memcpy(sb->data + uip_connr->len, uip_sappdata, uip_slen);
+                        sndoff = uip_connr->len;
+                        uip_connr->len += uip_slen;
+                        sb->ackpend = 1;
+                    }
+                } else
+#endif /* UIP_TCP_SNDBUFS > 0 */
                 if (uip_slen > 0) {
 
                     /* If the connection has acknowledged data, the contents of
@@ -1721,6 +2011,11 @@ appsend:
                         uip_slen = uip_connr->len;
                     }
                 }
+#if UIP_TCP_SNDBUFS > 0
+                /* With a send buffer the retransmit count belongs to the
+                   oldest segment in flight, it is reset by its ack. */
+                if (sb == NULL)
+#endif /* UIP_TCP_SNDBUFS > 0 */
                 uip_connr->nrtx = 0;
 apprexmit:
                 uip_appdata = uip_sappdata;
@@ -1729,7 +2024,11 @@ apprexmit:
                    packet had new data in it, we must send out a packet. */
                 if (uip_slen > 0 && uip_connr->len > 0) {
                     /* Add the length of the IP and TCP headers. */
+#if UIP_TCP_SNDBUFS > 0
+                    uip_len = (sb != NULL ? uip_slen : uip_connr->len) + UIP_TCPIP_HLEN;
+#else /* UIP_TCP_SNDBUFS > 0 */
                     uip_len = uip_connr->len + UIP_TCPIP_HLEN;
+#endif /* UIP_TCP_SNDBUFS > 0 */
                     /* We always set the ACK flag in response packets. */
                     BUF->flags = TCP_ACK | TCP_PSH;
                     /* Send the packet. */
@@ -1830,10 +2129,23 @@ tcp_send:
     BUF->ackno[2] = uip_connr->rcv_nxt[2];
     BUF->ackno[3] = uip_connr->rcv_nxt[3];
 
-    BUF->seqno[0] = uip_connr->snd_nxt[0];
-    BUF->seqno[1] = uip_connr->snd_nxt[1];
-    BUF->seqno[2] = uip_connr->snd_nxt[2];
-    BUF->seqno[3] = uip_connr->snd_nxt[3];
+#if UIP_TCP_SNDBUFS > 0
+    /* A new segment from a send buffer follows the data already in
+       flight. */
+    if (sndoff > 0) {
+        uip_add32(uip_connr->snd_nxt, sndoff);
+        BUF->seqno[0] = uip_acc32[0];
+        BUF->seqno[1] = uip_acc32[1];
+        BUF->seqno[2] = uip_acc32[2];
+        BUF->seqno[3] = uip_acc32[3];
+    } else
+#endif /* UIP_TCP_SNDBUFS > 0 */
+    {
+        BUF->seqno[0] = uip_connr->snd_nxt[0];
+        BUF->seqno[1] = uip_connr->snd_nxt[1];
+        BUF->seqno[2] = uip_connr->snd_nxt[2];
+        BUF->seqno[3] = uip_connr->snd_nxt[3];
+    }
 
     BUF->proto = UIP_PROTO_TCP;
 
@@ -427,11 +427,23 @@ void uip_setipid(u16_t id);
  \endcode
  */
 
+#if UIP_CONF_ZERO_COPY
+/* uip_buf points at the received frame being processed, or at
+   uip_default_buf when uIP is polling or sending on its own. */
+#ifdef __cplusplus
+extern "C" u8_t *uip_buf;
+extern "C" u8_t uip_default_buf[UIP_BUFSIZE+4];
+#else
+extern u8_t *uip_buf;
+extern u8_t uip_default_buf[UIP_BUFSIZE+4];
+#endif
+#else
 #ifdef __cplusplus
 extern "C" u8_t uip_buf[UIP_BUFSIZE+4];
 #else
 extern u8_t uip_buf[UIP_BUFSIZE+4];
 #endif
+#endif /* UIP_CONF_ZERO_COPY */
 
 #ifdef __cplusplus
 extern "C" {
@@ -478,6 +490,41 @@ void uip_listen(u16_t port);
  */
 void uip_unlisten(u16_t port);
 
+#if UIP_TCP_SNDBUFS > 0
+struct uip_conn;
+
+/**
+ * Register a TCP send buffer.
+ *
+ * Connections are given a free send buffer when they are established,
+ * the buffer holds the data that is in flight so the connection can
+ * send another segment before the previous one is acknowledged.
+ *
+ * \param buf The buffer memory, it must stay allocated.
+ * \param size The size of the buffer, at least UIP_TCP_MSS bytes.
+ *
+ * \return 1 if the buffer was added, 0 if it is too small or all
+ * UIP_TCP_SNDBUFS slots are used.
+ */
+u8_t uip_sndbuf_add(u8_t *buf, u16_t size);
+
+/**
+ * Check if a connection has room in its send buffer and is waiting to
+ * be told its last segment was acknowledged, if so uip_poll_conn() will
+ * let it send another segment straight away.
+ *
+ * \param conn The connection to check.
+ */
+u8_t uip_sndbuf_pollable(struct uip_conn *conn);
+
+/**
+ * Check if a connection is using a send buffer.
+ *
+ * \param conn The connection to check.
+ */
+u8_t uip_sndbuf_inuse(struct uip_conn *conn);
+#endif /* UIP_TCP_SNDBUFS > 0 */
+
 #ifdef __cplusplus
 }
 #endif
@@ -1206,6 +1253,10 @@ struct uip_conn {
   u8_t timer;         /**< The retransmission timer. */
   u8_t nrtx;          /**< The number of retransmissions for the last
 			 segment sent. */
+#if UIP_TCP_SNDBUFS > 0
+  u8_t sndbuf;        /**< The send buffer used by the connection plus
+			 one, 0 when it has none. */
+#endif /* UIP_TCP_SNDBUFS > 0 */
 
   /** The application state. */
   uip_tcp_appstate_t appstate;
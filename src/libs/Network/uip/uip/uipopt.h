@@ -319,6 +319,24 @@
 #define UIP_RECEIVE_WINDOW UIP_CONF_RECEIVE_WINDOW
 #endif
 
+/**
+ * The number of TCP send buffers.
+ *
+ * A connection that gets a send buffer when it is established keeps
+ * copies of the segments it has sent, so it can have several segments
+ * in flight and the application is told its data was acknowledged as
+ * soon as it has been buffered. The buffers themselves are registered
+ * with uip_sndbuf_add(). Set to 0 for the original one segment per
+ * connection behaviour.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_CONF_TCP_SNDBUFS
+#define UIP_TCP_SNDBUFS 0
+#else
+#define UIP_TCP_SNDBUFS UIP_CONF_TCP_SNDBUFS
+#endif
+
 /**
  * How long a connection should stay in the TIME_WAIT state.
  *
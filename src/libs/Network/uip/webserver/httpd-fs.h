@@ -40,6 +40,8 @@
 struct httpd_fs_file {
   char *data;
   int len;
+  char *etag;  /* quoted ETag of the uncompressed contents */
+  int gzip;    /* data is gzip compressed */
 };
 
 /* file must be allocated by caller and will be filled in
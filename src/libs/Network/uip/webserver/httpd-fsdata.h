@@ -47,6 +47,8 @@ struct httpd_fsdata_file {
   const unsigned char *name;
   const unsigned char *data;
   const int len;
+  const char *etag;
+  const int gzip;
 #ifdef HTTPD_FS_STATISTICS
 #if HTTPD_FS_STATISTICS == 1
   u16_t count;
@@ -59,6 +61,8 @@ struct httpd_fsdata_file_noconst {
   char *name;
   char *data;
   int len;
+  char *etag;
+  int gzip;
 #ifdef HTTPD_FS_STATISTICS
 #if HTTPD_FS_STATISTICS == 1
   u16_t count;
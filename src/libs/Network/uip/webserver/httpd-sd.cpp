@@ -0,0 +1,33 @@
+// ETags for files served from the sd card
+
+#include "DirHandle.h"
+
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <string>
+
+// makes a quoted ETag from the size and modification time in the files directory entry
+// returns 0 if the file was not found so no ETag can be given
+extern "C" int httpd_sd_etag(const char *filename, char *etag, int len)
+{
+    const char *name = strrchr(filename, '/');
+    if(name == NULL || name == filename) return 0;
+    std::string dir(filename, name - filename);
+    ++name;
+
+    DIR *d = opendir(dir.c_str());
+    if(d == NULL) return 0;
+
+    int found = 0;
+    struct dirent *p;
+    while((p = readdir(d)) != NULL) {
+        if(!p->d_isdir && strcasecmp(p->d_name, name) == 0) {
+            snprintf(etag, len, "\"%x-%04x%04x\"", p->d_fsize, p->d_fdate, p->d_ftime);
+            found = 1;
+            break;
+        }
+    }
+    closedir(d);
+    return found;
+}
@@ -74,8 +74,7 @@
 
 #include "CommandQueue.h"
 #include "CallbackStream.h"
-
-#include "c-fifo.h"
+#include "FileWriter.h"
 
 #define STATE_WAITING 0
 #define STATE_HEADERS 1
@@ -103,7 +102,7 @@
 // we need to stall the upstream sender return 0 if stalled 1 if ok to keep
 // providing more -1 if the connection has closed or is not in output state.
 // need to see which connection to send to based on state and add result to
-// that fifo for each connection. NOTE this will not get called if the
+// that connections response buffer. NOTE this will not get called if the
 // connection has been closed and the stream will get deleted when the last
 // command has been executed
 static int command_result(const char *str, void *state)
@@ -117,15 +116,14 @@ static int command_result(const char *str, void *state)
 
     if (str == NULL) {
         DEBUG_PRINTF("End of command (%p)\n", state);
-        fifo_push(s->fifo, NULL);
+        response_buffer_end(s->responses);
 
     } else {
-        if (fifo_size(s->fifo) < 10) {
+        if (response_buffer_put(s->responses, str)) {
             DEBUG_PRINTF("Got command result (%p): %s", state, str);
-            fifo_push(s->fifo, strdup(str));
             return 1;
         } else {
-            DEBUG_PRINTF("command result fifo is full (%p)\n", state);
+            DEBUG_PRINTF("command response buffer is full (%p)\n", state);
             return 0;
         }
     }
@@ -135,48 +133,36 @@ static int command_result(const char *str, void *state)
 static void create_callback_stream(struct httpd_state *s)
 {
     // need to create a callback stream here, but do one per connection pass
-    // the state to the callback, also create the fifo for the command results
-    s->fifo = new_fifo();
+    // the state to the callback, also create the buffer for the command results
+    s->responses = new_response_buffer();
     s->pstream = new_callback_stream(command_result, s);
 }
 
-// Used to save files to SDCARD during upload
-static FILE *fd;
-static char *output_filename = NULL;
-static int file_cnt = 0;
+// Used to save files to SDCARD during upload, buffered so the card is written a few sectors at a time
+static void *writer = NULL;
 static int open_file(const char *fn)
 {
-    if (output_filename != NULL) free(output_filename);
-    output_filename = malloc(strlen(fn) + 5);
+    char *output_filename = malloc(strlen(fn) + 5);
+    if (output_filename == NULL) return 0;
     strcpy(output_filename, "/sd/");
     strcat(output_filename, fn);
-    fd = fopen(output_filename, "w");
-    if (fd == NULL) {
-        free(output_filename);
-        output_filename = NULL;
-        return 0;
-    }
-    return 1;
+    if (writer != NULL) delete_file_writer(writer);
+    writer = new_file_writer(output_filename, "w");
+    free(output_filename);
+    return writer != NULL;
 }
 
 static int close_file()
 {
-    free(output_filename);
-    output_filename = NULL;
-    fclose(fd);
-    return 1;
+    if (writer == NULL) return 0;
+    int ok = delete_file_writer(writer);
+    writer = NULL;
+    return ok;
 }
 
 static int save_file(uint8_t *buf, unsigned int len)
 {
-    if (fwrite(buf, 1, len, fd) == len) {
-        file_cnt += len;
-        // HACK alert work around bug causing file corruption when writing large amounts of data
-        if (file_cnt >= 400) {
-            file_cnt = 0;
-            fclose(fd);
-            fd = fopen(output_filename, "a");
-        }
+    if (file_writer_write(writer, buf, len)) {
         return 1;
 
     } else {
@@ -203,24 +189,31 @@ static int fs_open(struct httpd_state *s)
 }
 
 /*---------------------------------------------------------------------------*/
+static unsigned short generate_command_response(void *state)
+{
+    struct httpd_state *s = (struct httpd_state *)state;
+    // a retransmit has to resend exactly what was sent before, even if more results have arrived since
+    if (!uip_rexmit()) {
+        s->len = response_buffer_size(s->responses);
+        if (s->len > uip_mss()) s->len = uip_mss();
+    }
+    return response_buffer_peek(s->responses, uip_appdata, s->len);
+}
+
 static PT_THREAD(send_command_response(struct httpd_state *s))
 {
     PSOCK_BEGIN(&s->sout);
 
     do {
-        PSOCK_WAIT_UNTIL( &s->sout, fifo_size(s->fifo) > 0 );
-        s->strbuf = fifo_pop(s->fifo);
-        if (s->strbuf != NULL) {
-            // send it
-            DEBUG_PRINTF("Sending response: %s", s->strbuf);
-            // TODO send as much as we can in one packet
-            PSOCK_SEND_STR(&s->sout, s->strbuf);
-            // free the strdup
-            free(s->strbuf);
-        }else if(--s->command_count <= 0) {
-            // when all commands have completed exit
+        PSOCK_WAIT_UNTIL( &s->sout, response_buffer_size(s->responses) > 0 || response_buffer_ended(s->responses) >= s->command_count );
+        if (response_buffer_size(s->responses) == 0) {
+            // when all commands have completed and their results are sent exit
             break;
         }
+        // send all the results we have so far, up to a full segment
+        PSOCK_GENERATOR_SEND(&s->sout, generate_command_response, s);
+        DEBUG_PRINTF("Sent %d bytes of response\n", s->len);
+        response_buffer_consume(s->responses, s->len);
     } while (1);
 
     PSOCK_END(&s->sout);
@@ -245,6 +238,8 @@ static unsigned short generate_part_of_sd_file(void *state)
 {
     struct httpd_state *s = (struct httpd_state *)state;
 
+    // a retransmit has to resend the same part of the file
+    if (uip_rexmit() && s->len > 0) fseek(s->fd, -s->len, SEEK_CUR);
     int len = fread(uip_appdata, 1, uip_mss(), s->fd);
     if (len <= 0) {
         // we need to send something
@@ -287,6 +282,41 @@ static PT_THREAD(send_sd_file(struct httpd_state *s))
 }
 
 /*---------------------------------------------------------------------------*/
+// puts the ETag, Cache-Control and Content-Encoding headers for the opened file in inputbuf,
+// which is free once the request has been read, returns 1 if the client already has this version
+static int make_file_headers(struct httpd_state *s, int cacheable)
+{
+    char *p = s->inputbuf;
+    int matched = 0;
+
+    *p = 0;
+    if (cacheable) {
+        strcpy(p, "ETag: ");
+        p += 6;
+        if (s->fd != NULL) {
+            if (!httpd_sd_etag(s->filename, p, 20)) p[0] = 0;
+        } else {
+            strcpy(p, s->file.etag);
+        }
+        if (p[0] != 0) {
+            matched = strcmp(p, s->if_none_match) == 0;
+            p += strlen(p);
+            // the client has to check each time, which costs a 304 and none of the file
+            strcpy(p, "\r\nCache-Control: no-cache\r\n");
+            p += strlen(p);
+        } else {
+            p = s->inputbuf;
+            *p = 0;
+        }
+    }
+    if (s->fd == NULL && s->file.gzip) {
+        strcpy(p, "Content-Encoding: gzip\r\n");
+    }
+
+    s->file_headers = 1;
+    return matched;
+}
+
 static PT_THREAD(send_headers_3(struct httpd_state *s, const char *statushdr, char send_content_type))
 {
     char *ptr;
@@ -295,6 +325,9 @@ static PT_THREAD(send_headers_3(struct httpd_state *s, const char *statushdr, ch
 
     PSOCK_SEND_STR(&s->sout, statushdr);
     PSOCK_SEND_STR(&s->sout, http_header_all);
+    if (s->file_headers && s->inputbuf[0] != 0) {
+        PSOCK_SEND_STR(&s->sout, s->inputbuf);
+    }
 
     if (send_content_type) {
         ptr = strrchr(s->filename, ISO_period);
@@ -313,6 +346,9 @@ static PT_THREAD(send_headers_3(struct httpd_state *s, const char *statushdr, ch
         } else {
             PSOCK_SEND_STR(&s->sout, http_content_type_plain);
         }
+    } else {
+        // end of the headers, there is no body
+        PSOCK_SEND_STR(&s->sout, "\r\n");
     }
     PSOCK_END(&s->sout);
 }
@@ -355,6 +391,7 @@ PT_THREAD(handle_output(struct httpd_state *s))
             DEBUG_PRINTF("Unknown POST: %s\n", s->filename);
             httpd_fs_open(http_404_html, &s->file);
             strcpy(s->filename, http_404_html);
+            make_file_headers(s, 0);
             PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_404));
             PT_WAIT_THREAD(&s->outputpt, send_file(s));
         }
@@ -365,10 +402,11 @@ PT_THREAD(handle_output(struct httpd_state *s))
             DEBUG_PRINTF("404 file not found\n");
             httpd_fs_open(http_404_html, &s->file);
             strcpy(s->filename, http_404_html);
+            make_file_headers(s, 0);
             PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_404));
             PT_WAIT_THREAD(&s->outputpt, send_file(s));
 
-        } else if (s->cache_page) {
+        } else if (make_file_headers(s, 1)) {
             if (s->fd != NULL) {
                 // if it was an sd file then we need to close it
                 fclose(s->fd);
@@ -463,8 +501,7 @@ static PT_THREAD(handle_uploaded_data(struct httpd_state *s, uint8_t *buf, int l
         }
     }
 
-    close_file();
-    s->uploadok = 1;
+    s->uploadok = close_file();
     DEBUG_PRINTF("finished upload\n");
 
     PT_END(&s->inputpt);
@@ -509,7 +546,8 @@ PT_THREAD(handle_input(struct httpd_state *s))
 
     s->state = STATE_HEADERS;
     s->content_length = 0;
-    s->cache_page = 0;
+    s->file_headers = 0;
+    s->if_none_match[0] = 0;
     while (1) {
         if (s->state == STATE_HEADERS) {
             // read the headers of the request
@@ -543,16 +581,18 @@ PT_THREAD(handle_input(struct httpd_state *s))
                     strncpy(s->upload_name, &s->inputbuf[12], sizeof(s->upload_name) - 1);
                     DEBUG_PRINTF("Upload name= %s\n", s->upload_name);
 
-                } else if (strncmp(s->inputbuf, http_cache_control, sizeof(http_cache_control) - 1) == 0) {
+                } else if (strncmp(s->inputbuf, http_if_none_match, sizeof(http_if_none_match) - 1) == 0) {
                     s->inputbuf[PSOCK_DATALEN(&s->sin) - 2] = 0;
-                    s->cache_page = strncmp(http_no_cache, &s->inputbuf[sizeof(http_cache_control) - 1], sizeof(http_no_cache) - 1) != 0;
-                    DEBUG_PRINTF("cache page= %d\n", s->cache_page);
+                    strncpy(s->if_none_match, &s->inputbuf[sizeof(http_if_none_match) - 1], sizeof(s->if_none_match) - 1);
+                    s->if_none_match[sizeof(s->if_none_match) - 1] = 0;
+                    DEBUG_PRINTF("If-None-Match= %s\n", s->if_none_match);
+
                 }
             }
 
         } else if (s->state == STATE_BODY) {
             if (s->method == POST && strcmp(s->filename, "/command") == 0) {
-                // create a callback stream and fifo for the results as it is a command
+                // create a callback stream and response buffer for the results as it is a command
                 create_callback_stream(s);
 
             } else if (s->method == POST && strcmp(s->filename, "/command_silent") == 0) {
@@ -637,8 +677,7 @@ httpd_appcall(void)
         /*    timer_set(&s->timer, CLOCK_SECOND * 100);*/
         s->timer = 0;
         s->fd = NULL;
-        s->strbuf = NULL;
-        s->fifo = NULL;
+        s->responses = NULL;
         s->pstream = NULL;
     }
 
@@ -661,11 +700,10 @@ httpd_appcall(void)
 
     if (uip_closed() || uip_aborted() || uip_timedout()) {
         DEBUG_PRINTF("Closing connection: %d\n", HTONS(uip_conn->rport));
-        if (s->fd != NULL) fclose(fd); // clean up
-        if (s->strbuf != NULL) free(s->strbuf);
+        if (s->fd != NULL) fclose(s->fd); // clean up
         if (s->pstream != NULL) {
             // free these if they were allocated
-            delete_fifo(s->fifo);
+            delete_response_buffer(s->responses);
             delete_callback_stream(s->pstream); // this will mark it as closed and will get deleted when no longer needed
         }
         free(s) ;
@@ -51,14 +51,14 @@ struct httpd_state {
   struct httpd_fs_file file;
   FILE *fd;
   uint16_t len;
-  char *strbuf;
   int content_length;
   uint16_t count;
   uint8_t uploadok;
   uint8_t upload_state;
-  uint8_t cache_page;
+  uint8_t file_headers;
+  char if_none_match[20];
   void *pstream;
-  void *fifo;
+  void *responses;
   uint16_t command_count;
 };
 
@@ -72,6 +72,8 @@ void httpd_appcall(void);
 void httpd_log(char *msg);
 void httpd_log_file(u16_t *requester, char *file);
 
+int httpd_sd_etag(const char *filename, char *etag, int len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,11 +1,17 @@
 #!/usr/bin/perl
 
+# Files are stored gzipped when that makes them smaller, and each gets an
+# ETag made from its uncompressed contents, so browsers can cache them
+
+use IO::Compress::Gzip qw(gzip $GzipError);
+use Digest::MD5 qw(md5_hex);
+
 open(OUTPUT, "> httpd-fsdata2.h");
 
 chdir("httpd-fs");
 
 opendir(DIR, ".");
-@files =  grep { !/^\./ && !/(CVS|~)/ } readdir(DIR);
+@files =  sort grep { !/^\./ && !/(CVS|~)/ } readdir(DIR);
 closedir(DIR);
 
 foreach $file (@files) {
@@ -13,7 +19,7 @@ foreach $file (@files) {
     if(-d $file && $file !~ /^\./) {
 	print "Processing directory $file\n";
 	opendir(DIR, $file);
-	@newfiles =  grep { !/^\./ && !/(CVS|~)/ } readdir(DIR);
+	@newfiles =  sort grep { !/^\./ && !/(CVS|~)/ } readdir(DIR);
 	closedir(DIR);
 	printf "Adding files @newfiles\n";
 	@files = (@files, map { $_ = "$file/$_" } @newfiles);
@@ -24,9 +30,23 @@ foreach $file (@files) {
 foreach $file (@files) {
     if(-f $file) {
 
-	print "Adding file $file\n";
-
 	open(FILE, $file) || die "Could not open file $file\n";
+	binmode(FILE);
+	local $/;
+	$contents = <FILE>;
+	close(FILE);
+
+	# -Minimal leaves out the name and timestamp so the output only changes when the file does
+	gzip(\$contents => \$gzipped, -Level => 9, -Minimal => 1) || die "gzip failed: $GzipError\n";
+	$etag = substr(md5_hex($contents), 0, 8);
+	if(length($gzipped) < length($contents)) {
+	    $data = $gzipped;
+	    $isgzip = 1;
+	} else {
+	    $data = $contents;
+	    $isgzip = 0;
+	}
+	printf("Adding file $file %d bytes%s\n", length($data), $isgzip ? sprintf(" (gzipped from %d)", length($contents)) : "");
 
 	$file =~ s-^-/-;
 	$fvar = $file;
@@ -42,11 +62,11 @@ foreach $file (@files) {
 
 
 	$i = 0;
-	while(read(FILE, $data, 1)) {
+	for($j = 0; $j < length($data); $j++) {
 	    if($i == 0) {
 		print(OUTPUT "\t");
 	    }
-	    printf(OUTPUT "%#02x, ", unpack("C", $data));
+	    printf(OUTPUT "%#02x, ", unpack("C", substr($data, $j, 1)));
 	    $i++;
 	    if($i == 10) {
 		print(OUTPUT "\n");
@@ -54,9 +74,10 @@ foreach $file (@files) {
 	    }
 	}
 	print(OUTPUT "0};\n\n");
-	close(FILE);
 	push(@fvars, $fvar);
 	push(@pfiles, $file);
+	push(@etags, $etag);
+	push(@gzips, $isgzip);
     }
 }
 
@@ -71,7 +92,8 @@ for($i = 0; $i < @fvars; $i++) {
     }
     print(OUTPUT "const struct httpd_fsdata_file file".$fvar."[] = {{$prevfile, data$fvar, ");
     print(OUTPUT "data$fvar + ". (length($file) + 1) .", ");
-    print(OUTPUT "sizeof(data$fvar) - ". (length($file) + 2) ."}};\n\n"); # don't include the terminating nul
+    print(OUTPUT "sizeof(data$fvar) - ". (length($file) + 2) .", "); # don't include the terminating nul
+    print(OUTPUT "\"\\\"$etags[$i]\\\"\", $gzips[$i]}};\n\n");
 }
 
 print(OUTPUT "#define HTTPD_FS_ROOT file$fvars[$i - 1]\n\n");
@@ -163,33 +163,64 @@ Pin* Pin::pull_down(){
     return this;
 }
 
-// If available on this pin, return mbed hardware pwm class for this pin
-mbed::PwmOut* Pin::hardware_pwm()
+// the PWM1 channels claimed by hardware_pwm()
+static uint8_t pwm_channels_used= 0;
+
+// the mbed name and PWM1 channel of a PWM pin, NC if it is not one
+static PinName pwm_pin_name(int port_number, int pin, int& channel)
 {
+    PinName name= NC;
+    channel= 0;
+
     if (port_number == 1)
     {
-        if (pin == 18) { return new mbed::PwmOut(P1_18); }
-        if (pin == 20) { return new mbed::PwmOut(P1_20); }
-        if (pin == 21) { return new mbed::PwmOut(P1_21); }
-        if (pin == 23) { return new mbed::PwmOut(P1_23); }
-        if (pin == 24) { return new mbed::PwmOut(P1_24); }
-        if (pin == 26) { return new mbed::PwmOut(P1_26); }
+        if (pin == 18) { name= P1_18; channel= 1; }
+        if (pin == 20) { name= P1_20; channel= 2; }
+        if (pin == 21) { name= P1_21; channel= 3; }
+        if (pin == 23) { name= P1_23; channel= 4; }
+        if (pin == 24) { name= P1_24; channel= 5; }
+        if (pin == 26) { name= P1_26; channel= 6; }
     }
     else if (port_number == 2)
     {
-        if (pin == 0) { return new mbed::PwmOut(P2_0); }
-        if (pin == 1) { return new mbed::PwmOut(P2_1); }
-        if (pin == 2) { return new mbed::PwmOut(P2_2); }
-        if (pin == 3) { return new mbed::PwmOut(P2_3); }
-        if (pin == 4) { return new mbed::PwmOut(P2_4); }
-        if (pin == 5) { return new mbed::PwmOut(P2_5); }
+        if (pin == 0) { name= P2_0; channel= 1; }
+        if (pin == 1) { name= P2_1; channel= 2; }
+        if (pin == 2) { name= P2_2; channel= 3; }
+        if (pin == 3) { name= P2_3; channel= 4; }
+        if (pin == 4) { name= P2_4; channel= 5; }
+        if (pin == 5) { name= P2_5; channel= 6; }
     }
     else if (port_number == 3)
     {
-        if (pin == 25) { return new mbed::PwmOut(P3_25); }
-        if (pin == 26) { return new mbed::PwmOut(P3_26); }
+        if (pin == 25) { name= P3_25; channel= 2; }
+        if (pin == 26) { name= P3_26; channel= 3; }
     }
-    return nullptr;
+    return name;
+}
+
+// If available on this pin, return mbed hardware pwm class for this pin
+// returns nullptr if it is not a PWM pin or its PWM1 channel is already used by another pin
+mbed::PwmOut* Pin::hardware_pwm()
+{
+    int channel;
+    PinName name= pwm_pin_name(port_number, pin, channel);
+
+    if (name == NC || (pwm_channels_used & (1 << channel))) return nullptr;
+    pwm_channels_used |= (1 << channel);
+    return new mbed::PwmOut(name);
+}
+
+// Stops the PWM output returned by hardware_pwm() for this pin, puts the pin back to GPIO and frees its channel
+void Pin::release_hardware_pwm(mbed::PwmOut *pwm)
+{
+    int channel;
+    if (pwm == nullptr || pwm_pin_name(port_number, pin, channel) == NC) return;
+
+    LPC_PWM1->PCR &= ~(1 << (8 + channel));
+    volatile uint32_t *pinsel = &LPC_PINCON->PINSEL0 + port_number * 2 + (pin >= 16);
+    *pinsel &= ~(3 << ((pin % 16) * 2));
+    delete pwm;
+    pwm_channels_used &= ~(1 << channel);
 }
 
 mbed::InterruptIn* Pin::interrupt_pin()
@@ -201,7 +232,13 @@ mbed::InterruptIn* Pin::interrupt_pin()
 
     if (port_number == 0 || port_number == 2) {
         PinName pinname = port_pin((PortName)port_number, pin);
-        return new mbed::InterruptIn(pinname);
+        // InterruptIn sets the pin to pull down, keep the mode from the pin definition
+        volatile uint32_t *pinmode = &LPC_PINCON->PINMODE0 + port_number * 2 + (pin >= 16);
+        uint32_t shift = (pin % 16) * 2;
+        uint32_t mode = (*pinmode >> shift) & 3;
+        mbed::InterruptIn *in = new mbed::InterruptIn(pinname);
+        *pinmode = (*pinmode & ~(3 << shift)) | (mode << shift);
+        return in;
 
     }else{
         this->valid= false;
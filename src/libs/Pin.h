@@ -64,6 +64,7 @@ class Pin {
         }
 
         mbed::PwmOut *hardware_pwm();
+        void release_hardware_pwm(mbed::PwmOut *pwm);
 
         mbed::InterruptIn *interrupt_pin();
 
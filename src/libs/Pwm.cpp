@@ -1,28 +1,140 @@
 #include "Pwm.h"
 
+#include "libs/Kernel.h"
+#include "SlowTicker.h"
+#include "PwmOut.h"
 #include "utils.h"
 
+#include <vector>
+#include <algorithm>
+
 #define PID_PWM_MAX 256
 
-// What ?
+// Software outputs ticked at the same frequency, one SlowTicker hook for all of them
+// that writes each GPIO port they are on once per tick instead of once per output
+class PwmGroup {
+public:
+    PwmGroup(uint32_t f) : frequency(f), hook(nullptr) {}
+    uint32_t on_tick(uint32_t);
+
+    uint32_t frequency;
+    Hook *hook;
+    std::vector<Pwm*> outputs;
+};
+
+static std::vector<PwmGroup*> pwm_groups;
+
+uint32_t PwmGroup::on_tick(uint32_t dummy)
+{
+    static LPC_GPIO_TypeDef * const ports[5] = { LPC_GPIO0, LPC_GPIO1, LPC_GPIO2, LPC_GPIO3, LPC_GPIO4 };
+    uint32_t set[5] = {0}, clr[5] = {0};
+
+    for (Pwm *p : outputs) {
+        int state = p->next_state();
+        if (state < 0) continue;
+        if (p->is_inverting() ^ state)
+            set[(int)p->port_number] |= 1 << p->pin;
+        else
+            clr[(int)p->port_number] |= 1 << p->pin;
+    }
+
+    for (int i = 0; i < 5; i++) {
+        if (set[i]) ports[i]->FIOSET = set[i];
+        if (clr[i]) ports[i]->FIOCLR = clr[i];
+    }
+
+    return dummy;
+}
 
 Pwm::Pwm()
 {
+    _hardware = nullptr;
     _max = PID_PWM_MAX - 1;
     _pwm = -1;
     _sd_direction= false;
     _sd_accumulator= 0;
 }
 
+Pwm::~Pwm()
+{
+    release_hardware_pwm(_hardware);
+
+    // stop the group ticking this output, and stop the group when it was the last one
+    for (auto g = pwm_groups.begin(); g != pwm_groups.end(); ++g) {
+        PwmGroup *group = *g;
+        auto i = std::find(group->outputs.begin(), group->outputs.end(), this);
+        if (i == group->outputs.end()) continue;
+
+        __disable_irq();
+        group->outputs.erase(i);
+        __enable_irq();
+
+        if (group->outputs.empty()) {
+            // once detached the hook is not called again so the group can go
+            THEKERNEL->slow_ticker->detach(group->hook);
+            pwm_groups.erase(g);
+            delete group;
+        }
+        break;
+    }
+}
+
+void Pwm::attach(uint32_t frequency)
+{
+    if (!connected() || _hardware != nullptr) return;
+
+    PwmGroup *group = nullptr;
+    for (PwmGroup *g : pwm_groups) {
+        if (g->frequency == frequency) {
+            group = g;
+            break;
+        }
+    }
+
+    if (group == nullptr) {
+        group = new PwmGroup(frequency);
+        pwm_groups.push_back(group);
+        group->outputs.push_back(this);
+        group->hook = THEKERNEL->slow_ticker->attach(frequency, group, &PwmGroup::on_tick);
+    } else {
+        // the group is already being ticked
+        __disable_irq();
+        group->outputs.push_back(this);
+        __enable_irq();
+    }
+}
+
+bool Pwm::use_hardware()
+{
+    if (!connected()) return false;
+
+    // the channels share one period, creating a PwmOut sets it back to 20ms so keep any period already set
+    bool running = (LPC_SC->PCONP & (1 << 6)) != 0;
+    uint32_t period = LPC_PWM1->MR0;
+
+    _hardware = hardware_pwm();
+    if (_hardware == nullptr) return false;
+
+    if (running && period > 0) _hardware->period_us(period / (SystemCoreClock / 4000000));
+    write_hardware(0);
+    return true;
+}
+
 void Pwm::pwm(int new_pwm)
 {
     _pwm = confine(new_pwm, 0, _max);
+    if (_hardware != nullptr) write_hardware((float)_pwm / (PID_PWM_MAX - 1));
+}
+
+void Pwm::write_hardware(float duty)
+{
+    _hardware->write(is_inverting() ? 1.0F - duty : duty);
 }
 
 Pwm* Pwm::max_pwm(int new_max)
 {
     _max = confine(new_max, 0, PID_PWM_MAX - 1);
-    _pwm = confine(   _pwm, 0, _max);
+    pwm(_pwm);
     return this;
 }
 
@@ -34,21 +146,23 @@ int Pwm::max_pwm()
 void Pwm::set(bool value)
 {
     _pwm = -1;
-    Pin::set(value);
+    if (_hardware != nullptr)
+        write_hardware(value ? 1.0F : 0.0F);
+    else
+        Pin::set(value);
 }
 
-uint32_t Pwm::on_tick(uint32_t dummy)
+// the output for this tick, or -1 if the pin has been set directly and is left alone
+int Pwm::next_state()
 {
     if ((_pwm < 0) || _pwm >= PID_PWM_MAX) {
-        return dummy;
+        return -1;
     }
     else if (_pwm == 0) {
-        Pin::set(false);
-        return dummy;
+        return 0;
     }
     else if (_pwm == PID_PWM_MAX - 1) {
-        Pin::set(true);
-        return dummy;
+        return 1;
     }
 
     /*
@@ -129,7 +243,5 @@ uint32_t Pwm::on_tick(uint32_t dummy)
         if (_sd_accumulator <= 0)
             _sd_direction = false;
     }
-    Pin::set(_sd_direction);
-
-    return dummy;
+    return _sd_direction;
 }
@@ -6,12 +6,21 @@
 #include "Pin.h"
 #include "Module.h"
 
+namespace mbed {
+    class PwmOut;
+}
+
 class Pwm : public Module, public Pin {
 public:
     Pwm();
+    ~Pwm();
 
     void     on_module_load(void);
-    uint32_t on_tick(uint32_t);
+
+    // tick the sigma-delta output at this frequency, outputs at the same frequency share one SlowTicker hook
+    void     attach(uint32_t frequency);
+    // use the PWM1 peripheral instead if the pin is a PWM pin whose channel is free, returns false if not
+    bool     use_hardware();
 
     Pwm*     max_pwm(int);
     int      max_pwm(void);
@@ -21,6 +30,11 @@ public:
     void     set(bool);
 
 private:
+    friend class PwmGroup;
+    int  next_state();
+    void write_hardware(float duty);
+
+    mbed::PwmOut *_hardware;
     int  _max;
     int  _pwm;
     int  _sd_accumulator;
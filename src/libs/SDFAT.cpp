@@ -1,12 +1,38 @@
 #include "SDFAT.h"
 
+#include "platform_memory.h"
+
+#include <string.h>
+
+#define SECTOR_SIZE 512
+
+/*
+    A small LRU cache of single sector accesses sits between FatFS and the disk.
+    The FAT and directory sectors that get re-read for every open, seek and directory listing stay in the cache,
+    FAT sectors are written back when FatFS syncs, everything else is written through.
+    FatFS reads FAT and directory sectors into its window buffer, anything else is file data which is inserted as least
+    recently used so streaming a file does not flush the cache, multiple sector transfers bypass it.
+    Writes over USB mass storage go straight to the disk, they mark the cache stale and it is dropped, dirty sectors
+    included, before FatFS next uses it.
+*/
+
 SDFAT::SDFAT(const char *n, MSD_Disk *disk) : mbed::FATFileSystem(n)
 {
     d = disk;
+    cache_entries = nullptr;
+    cache_data = nullptr;
+    cache_size = 0;
+    cache_stale = false;
+    cache_clock = 0;
+    cache_hits = 0;
+    cache_misses = 0;
+    cache_writebacks = 0;
 }
 
 int SDFAT::disk_initialize()
 {
+    // the card may have changed
+    cache_invalidate(0, -1);
     return d->disk_initialize();
 }
 
@@ -17,17 +43,94 @@ int SDFAT::disk_status()
 
 int SDFAT::disk_read(char *buffer, int sector)
 {
-    return d->disk_read(buffer, sector);
+    cache_check_stale();
+    if(cache_size == 0) return d->disk_read(buffer, sector);
+
+    int i = cache_find(sector);
+    if(i >= 0) {
+        ++cache_hits;
+        cache_entries[i].used = ++cache_clock;
+        memcpy(buffer, &cache_data[i * SECTOR_SIZE], SECTOR_SIZE);
+        return 0;
+    }
+
+    ++cache_misses;
+    i = cache_victim();
+    if(i < 0) return d->disk_read(buffer, sector);
+
+    char *p = &cache_data[i * SECTOR_SIZE];
+    int r = d->disk_read(p, sector);
+    if(r) return r;
+
+    cache_entries[i].sector = sector;
+    cache_entries[i].valid = true;
+    cache_entries[i].dirty = false;
+    cache_entries[i].used = (buffer == (char *)_fs.win) ? ++cache_clock : 0;
+    memcpy(buffer, p, SECTOR_SIZE);
+    return 0;
 }
 
 int SDFAT::disk_write(const char *buffer, int sector)
 {
+    cache_check_stale();
+    if(cache_size == 0) return d->disk_write(buffer, sector);
+
+    int i = cache_find(sector);
+    bool fat = is_fat_sector(sector);
+    if(i < 0 && fat) {
+        i = cache_victim();
+        if(i >= 0) {
+            cache_entries[i].sector = sector;
+            cache_entries[i].valid = true;
+        }
+    }
+
+    if(i >= 0) {
+        memcpy(&cache_data[i * SECTOR_SIZE], buffer, SECTOR_SIZE);
+        cache_entries[i].used = ++cache_clock;
+        if(fat) {
+            // written back by disk_sync
+            cache_entries[i].dirty = true;
+            return 0;
+        }
+        cache_entries[i].dirty = false;
+    }
+
     return d->disk_write(buffer, sector);
 }
 
+int SDFAT::disk_read_sectors(char *buffer, int sector, int count)
+{
+    if(count == 1) return disk_read(buffer, sector);
+
+    cache_check_stale();
+    int r = d->disk_read_blocks(buffer, sector, count);
+    if(r || cache_size == 0) return r;
+
+    // cached copies may be newer than the disk
+    for (int i = 0; i < cache_size; i++) {
+        uint32_t s = cache_entries[i].sector;
+        if(cache_entries[i].valid && cache_entries[i].dirty && s >= (uint32_t)sector && s < (uint32_t)(sector + count)) {
+            memcpy(&buffer[(s - sector) * SECTOR_SIZE], &cache_data[i * SECTOR_SIZE], SECTOR_SIZE);
+        }
+    }
+    return 0;
+}
+
+int SDFAT::disk_write_sectors(const char *buffer, int sector, int count)
+{
+    if(count == 1) return disk_write(buffer, sector);
+
+    cache_invalidate(sector, count);
+    return d->disk_write_blocks(buffer, sector, count);
+}
+
 int SDFAT::disk_sync()
 {
-    return d->disk_sync();
+    cache_check_stale();
+    int r = cache_flush();
+    int s = d->disk_sync();
+    return r ? r : s;
 }
 
 int SDFAT::disk_sectors()
@@ -35,8 +138,107 @@ int SDFAT::disk_sectors()
     return d->disk_sectors();
 }
 int SDFAT::remount() {
+    // anything cached may have been changed over USB, so it is dropped, writing dirty sectors back would undo the host's changes
+    cache_stale = false;
+    cache_invalidate(0, -1);
+
     f_mount(_fsid, NULL);
     f_mount(_fsid, &_fs);
     
 	return 0;
-}
\ No newline at end of file
+}
+
+int SDFAT::set_cache_size(int sectors)
+{
+    cache_check_stale();
+    cache_flush();
+    if(cache_data != nullptr) {
+        AHB0.dealloc(cache_data);
+        AHB0.dealloc(cache_entries);
+        cache_data = nullptr;
+        cache_entries = nullptr;
+    }
+    cache_size = 0;
+
+    // use as much as there is room for up to the requested size
+    for (; sectors > 0; sectors /= 2) {
+        cache_data = (char *)AHB0.alloc(sectors * SECTOR_SIZE);
+        if(cache_data == nullptr) continue;
+        cache_entries = (cache_entry_t *)AHB0.alloc(sectors * sizeof(cache_entry_t));
+        if(cache_entries != nullptr) break;
+        AHB0.dealloc(cache_data);
+        cache_data = nullptr;
+    }
+    if(sectors <= 0) return 0;
+
+    cache_size = sectors;
+    cache_invalidate(0, -1);
+    return cache_size;
+}
+
+int SDFAT::cache_find(uint32_t sector) const
+{
+    for (int i = 0; i < cache_size; i++) {
+        if(cache_entries[i].valid && cache_entries[i].sector == sector) return i;
+    }
+    return -1;
+}
+
+// returns the least recently used entry, written back first if it is dirty
+int SDFAT::cache_victim()
+{
+    int v = -1;
+    for (int i = 0; i < cache_size; i++) {
+        if(!cache_entries[i].valid) return i;
+        if(v < 0 || cache_entries[i].used < cache_entries[v].used) v = i;
+    }
+
+    if(v >= 0 && cache_entries[v].dirty) {
+        ++cache_writebacks;
+        if(d->disk_write(&cache_data[v * SECTOR_SIZE], cache_entries[v].sector)) return -1;
+        cache_entries[v].dirty = false;
+    }
+    return v;
+}
+
+// write all the dirty sectors back to the disk
+int SDFAT::cache_flush()
+{
+    int r = 0;
+    for (int i = 0; i < cache_size; i++) {
+        if(cache_entries[i].valid && cache_entries[i].dirty) {
+            ++cache_writebacks;
+            if(d->disk_write(&cache_data[i * SECTOR_SIZE], cache_entries[i].sector)) {
+                r = 1;
+            } else {
+                cache_entries[i].dirty = false;
+            }
+        }
+    }
+    return r;
+}
+
+// drops everything if the disk was written behind the cache's back
+void SDFAT::cache_check_stale()
+{
+    if(!cache_stale) return;
+    cache_stale = false;
+    cache_invalidate(0, -1);
+}
+
+// drops count sectors from sector on, count of -1 drops everything
+void SDFAT::cache_invalidate(uint32_t sector, int count)
+{
+    for (int i = 0; i < cache_size; i++) {
+        if(count < 0 || (cache_entries[i].sector >= sector && cache_entries[i].sector < sector + count)) {
+            cache_entries[i].valid = false;
+            cache_entries[i].dirty = false;
+        }
+    }
+}
+
+// sectors in any copy of the FAT, only known once mounted
+bool SDFAT::is_fat_sector(uint32_t sector) const
+{
+    return _fs.fs_type != 0 && sector >= _fs.fatbase && sector < _fs.fatbase + _fs.fsize * _fs.n_fats;
+}
@@ -12,13 +12,49 @@ public:
     virtual int disk_status();
     virtual int disk_read(char *buffer, int sector);
     virtual int disk_write(const char *buffer, int sector);
+    virtual int disk_read_sectors(char *buffer, int sector, int count);
+    virtual int disk_write_sectors(const char *buffer, int sector, int count);
     virtual int disk_sync();
     virtual int disk_sectors();
 
     int remount();
 
+    // sector cache in AHB RAM, returns the number of sectors actually allocated, 0 disables it
+    int set_cache_size(int sectors);
+    int get_cache_size() const { return cache_size; }
+    // the disk was written by something else (USB mass storage), the cache is dropped before it is next used,
+    // safe to call from an interrupt
+    void invalidate_cache() { cache_stale = true; }
+    uint32_t get_cache_hits() const { return cache_hits; }
+    uint32_t get_cache_misses() const { return cache_misses; }
+    uint32_t get_cache_writebacks() const { return cache_writebacks; }
+
 protected:
     MSD_Disk *d;
+
+private:
+    struct cache_entry_t {
+        uint32_t sector;
+        uint32_t used;  // higher is more recently used, 0 is the next to be replaced
+        bool valid;
+        bool dirty;
+    };
+
+    int cache_find(uint32_t sector) const;
+    int cache_victim();
+    int cache_flush();
+    void cache_check_stale();
+    void cache_invalidate(uint32_t sector, int count);
+    bool is_fat_sector(uint32_t sector) const;
+
+    cache_entry_t *cache_entries;
+    char *cache_data;
+    int cache_size;
+    volatile bool cache_stale;
+    uint32_t cache_clock;
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    uint32_t cache_writebacks;
 };
 
 #endif /* _SDFAT_H */
@@ -15,11 +15,15 @@ using namespace std;
 #include "libs/Hook.h"
 #include "modules/robot/Conveyor.h"
 #include "Gcode.h"
+#include "StreamOutput.h"
+#include "StreamOutputPool.h"
 
 #include <mri.h>
 
 // This module uses a Timer to periodically call hooks
 // Modules register with a function ( callback ) and a frequency, and we then call that function at the given frequency.
+// TIMER2 runs freely and its match register is set to the deadline of the hook due first, so the interrupt only
+// happens when a hook is due and only the hooks that are due are looked at.
 
 SlowTicker* global_slow_ticker;
 
@@ -30,17 +34,25 @@ SlowTicker::SlowTicker(){
     ispbtn.from_string("2.10")->as_input()->pull_up();
 
     LPC_SC->PCONP |= (1 << 22);     // Power Ticker ON
-    LPC_TIM2->MCR = 3;              // Match on MR0, reset on MR0
+    LPC_TIM2->MCR = 1;              // Interrupt on MR0, the counter keeps running
     // do not enable interrupt until setup is complete
     LPC_TIM2->TCR = 0;              // Disable interrupt
 
-    max_frequency = 5;  // initial max frequency is set to 5Hz
-    set_frequency(max_frequency);
+    request_head = request_tail = 0;
+    started = false;
+    hooks_dropped = false;
+    flag_1s_count = 0;
     flag_1s_flag = 0;
+
+    // checks the ISP button and counts seconds
+    attach(10, this, &SlowTicker::housekeeping_tick);
 }
 
 void SlowTicker::start()
 {
+    LPC_TIM2->TCR = 2;              // Reset, the deadlines so far are from 0
+    if(schedule.size() > 0) LPC_TIM2->MR0 = schedule.top()->deadline;
+    started = true;
     LPC_TIM2->TCR = 1;              // Enable interrupt
     NVIC_EnableIRQ(TIMER2_IRQn);    // Enable interrupt handler
 }
@@ -49,36 +61,106 @@ void SlowTicker::on_module_loaded(){
     register_for_event(ON_IDLE);
 }
 
-// Set the base frequency we use for all sub-frequencies
-void SlowTicker::set_frequency( int frequency ){
-    this->interval = (SystemCoreClock >> 2) / frequency;   // SystemCoreClock/4 = Timer increments in a second
-    LPC_TIM2->MR0 = this->interval;
-    LPC_TIM2->TCR = 3;  // Reset
-    LPC_TIM2->TCR = 1;  // Reset
-    flag_1s_count= SystemCoreClock>>2;
+// refuses the hook if the schedule has no room for it, so a hook that is attached is always called
+bool SlowTicker::add(Hook *hook)
+{
+    if(this->hooks.size() >= (size_t)HookHeap::max_hooks) {
+        THEKERNEL->streams->printf("Error: too many slow ticker hooks, only %d can be attached\n", HookHeap::max_hooks);
+        delete hook;
+        return false;
+    }
+
+    this->hooks.push_back(hook);
+    if(!started) {
+        // the interrupt is not running yet so it can go straight in, the deadlines are from when it starts
+        hook->deadline = hook->interval;
+        schedule.push(hook);
+    } else {
+        request(hook);
+    }
+    return true;
+}
+
+// the hook is not called again once this returns, it is deleted when the interrupt has dropped it from the schedule
+// only sets a flag so it does not wait for the interrupt and can be called from anywhere, including the hook itself
+void SlowTicker::detach(Hook *hook)
+{
+    if(hook == nullptr) return;
+    hook->detaching = true;
+}
+
+// queue a hook to be added by the interrupt and make it run now to take it
+// waits for the interrupt if the queue is full, so must not be called from an interrupt
+void SlowTicker::request(Hook *hook)
+{
+    uint8_t next = (request_head + 1) % max_requests;
+    while(next == request_tail) {
+        // full, the interrupt will empty it
+        NVIC_SetPendingIRQ(TIMER2_IRQn);
+    }
+    requests[request_head] = hook;
+    request_head = next;
+    NVIC_SetPendingIRQ(TIMER2_IRQn);
+}
+
+// called in the interrupt
+void SlowTicker::take_requests()
+{
+    while(request_tail != request_head) {
+        Hook *hook = requests[request_tail];
+        if(hook->detaching) {
+            hook->dropped = true;
+            hooks_dropped = true;
+        } else {
+            hook->deadline = LPC_TIM2->TC + hook->interval;
+            // add() only lets in as many hooks as the schedule holds so there is room
+            schedule.push(hook);
+        }
+        request_tail = (request_tail + 1) % max_requests;
+    }
 }
 
 // The actual interrupt being called by the timer, this is where work is done
 void SlowTicker::tick(){
 
-    // Call all hooks that need to be called
-    for (Hook* hook : this->hooks){
-        hook->countdown -= this->interval;
-        if (hook->countdown < 0)
-        {
-            hook->countdown += hook->interval;
-            hook->call();
+    take_requests();
+
+    // Call the hooks that are due, earliest first
+    while(schedule.size() > 0) {
+        Hook *hook = schedule.top();
+        if(hook->detaching) {
+            // a detached hook waits in the schedule until it gets to the top
+            schedule.pop();
+            hook->dropped = true;
+            hooks_dropped = true;
+            continue;
+        }
+        if((int32_t)(hook->deadline - LPC_TIM2->TC) > 0) break;
+
+        hook->call();
+
+        // keep to the same phase, if the next call is already due it has been missed
+        hook->deadline += hook->interval;
+        while((int32_t)(hook->deadline - LPC_TIM2->TC) <= 0) {
+            hook->deadline += hook->interval;
+            hook->overruns++;
         }
+        schedule.update_top();
     }
 
-    // deduct tick time from second counter
-    flag_1s_count -= this->interval;
-    // if a whole second has elapsed,
-    if (flag_1s_count < 0)
-    {
-        // add a second to our counter
-        flag_1s_count += SystemCoreClock >> 2;
-        // and set a flag for idle event to pick up
+    if(schedule.size() > 0) {
+        uint32_t deadline = schedule.top()->deadline;
+        LPC_TIM2->MR0 = deadline;
+        // the match only happens when the counter gets to it, so if it already has come straight back
+        if((int32_t)(deadline - LPC_TIM2->TC) <= 0) NVIC_SetPendingIRQ(TIMER2_IRQn);
+    }
+}
+
+uint32_t SlowTicker::housekeeping_tick(uint32_t dummy)
+{
+    // if a whole second has elapsed set a flag for idle event to pick up
+    if (++flag_1s_count >= 10) {
+        flag_1s_count = 0;
         flag_1s_flag++;
     }
 
@@ -87,6 +169,16 @@ void SlowTicker::tick(){
     if (ispbtn.get() == 0)
         __debugbreak();
 
+    return dummy;
+}
+
+void SlowTicker::print_hooks(StreamOutput *stream)
+{
+    int n = 0;
+    for (Hook *hook : this->hooks) {
+        if(hook->detaching) continue;
+        stream->printf("%d: %luHz overruns: %lu\n", n++, (SystemCoreClock / 4) / hook->interval, hook->overruns);
+    }
 }
 
 bool SlowTicker::flag_1s(){
@@ -118,6 +210,20 @@ void SlowTicker::on_idle(void*)
         leds[2]= (ledcnt++ & 0x1000) ? 1 : 0;
     }
 
+    // delete the detached hooks the interrupt has finished with, they keep their place in hooks until then
+    // so add() still counts them against the room in the schedule
+    if(hooks_dropped) {
+        hooks_dropped = false;
+        for (auto i = this->hooks.begin(); i != this->hooks.end(); ) {
+            if((*i)->dropped) {
+                delete *i;
+                i = this->hooks.erase(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
     // if interrupt has set the 1 second flag
     if (flag_1s())
         // fire the on_second_tick event
@@ -16,11 +16,14 @@ using namespace std;
 #include <vector>
 
 #include "libs/Hook.h"
+#include "libs/HookHeap.h"
 #include "libs/Pin.h"
 
 #include "system_LPC17xx.h" // for SystemCoreClock
 #include <math.h>
 
+class StreamOutput;
+
 class SlowTicker : public Module{
     public:
         SlowTicker();
@@ -28,7 +31,6 @@ class SlowTicker : public Module{
         void on_module_loaded(void);
         void on_idle(void*);
         void start();
-        void set_frequency( int frequency );
         void tick();
         // For some reason this can't go in the .cpp, see :  http://mbed.org/forum/mbed/topic/2774/?page=1#comment-14221
         // TODO replace this with std::function()
@@ -36,25 +38,31 @@ class SlowTicker : public Module{
             Hook* hook = new Hook();
             hook->interval = floorf((SystemCoreClock/4)/frequency);
             hook->attach(optr, fptr);
-            hook->countdown = hook->interval;
-
-            // to avoid race conditions we must stop the interupts before updating this non thread safe vector
-            __disable_irq();
-            if( frequency > this->max_frequency ){
-                this->max_frequency = frequency;
-                this->set_frequency(frequency);
-            }
-            this->hooks.push_back(hook);
-            __enable_irq();
-            return hook;
+            return this->add(hook) ? hook : nullptr;
         }
+        void detach(Hook *hook);
+        void print_hooks(StreamOutput *stream);
 
     private:
         bool flag_1s();
+        uint32_t housekeeping_tick(uint32_t);
+        bool add(Hook *hook);
+        void request(Hook *hook);
+        void take_requests();
 
+        // the hooks in the order they were attached, only used outside the interrupt
         vector<Hook*> hooks;
-        uint32_t max_frequency;
-        uint32_t interval;
+
+        // the hooks by deadline, TIMER2 matches on the first one, only changed in the interrupt once started
+        HookHeap schedule;
+
+        // hooks attached after start() are passed to the interrupt here so neither side disables interrupts
+        static const int max_requests= 8;
+        Hook * volatile requests[max_requests];
+        volatile uint8_t request_head;
+        volatile uint8_t request_tail;
+        bool started;
+        volatile bool hooks_dropped; // set by the interrupt when there are detached hooks to delete
 
         Pin ispbtn;
 protected:
@@ -15,10 +15,12 @@
 #include "StreamOutputPool.h"
 #include "Block.h"
 #include "Conveyor.h"
+#include "InputShaper.h"
 
 #include "system_LPC17xx.h" // mbed.h lib
 #include <math.h>
 #include <mri.h>
+#include <algorithm>
 
 #ifdef STEPTICKER_DEBUG_PIN
 // debug pins, only used if defined in src/makefile
@@ -50,7 +52,20 @@ StepTicker::StepTicker()
     this->set_unstep_time(100);
 
     this->unstep.reset();
+    this->shaped.reset();
+    this->shaper.fill(nullptr);
+    this->advanced.reset();
+    this->advance_factor.fill(0);
+    this->advance_interval.fill(1);
+    this->advance_countdown.fill(0);
+    this->decay_interval.fill(0);
+    this->decay_countdown.fill(0);
+    this->advance_target.fill(0);
+    this->advance_steps.fill(0);
+    this->dir_tick.fill(0);
+    for(auto& p : pending_steps) p= 0;
     this->num_motors = 0;
+    this->sync_motor = 0;
 
     this->running = false;
     this->current_block = nullptr;
@@ -93,6 +108,12 @@ void StepTicker::set_unstep_time( float microseconds )
     // TODO check that the unstep time is less than the step period, if not slow down step ticker
 }
 
+// Set the minimum time between changing a direction pin and the next step pulse, must be called after set_frequency
+void StepTicker::set_dir_setup_time( float microseconds )
+{
+    dir_setup_ticks = ceilf(microseconds * frequency / 1000000.0F);
+}
+
 // Reset step pins on any motor that was stepped
 void StepTicker::unstep_tick()
 {
@@ -130,11 +151,122 @@ void StepTicker::handle_finish (void)
     if(finished_fnc) finished_fnc();
 }
 
+// issue any steps that are due from the input shapers, this continues after the last block has finished
+void StepTicker::shaper_tick()
+{
+    bool halted= THEKERNEL->is_halted();
+    for (uint8_t m = 0; m < num_motors; m++) {
+        if(!shaped[m]) continue;
+
+        if(halted) {
+            shaper[m]->flush();
+            continue;
+        }
+
+        // stopped externally part way through its move (probes, endstops etc) so the steps still in the delay window must not be issued
+        if(running && current_block->tick_info[m].steps_to_move > 0 && !motor[m]->is_moving()) {
+            shaper[m]->flush();
+            continue;
+        }
+
+        int s= shaper[m]->tick();
+        if(s == 0) continue;
+
+        bool dir= (s < 0);
+        if(motor[m]->which_direction() != dir) {
+            // change direction now and issue the step on the next tick to give the driver its setup time
+            motor[m]->set_direction(dir);
+            shaper[m]->defer(s);
+            continue;
+        }
+
+        motor[m]->step();
+        unstep.set(m);
+    }
+
+    if(unstep.any()) {
+        LPC_TIM1->TCR = 3;
+        LPC_TIM1->TCR = 1;
+    }
+}
+
+// the current block extrudes with extruder m on a print move, retracts and extruder only moves are not advanced
+bool StepTicker::is_print_move(int m) const
+{
+    return current_block->primary_axis && current_block->steps[m] > 0 && !current_block->direction_bits[m];
+}
+
+// pressure advance for extruders, the extruder is pushed ahead of its nominal position by advance_factor * velocity
+// so it accelerates harder than the other axis and pulls back during deceleration.
+// The target advance follows the planned extruder speed of a print move and is ramped down over moves that do not extrude,
+// the applied advance follows the target no faster than one step every advance_interval ticks.
+// The nominal steps and the change in advance are merged into pending_steps and issued at most one per tick
+void StepTicker::advance_tick()
+{
+    bool halted= THEKERNEL->is_halted();
+    for (uint8_t m = 0; m < num_motors; m++) {
+        if(!advanced[m]) continue;
+
+        if(halted) {
+            pending_steps[m]= 0;
+            advance_steps[m]= 0;
+            advance_target[m]= 0;
+            continue;
+        }
+
+        if(!running) {
+            advance_target[m]= 0;
+
+        }else if(is_print_move(m)) {
+            // advance in whole steps from the planned rate, 2.62 >> 30 is 2.32 so the product >> 32 is whole steps
+            advance_target[m]= ((current_block->tick_info[m].steps_per_tick >> 30) * advance_factor[m]) >> 32;
+
+        }else if(advance_target[m] > 0 && (decay_countdown[m] == 0 || --decay_countdown[m] == 0)) {
+            --advance_target[m];
+            decay_countdown[m]= decay_interval[m];
+        }
+
+        if(advance_countdown[m] > 0) {
+            --advance_countdown[m];
+
+        }else if(advance_steps[m] != advance_target[m]) {
+            int32_t d= (advance_target[m] > advance_steps[m]) ? 1 : -1;
+            advance_steps[m] += d;
+            pending_steps[m] += d;
+            advance_countdown[m]= advance_interval[m] - 1;
+        }
+
+        int32_t p= pending_steps[m];
+        if(p == 0) continue;
+
+        bool dir= (p < 0);
+        if(motor[m]->which_direction() != dir) {
+            // change direction now and issue the step on the next tick to give the driver its setup time
+            motor[m]->set_direction(dir);
+            continue;
+        }
+
+        motor[m]->step();
+        unstep.set(m);
+        pending_steps[m] += dir ? 1 : -1;
+    }
+
+    if(unstep.any()) {
+        LPC_TIM1->TCR = 3;
+        LPC_TIM1->TCR = 1;
+    }
+}
+
 // step clock
 void StepTicker::step_tick (void)
 {
     //SET_STEPTICKER_DEBUG_PIN(running ? 1 : 0);
 
+    ++tick_count;
+
+    if(shaped.any()) shaper_tick();
+    if(advanced.any()) advance_tick();
+
     // if nothing has been setup we ignore the ticks
     if(!running){
         // check if anything new available
@@ -150,10 +282,20 @@ void StepTicker::step_tick (void)
         running= false;
         current_tick = 0;
         current_block= nullptr;
+        start_delay= 0;
+        return;
+    }
+
+    // give any direction pins that changed at the start of this block time to settle
+    if(start_delay > 0) {
+        --start_delay;
         return;
     }
 
     bool still_moving= false;
+    // a sync call is needed when the trapezoid changes phase
+    bool do_sync= (current_tick == current_block->accelerate_until || current_tick == current_block->decelerate_after);
+
     // foreach motor, if it is active see if time to issue a step to that motor
     for (uint8_t m = 0; m < num_motors; m++) {
         if(current_block->tick_info[m].steps_to_move == 0) continue; // not active
@@ -189,15 +331,40 @@ void StepTicker::step_tick (void)
             current_block->tick_info[m].counter -= STEPTICKER_FPSCALE; // -= 1.0F;
             ++current_block->tick_info[m].step_count;
 
-            // step the motor
-            bool ismoving= motor[m]->step(); // returns false if the moving flag was set to false externally (probes, endstops etc)
-            // we stepped so schedule an unstep
-            unstep.set(m);
+            bool ismoving;
+            if(shaped[m]) {
+                // the shaper issues the actual steps on later ticks
+                shaper[m]->push(current_block->direction_bits[m]);
+                ismoving= motor[m]->is_moving();
+                if(!ismoving) shaper[m]->flush(); // stopped externally so discard any pending steps
+
+            }else if(advanced[m]) {
+                // advance_tick issues the actual step
+                pending_steps[m] += current_block->direction_bits[m] ? -1 : 1;
+                ismoving= motor[m]->is_moving();
+                if(!ismoving) pending_steps[m]= 0; // stopped externally so discard any pending steps
+
+            }else{
+                // step the motor
+                ismoving= motor[m]->step(); // returns false if the moving flag was set to false externally (probes, endstops etc)
+                // we stepped so schedule an unstep
+                unstep.set(m);
+            }
+
+            if(m == sync_motor && sync_countdown > 0 && --sync_countdown == 0) {
+                do_sync= true;
+            }
 
             if(!ismoving || current_block->tick_info[m].step_count == current_block->tick_info[m].steps_to_move) {
                 // done
                 current_block->tick_info[m].steps_to_move = 0;
                 motor[m]->stop_moving(); // let motor know it is no longer moving
+
+                // this motor has finished this block so it can be setup for the next block while the others finish
+                if(ismoving) {
+                    const Block *next= THECONVEYOR->peek_next_block();
+                    if(next != nullptr && next->steps[m] > 0 && !shaped[m] && !advanced[m]) set_direction(m, next->direction_bits[m]);
+                }
             }
         }
 
@@ -218,6 +385,8 @@ void StepTicker::step_tick (void)
     }
 
 
+    if(do_sync && still_moving) call_sync_fnc(current_block);
+
     // see if any motors are still moving
     if(!still_moving) {
         //SET_STEPTICKER_DEBUG_PIN(0);
@@ -235,6 +404,7 @@ void StepTicker::step_tick (void)
         }else{
             current_block= nullptr;
             running= false;
+            call_sync_fnc(nullptr);
         }
 
         // all moves finished
@@ -250,22 +420,45 @@ bool StepTicker::start_next_block()
     if(current_block == nullptr) return false;
 
     bool ok= false;
+    uint32_t max_steps= 0;
+    uint32_t delay= 0;
     // need to prepare each active motor
     for (uint8_t m = 0; m < num_motors; m++) {
         if(current_block->tick_info[m].steps_to_move == 0) continue;
 
+        // the motor with the most steps is used to time the sync callbacks
+        if(current_block->tick_info[m].steps_to_move > max_steps) {
+            max_steps= current_block->tick_info[m].steps_to_move;
+            sync_motor= m;
+        }
+
         ok= true; // mark at least one motor is moving
-        // set direction bit here
-        // NOTE this would be at least 10us before first step pulse.
-        // TODO does this need to be done sooner, if so how without delaying next tick
-        motor[m]->set_direction(current_block->direction_bits[m]);
+        // set direction bit here, shaped and advanced motors set their own direction as the delayed steps are issued
+        // usually the direction was already set by the look ahead when the motor finished the previous block,
+        // if not the block start is delayed until the pin has been stable for dir_setup_ticks
+        if(!shaped[m] && !advanced[m]) {
+            set_direction(m, current_block->direction_bits[m]);
+            uint32_t t= tick_count - dir_tick[m];
+            if(t < dir_setup_ticks && dir_setup_ticks - t > delay) delay= dir_setup_ticks - t;
+        }
         motor[m]->start_moving(); // also let motor know it is moving now
     }
 
+    // moves that do not extrude ramp any advance down evenly over the move
+    for (uint8_t m = 0; m < num_motors; m++) {
+        if(!advanced[m] || is_print_move(m) || advance_target[m] <= 0) continue;
+        decay_interval[m]= std::max(1UL, (unsigned long)(current_block->total_move_ticks / advance_target[m]));
+        decay_countdown[m]= decay_interval[m];
+    }
+
     current_tick= 0;
+    start_delay= delay;
 
     if(ok) {
+        // motors that are idle during this block can be setup for the one after
+        preset_directions(THECONVEYOR->peek_next_block());
         //SET_STEPTICKER_DEBUG_PIN(1);
+        call_sync_fnc(current_block);
         return true;
 
     }else{
@@ -278,6 +471,74 @@ bool StepTicker::start_next_block()
 }
 
 
+// only called from the step tick ISR, records when the pin last changed
+void StepTicker::set_direction(int m, bool dir)
+{
+    if(motor[m]->which_direction() == dir) return;
+    motor[m]->set_direction(dir);
+    dir_tick[m]= tick_count;
+}
+
+// set the direction pins for the given block ahead of time on the motors that are not moving in the current block
+void StepTicker::preset_directions(const Block *block)
+{
+    if(block == nullptr) return;
+    for (uint8_t m = 0; m < num_motors; m++) {
+        if(block->steps[m] == 0 || shaped[m] || advanced[m] || motor[m]->is_moving()) continue;
+        set_direction(m, block->direction_bits[m]);
+    }
+}
+
+// only called from the step tick ISR
+void StepTicker::call_sync_fnc(const Block *block)
+{
+    if(sync_fnc) {
+        uint32_t n= sync_fnc(block);
+        sync_countdown= (n > 0) ? n : sync_interval;
+    }
+}
+
+// set or clear (with nullptr) the input shaper for the given motor, must only be called when idle
+void StepTicker::set_shaper(int m, InputShaper *s)
+{
+    shaped[m]= false;
+    shaper[m]= s;
+    if(s != nullptr && s->get_type() != InputShaper::NONE) shaped[m]= true;
+}
+
+// true if none of the input shapers have any steps left to issue
+bool StepTicker::is_shaper_idle() const
+{
+    for (uint8_t m = 0; m < num_motors; m++) {
+        if(shaped[m] && !shaper[m]->is_empty()) return false;
+    }
+    return true;
+}
+
+// set the pressure advance time in seconds for the given extruder motor, 0 disables it, and the maximum rate in steps/sec
+// the advance can change at. must only be called when idle
+void StepTicker::set_pressure_advance(int m, float k, float max_rate)
+{
+    advanced[m]= false;
+    advance_factor[m]= (k > 0) ? lroundf(k * frequency) : 0;
+    advance_interval[m]= (max_rate > 0) ? std::max(1L, lroundf(frequency / max_rate)) : 1;
+    advance_countdown[m]= 0;
+    decay_countdown[m]= 0;
+    advance_target[m]= 0;
+    advance_steps[m]= 0;
+    pending_steps[m]= 0;
+    if(advance_factor[m] > 0 && !shaped[m]) advanced[m]= true;
+}
+
+// true if there are no advance steps left to issue
+bool StepTicker::is_advance_idle() const
+{
+    for (uint8_t m = 0; m < num_motors; m++) {
+        if(advanced[m] && (pending_steps[m] != 0 || advance_steps[m] != 0)) return false;
+    }
+    return true;
+}
+
 // returns index of the stepper motor in the array and bitset
 int StepTicker::register_motor(StepperMotor* m)
 {
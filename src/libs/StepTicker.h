@@ -20,6 +20,7 @@
 
 class StepperMotor;
 class Block;
+class InputShaper;
 
 // handle 2.62 Fixed point
 #define STEPTICKER_FPSCALE (1LL<<62)
@@ -31,7 +32,13 @@ class StepTicker{
         ~StepTicker();
         void set_frequency( float frequency );
         void set_unstep_time( float microseconds );
+        void set_dir_setup_time( float microseconds );
         int register_motor(StepperMotor* motor);
+        void set_shaper(int motor, InputShaper *shaper);
+        InputShaper *get_shaper(int motor) const { return shaper[motor]; }
+        bool is_shaper_idle() const;
+        void set_pressure_advance(int motor, float k, float max_rate);
+        bool is_advance_idle() const;
         float get_frequency() const { return frequency; }
         void unstep_tick();
         const Block *get_current_block() const { return current_block; }
@@ -43,23 +50,58 @@ class StepTicker{
         // whatever setup the block should register this to know when it is done
         std::function<void()> finished_fnc{nullptr};
 
+        // optional callback made from the step ISR at block start, on each trapezoid phase change
+        // and every sync_interval steps of the primary axis, it is called with nullptr when motion stops
+        // it returns the number of primary axis steps until it next needs to be called, or 0 to use sync_interval
+        void set_sync_callback(std::function<uint32_t(const Block*)> fnc, uint32_t interval) { sync_interval= interval; sync_fnc= fnc; }
+
         static StepTicker *getInstance() { return instance; }
 
     private:
         static StepTicker *instance;
 
         bool start_next_block();
+        void call_sync_fnc(const Block *block);
+        void shaper_tick();
+        void advance_tick();
+        bool is_print_move(int m) const;
+        void set_direction(int m, bool dir);
+        void preset_directions(const Block *block);
 
         float frequency;
         uint32_t period;
         std::array<StepperMotor*, k_max_actuators> motor;
+        std::array<InputShaper*, k_max_actuators> shaper;
         std::bitset<k_max_actuators> unstep;
+        std::bitset<k_max_actuators> shaped; // motors whose steps go through an input shaper
+        std::bitset<k_max_actuators> advanced; // extruders with pressure advance enabled
+
+        // pressure advance state for each extruder
+        std::array<uint32_t, k_max_actuators> advance_factor; // advance time in ticks
+        std::array<uint32_t, k_max_actuators> advance_interval; // minimum ticks between changes of the advance, from the max advance rate
+        std::array<uint32_t, k_max_actuators> advance_countdown; // ticks until the advance can change again
+        std::array<uint32_t, k_max_actuators> decay_interval; // ticks between each step the advance is ramped down by on a move that does not extrude
+        std::array<uint32_t, k_max_actuators> decay_countdown;
+        std::array<int32_t, k_max_actuators> advance_target; // advance steps wanted at this point of the move
+        std::array<int32_t, k_max_actuators> advance_steps; // advance steps applied so far
+        std::array<volatile int32_t, k_max_actuators> pending_steps; // steps waiting to be issued, +ve is forward
 
         Block *current_block;
         uint32_t current_tick{0};
 
+        // direction setup, tick_count is free running and dir_tick is when each motors direction pin last changed
+        uint32_t tick_count{0};
+        std::array<uint32_t, k_max_actuators> dir_tick;
+        uint32_t dir_setup_ticks{1};
+        uint32_t start_delay{0}; // ticks to wait before the current block starts so the dir pins have settled
+
+        std::function<uint32_t(const Block*)> sync_fnc{nullptr};
+        uint32_t sync_interval{0};
+        uint32_t sync_countdown{0};
+
         struct {
             volatile bool running:1;
             uint8_t num_motors:4;
+            uint8_t sync_motor:4;
         };
 };
@@ -64,10 +64,12 @@
  * just always use the Standard Capacity cards with a block size of 512 bytes.
  * This is set with CMD16.
  *
- * You can read and write single blocks (CMD17, CMD25) or multiple blocks
- * (CMD18, CMD25). For simplicity, I'll just use single block accesses. When
- * the card gets a read command, it responds with a response token, and then
- * a data token or an error.
+ * You can read and write single blocks (CMD17, CMD24) or multiple blocks
+ * (CMD18, CMD25). Runs of consecutive blocks use the multiple block commands
+ * so the card only has to be addressed once. When the card gets a read
+ * command, it responds with a response token, and then a data token or an
+ * error. Multiple block reads are ended with CMD12, multiple block writes
+ * use the 0xFC data token for each block and end with the 0xFD stop token.
  *
  * SPI Command Format
  * ------------------
@@ -125,6 +127,15 @@
 static const uint8_t OXFF = 0xFF;
 
 #define SD_COMMAND_TIMEOUT 5000
+#define SD_DATA_TIMEOUT 100000
+
+// SPI clock used for data transfers unless set_max_frequency() is called
+#define SD_DEFAULT_FREQUENCY 12000000
+
+// GPDMA channels used for SSP transfers, the lowest priority ones
+#define SD_DMA_RX_CHANNEL LPC_GPDMACH6
+#define SD_DMA_TX_CHANNEL LPC_GPDMACH7
+#define SD_DMA_CHANNEL_BITS ((1 << 6) | (1 << 7))
 
 SDCard::SDCard(PinName mosi, PinName miso, PinName sclk, PinName cs) :
   _spi(mosi, miso, sclk), _cs(cs) {
@@ -132,6 +143,8 @@ SDCard::SDCard(PinName mosi, PinName miso, PinName sclk, PinName cs) :
     _cs = 1;
     busyflag = false;
     _sectors = 0;
+    _tran_speed = 0;
+    _max_frequency = SD_DEFAULT_FREQUENCY;
 }
 
 #define R1_IDLE_STATE           (1 << 0)
@@ -277,7 +290,10 @@ int SDCard::disk_initialize()
         return 1;
     }
 
-    _spi.frequency(2500000); // Set to 2.5MHz for data transfer
+    // use the fastest clock both we and the card allow, the CSD gives the card limit (25MHz for most cards)
+    uint32_t hz = _max_frequency;
+    if(_tran_speed > 0 && _tran_speed < hz) hz = _tran_speed;
+    _spi.frequency(hz);
 
     busyflag = false;
 
@@ -285,47 +301,112 @@ int SDCard::disk_initialize()
 }
 
 int SDCard::disk_write(const char *buffer, uint32_t block_number)
+{
+    return disk_write_blocks(buffer, block_number, 1);
+}
+
+int SDCard::disk_read(char *buffer, uint32_t block_number)
+{
+    return disk_read_blocks(buffer, block_number, 1);
+}
+
+int SDCard::disk_write_blocks(const char *buffer, uint32_t block_number, uint32_t count)
 {
     if (busyflag)
         return 0;
 
-    busyflag = true;
-
     if (cardtype == SDCARD_FAIL)
         return -1;
-    // set write address for single block (CMD24)
-    if(_cmd(SDCMD_WRITE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
-        return 1;
-    }
 
-    // send the data block
-    _write(buffer, 512);
+    busyflag = true;
+
+    int r = 0;
+    if (count == 1) {
+        // set write address for single block (CMD24)
+        if(_cmd(SDCMD_WRITE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+            busyflag = false;
+            return 1;
+        }
+
+        // send the data block
+        r = _write(buffer, 512);
+
+    } else {
+        // set write address for multiple blocks (CMD25)
+        if(_cmdx(SDCMD_WRITE_MULTIPLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+            // _cmdx leaves the card selected when it answers with an error
+            _cs = 1;
+            _spi.write(0xFF);
+            busyflag = false;
+            return 1;
+        }
+
+        _cs = 0;
+        _spi.write(0xFF);
+        for (uint32_t i = 0; i < count && r == 0; i++) {
+            r = _write_block(buffer, 512, 0xFC);
+            buffer += 512;
+        }
+
+        // stop transmission token, then the card is busy while it finishes programming
+        _spi.write(0xFD);
+        _spi.write(0xFF);
+        if(_wait_not_busy() != 0) r = 1;
+
+        _cs = 1;
+        _spi.write(0xFF);
+    }
 
     busyflag = false;
 
-    return 0;
+    return r;
 }
 
-int SDCard::disk_read(char *buffer, uint32_t block_number)
+int SDCard::disk_read_blocks(char *buffer, uint32_t block_number, uint32_t count)
 {
     if (busyflag)
         return 0;
 
-    busyflag = true;
-
     if (cardtype == SDCARD_FAIL)
         return -1;
-    // set read address for single block (CMD17)
-    if(_cmd(SDCMD_READ_SINGLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
-        return 1;
-    }
 
-    // receive the data
-    _read(buffer, 512);
+    busyflag = true;
+
+    int r = 0;
+    if (count == 1) {
+        // set read address for single block (CMD17)
+        if(_cmd(SDCMD_READ_SINGLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+            busyflag = false;
+            return 1;
+        }
+
+        // receive the data
+        r = _read(buffer, 512);
+
+    } else {
+        // set read address for multiple blocks (CMD18), the card streams blocks until it gets CMD12
+        if(_cmdx(SDCMD_READ_MULTIPLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+            // _cmdx leaves the card selected when it answers with an error
+            _cs = 1;
+            _spi.write(0xFF);
+            busyflag = false;
+            return 1;
+        }
+
+        for (uint32_t i = 0; i < count && r == 0; i++) {
+            r = _read_block(buffer, 512);
+            buffer += 512;
+        }
+
+        if(_stop_transmission() != 0) r = 1;
+
+        _cs = 1;
+        _spi.write(0xFF);
+    }
 
     busyflag = false;
 
-    return 0;
+    return r;
 }
 
 int SDCard::disk_status() { return (_sectors > 0)?0:1; }
@@ -336,7 +417,7 @@ int SDCard::disk_sync() {
 uint32_t SDCard::disk_sectors() { return _sectors; }
 uint64_t SDCard::disk_size() { return ((uint64_t) _sectors) << 9; }
 uint32_t SDCard::disk_blocksize() { return (1<<9); }
-bool SDCard::disk_canDMA() { return false; }
+bool SDCard::disk_canDMA() { return true; }
 
 SDCard::CARD_TYPE SDCard::card_type()
 {
@@ -456,38 +537,52 @@ int SDCard::_cmd8() {
 int SDCard::_read(char *buffer, int length) {
     _cs = 0;
 
-    // read until start byte (0xFF)
-    while(_spi.write(0xFF) != 0xFE);
-//     uint8_t r;
-//     while((r = _spi.write(0xFF)) != 0xFE)
-//     {
-//         iprintf("0x%02X ", r);
-//         for (volatile uint32_t j = 262144; j; j--);
-//     }
-//
-//     iprintf("Got start byte, reading data\n");
-
-    // read data
-    for(int i=0; i<length; i++) {
-        buffer[i] = _spi.write(0xFF);
-    }
-    _spi.write(0xFF); // checksum
-    _spi.write(0xFF);
+    int r = _read_block(buffer, length);
 
     _cs = 1;
     _spi.write(0xFF);
-    return 0;
+    return r;
 }
 
 int SDCard::_write(const char *buffer, int length) {
     _cs = 0;
 
+    int r = _write_block(buffer, length, 0xFE);
+
+    _cs = 1;
+    _spi.write(0xFF);
+    return r;
+}
+
+// read one data block with cs already asserted
+int SDCard::_read_block(char *buffer, int length) {
+    // read until start byte (0xFE), an error token has the top 4 bits clear
+    int token = 0xFF;
+    for(int i=0; i<SD_DATA_TIMEOUT; i++) {
+        token = _spi.write(0xFF);
+        if(token != 0xFF) break;
+    }
+    if(token != 0xFE) {
+        return 1;
+    }
+
+    // read data
+    int r = _transfer(NULL, buffer, length);
+
+    _spi.write(0xFF); // checksum
+    _spi.write(0xFF);
+
+    return r;
+}
+
+// write one data block with cs already asserted, token is 0xFE for a single block or 0xFC for each of multiple blocks
+int SDCard::_write_block(const char *buffer, int length, uint8_t token) {
     // indicate start of block
-    _spi.write(0xFE);
+    _spi.write(token);
 
     // write the data
-    for(int i=0; i<length; i++) {
-        _spi.write(buffer[i]);
+    if(_transfer(buffer, NULL, length) != 0) {
+        return 1;
     }
 
     // write the checksum
@@ -496,16 +591,119 @@ int SDCard::_write(const char *buffer, int length) {
 
     // check the repsonse token
     if((_spi.write(0xFF) & 0x1F) != 0x05) {
-        _cs = 1;
-        _spi.write(0xFF);
         return 1;
     }
 
     // wait for write to finish
-    while(_spi.write(0xFF) == 0);
+    return _wait_not_busy();
+}
 
-    _cs = 1;
+// ends a multiple block read with cs already asserted (CMD12)
+int SDCard::_stop_transmission() {
+    uint32_t arg = 0;
+    _spi.write(0x40 | SDCMD_STOP_TRANSMISSION);
+    _spi.write(arg >> 24);
+    _spi.write(arg >> 16);
+    _spi.write(arg >> 8);
+    _spi.write(arg >> 0);
+    _spi.write(0x95);
+
+    // the byte after CMD12 is a stuff byte that may still be block data
     _spi.write(0xFF);
+
+    for(int i=0; i<SD_COMMAND_TIMEOUT; i++) {
+        int response = _spi.write(0xFF);
+        if(!(response & 0x80)) {
+            return (response == 0) ? _wait_not_busy() : 1;
+        }
+    }
+    return 1;
+}
+
+// the card holds the data line low while it is busy
+int SDCard::_wait_not_busy() {
+    for(int i=0; i<SD_DATA_TIMEOUT * 10; i++) {
+        if(_spi.write(0xFF) != 0) return 0;
+    }
+    return 1;
+}
+
+// clock length bytes out of tx (or 0xFF if NULL) and into rx (discarded if NULL)
+int SDCard::_transfer(const char *tx, char *rx, int length) {
+    int r = _dma_transfer(tx, rx, length);
+    if(r >= 0) return r;
+
+    for(int i=0; i<length; i++) {
+        int v = _spi.write(tx ? tx[i] : 0xFF);
+        if(rx) rx[i] = v;
+    }
+    return 0;
+}
+
+// the GPDMA can only reach the AHB SRAM banks, not the local SRAM the stack and heap are in
+static bool dma_capable(const void *p)
+{
+    uint32_t a = (uint32_t)p;
+    return a >= 0x2007C000 && a < 0x20084000;
+}
+
+// transfer using one GPDMA channel to feed the SSP and another to empty it
+// returns 0 when done, 1 if the transfer failed and -1 if it cannot be done with DMA
+int SDCard::_dma_transfer(const char *tx, char *rx, int length) {
+    if((tx && !dma_capable(tx)) || (rx && !dma_capable(rx)) || !dma_capable(&_dma_ff) || length > 4095) return -1;
+
+    LPC_SSP_TypeDef *ssp = _spi.ssp();
+    uint32_t tx_peripheral = (ssp == LPC_SSP0) ? 0 : 2;
+    uint32_t rx_peripheral = tx_peripheral + 1;
+
+    // the channels may be busy if another transfer timed out
+    if(LPC_GPDMA->DMACEnbldChns & SD_DMA_CHANNEL_BITS) return -1;
+
+    LPC_SC->PCONP |= (1 << 29); // power up the GPDMA
+    LPC_GPDMA->DMACConfig = 1;  // enable, little endian
+    LPC_GPDMA->DMACIntTCClear = SD_DMA_CHANNEL_BITS;
+    LPC_GPDMA->DMACIntErrClr = SD_DMA_CHANNEL_BITS;
+
+    // make sure nothing is left over in the receive FIFO
+    while(ssp->SR & (1 << 2)) (void)ssp->DR;
+
+    _dma_ff = 0xFF;
+
+    // byte wide single transfers, only increment the memory side when there is a buffer
+    SD_DMA_RX_CHANNEL->DMACCSrcAddr = (uint32_t)&ssp->DR;
+    SD_DMA_RX_CHANNEL->DMACCDestAddr = rx ? (uint32_t)rx : (uint32_t)&_dma_sink;
+    SD_DMA_RX_CHANNEL->DMACCLLI = 0;
+    SD_DMA_RX_CHANNEL->DMACCControl = length | (rx ? (1UL << 27) : 0);
+    SD_DMA_RX_CHANNEL->DMACCConfig = 1 | (rx_peripheral << 1) | (2 << 11); // enable, peripheral to memory
+
+    SD_DMA_TX_CHANNEL->DMACCSrcAddr = tx ? (uint32_t)tx : (uint32_t)&_dma_ff;
+    SD_DMA_TX_CHANNEL->DMACCDestAddr = (uint32_t)&ssp->DR;
+    SD_DMA_TX_CHANNEL->DMACCLLI = 0;
+    SD_DMA_TX_CHANNEL->DMACCControl = length | (tx ? (1UL << 26) : 0);
+    SD_DMA_TX_CHANNEL->DMACCConfig = 1 | (tx_peripheral << 6) | (1 << 11); // enable, memory to peripheral
+
+    ssp->DMACR = 3; // receive and transmit DMA
+
+    // the receive channel finishes last, it disables itself when done
+    bool ok = false;
+    for(int i=0; i<SD_DATA_TIMEOUT * 10; i++) {
+        if((LPC_GPDMA->DMACEnbldChns & SD_DMA_CHANNEL_BITS) == 0) {
+            ok = (LPC_GPDMA->DMACRawIntErrStat & SD_DMA_CHANNEL_BITS) == 0;
+            break;
+        }
+    }
+
+    ssp->DMACR = 0;
+    SD_DMA_RX_CHANNEL->DMACCConfig = 0;
+    SD_DMA_TX_CHANNEL->DMACCConfig = 0;
+
+    if(!ok) {
+        // discard whatever is left in the FIFO, the caller fails the block
+        while(ssp->SR & (1 << 4)); // busy
+        while(ssp->SR & (1 << 2)) (void)ssp->DR;
+        return 1;
+    }
+
     return 0;
 }
 
@@ -543,6 +741,12 @@ uint32_t SDCard::_sd_sectors() {
 
     int csd_structure = ext_bits(csd, 127, 126);
 
+    // tran_speed : csd[103:96], the maximum data transfer clock
+    static const uint8_t tran_mult[16] = { 0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80 };
+    static const uint32_t tran_unit[4] = { 10000, 100000, 1000000, 10000000 }; // 100kbit/s to 100Mbit/s divided by 10 for the multiplier
+    int tran_speed = ext_bits(csd, 103, 96);
+    _tran_speed = ((tran_speed & 0x07) < 4) ? tran_unit[tran_speed & 0x07] * tran_mult[(tran_speed >> 3) & 0x0F] : 0;
+
     if (csd_structure == 0)
     {
         if (cardtype == SDCARD_V2HC)
@@ -31,7 +31,12 @@
 #include "disk.h"
 #include "mbed.h"
 
-// #include "DMA.h"
+// mbed SPI with access to the SSP peripheral so block transfers can use the GPDMA
+class SDCardSPI : public mbed::SPI {
+public:
+    SDCardSPI(PinName mosi, PinName miso, PinName sclk) : mbed::SPI(mosi, miso, sclk) {}
+    LPC_SSP_TypeDef *ssp() const { return _spi.spi; }
+};
 
 /** Access the filesystem on an SD Card using SPI
  *
@@ -71,6 +76,8 @@ public:
     virtual int disk_initialize();
     virtual int disk_write(const char *buffer, uint32_t block_number);
     virtual int disk_read(char *buffer, uint32_t block_number);
+    virtual int disk_write_blocks(const char *buffer, uint32_t block_number, uint32_t count);
+    virtual int disk_read_blocks(char *buffer, uint32_t block_number, uint32_t count);
     virtual int disk_status();
     virtual int disk_sync();
     virtual uint32_t disk_sectors();
@@ -80,6 +87,9 @@ public:
 
     CARD_TYPE card_type(void);
 
+    // the highest SPI clock to use for data transfers, the card may limit it further
+    void set_max_frequency(uint32_t hz) { _max_frequency = hz; }
+
     bool busy();
 
 protected:
@@ -94,16 +104,28 @@ protected:
 
     int _read(char *buffer, int length);
     int _write(const char *buffer, int length);
+    int _read_block(char *buffer, int length);
+    int _write_block(const char *buffer, int length, uint8_t token);
+    int _stop_transmission();
+    int _wait_not_busy();
+    int _transfer(const char *tx, char *rx, int length);
+    int _dma_transfer(const char *tx, char *rx, int length);
 
     uint32_t _sd_sectors();
     uint32_t _sectors;
+    uint32_t _tran_speed; // maximum clock from the CSD
+    uint32_t _max_frequency;
 
-    mbed::SPI _spi;
+    SDCardSPI _spi;
     GPIO _cs;
 
     volatile bool busyflag;
 
     CARD_TYPE cardtype;
+
+    // source of the 0xFF bytes clocked out and sink for the bytes discarded during DMA transfers
+    uint8_t _dma_ff;
+    uint8_t _dma_sink;
 };
 
 #endif
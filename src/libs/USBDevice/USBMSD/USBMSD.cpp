@@ -34,6 +34,9 @@
 #define NO_DISK         0x02
 #define WRITE_PROTECT   0x04
 
+// number of blocks buffered for multiple block reads and writes
+#define MSD_PAGE_BLOCKS 4
+
 #define CBW_Signature   0x43425355
 #define CSW_Signature   0x53425355
 
@@ -83,6 +86,7 @@ enum Status {
 USBMSD::USBMSD(USB *u, MSD_Disk *d) {
     this->usb = u;
     this->disk = d;
+    this->write_callback = NULL;
 
     usbdesc_interface i = {
         DL_INTERFACE,           // bLength
@@ -191,7 +195,15 @@ bool USBMSD::connect()
     BlockSize = disk->disk_blocksize();
 
     if ((BlockCount > 0) && (BlockSize != 0)) {
-        page = (uint8_t*) AHB0.alloc(BlockSize);
+        // try for a multiple block page, fall back to a single block if memory is short
+        page_size = MSD_PAGE_BLOCKS;
+        page = (uint8_t*) AHB0.alloc(BlockSize * page_size);
+        if (page == NULL) {
+            page_size = 1;
+            page = (uint8_t*) AHB0.alloc(BlockSize);
+        }
+        page_blocks = 0;
+        page_lba = 0;
         if (page == NULL)
             return false;
     } else {
@@ -309,16 +321,12 @@ void USBMSD::memoryWrite (uint8_t * buf, uint16_t size) {
         usb->stallEndpoint(MSC_BulkOut.bEndpointAddress);
     }
 
-    // we fill an array in RAM of 1 block before writing it in memory
+    // we fill an array in RAM of up to page_size blocks before writing them in memory
+    if (page_blocks == 0)
+        page_lba = lba;
+    uint8_t *p = &page[(lba - page_lba) * BlockSize + addr_in_block];
     for (int i = 0; i < size; i++)
-        page[addr_in_block + i] = buf[i];
-
-    // if the array is filled, write it in memory
-    if ((addr_in_block + size) >= BlockSize) {
-        if (!(disk->disk_status() & WRITE_PROTECT)) {
-            disk->disk_write((const char *)page, lba);
-        }
-    }
+        p[i] = buf[i];
 
     addr_in_block += size;
     length -= size;
@@ -327,6 +335,17 @@ void USBMSD::memoryWrite (uint8_t * buf, uint16_t size) {
     {
         addr_in_block = 0;
         lba++;
+        page_blocks++;
+    }
+
+    // if the array is filled or this is the last block, write it in memory
+    if (page_blocks > 0 && (page_blocks >= page_size || !length || stage != PROCESS_CBW)) {
+        if (!(disk->disk_status() & WRITE_PROTECT)) {
+            disk->disk_write_blocks((const char *)page, page_lba, page_blocks);
+            if (write_callback != NULL)
+                write_callback();
+        }
+        page_blocks = 0;
     }
 
     if ((!length) || (stage != PROCESS_CBW)) {
@@ -345,8 +364,10 @@ void USBMSD::memoryVerify (uint8_t * buf, uint16_t size) {
     }
 
     // beginning of a new block -> load a whole block in RAM
-    if (addr_in_block == 0)
+    if (addr_in_block == 0) {
         disk->disk_read((char *)page, lba);
+        page_blocks = 0;
+    }
 
     // info are in RAM -> no need to re-read memory
     for (n = 0; n < size; n++) {
@@ -647,17 +668,22 @@ void USBMSD::memoryRead (void) {
         stage = ERROR;
     }
 
-    // we read an entire block
-    if (addr_in_block == 0)
+    // we read as many of the remaining blocks as fit in the page with one transfer
+    if (addr_in_block == 0 && (page_blocks == 0 || lba < page_lba || lba >= page_lba + page_blocks))
     {
-        iprintf("MSD:LBA %lu:", lba);
-        disk->disk_read((char *)page, lba);
+        uint32_t nb = (length + BlockSize - 1) / BlockSize;
+        if (nb > page_size) nb = page_size;
+        if (lba + nb > BlockCount) nb = (lba < BlockCount) ? BlockCount - lba : 1;
+        iprintf("MSD:LBA %lu+%lu:", lba, nb);
+        disk->disk_read_blocks((char *)page, lba, nb);
+        page_lba = lba;
+        page_blocks = nb;
     }
 
     iprintf(" %u", addr_in_block / MAX_PACKET_SIZE_EPBULK);
 
     // write data which are in RAM
-    usb->writeNB(MSC_BulkIn.bEndpointAddress, &page[addr_in_block], n, MAX_PACKET_SIZE_EPBULK);
+    usb->writeNB(MSC_BulkIn.bEndpointAddress, &page[(lba - page_lba) * BlockSize + addr_in_block], n, MAX_PACKET_SIZE_EPBULK);
 
     addr_in_block += n;
 
@@ -726,6 +752,7 @@ bool USBMSD::infoTransfer (void) {
     }
 
     addr_in_block = 0;
+    page_blocks = 0; // nothing cached between commands
 
 //     iprintf("MSD:transferring %lu blocks from LBA %lu.\n", blocks, lba);
 
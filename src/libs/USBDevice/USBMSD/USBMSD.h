@@ -81,6 +81,9 @@ public:
     */
     bool connect();
 
+    // called from the USB interrupt after the host writes to the disk, so anything caching the disk can drop its copy
+    void set_write_callback(void (*fn)(void)) { write_callback = fn; }
+
     bool USBEvent_Request(CONTROL_TRANSFER&);
     bool USBEvent_RequestComplete(CONTROL_TRANSFER&, uint8_t *, uint32_t);
     bool USBEvent_EPIn(uint8_t, uint8_t);
@@ -123,6 +126,7 @@ private:
 
     // disk
     MSD_Disk *disk;
+    void (*write_callback)(void);
 
     // MSC Bulk-only Stage
     enum Stage {
@@ -159,7 +163,11 @@ private:
     bool memOK;
 
     // cache in RAM before writing in memory. Useful also to read a block.
+    // holds up to page_size blocks so runs of blocks use multiple block transfers
     uint8_t * page;
+    uint8_t page_size;
+    uint8_t page_blocks; // blocks read into or waiting to be written from the page
+    uint32_t page_lba;   // block number of the first block in the page
 
     // USB packet buffer
     uint8_t buffer[MAX_PACKET_SIZE_EPBULK];
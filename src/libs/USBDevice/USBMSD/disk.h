@@ -23,6 +23,32 @@ public:
      */
     virtual int disk_write(const char * data, uint32_t block) { return 0; };
 
+    /*
+     * read count consecutive blocks, disks that support multiple block transfers should override this
+     *
+     * @returns 0 if successful
+     */
+    virtual int disk_read_blocks(char * data, uint32_t block, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            int r = disk_read(data + i * disk_blocksize(), block + i);
+            if (r) return r;
+        }
+        return 0;
+    };
+
+    /*
+     * write count consecutive blocks, disks that support multiple block transfers should override this
+     *
+     * @returns 0 if successful
+     */
+    virtual int disk_write_blocks(const char * data, uint32_t block, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            int r = disk_write(data + i * disk_blocksize(), block + i);
+            if (r) return r;
+        }
+        return 0;
+    };
+
     /*
      * Disk initilization
      */
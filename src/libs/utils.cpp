@@ -263,6 +263,53 @@ string wcs2gcode(int wcs) {
     return str;
 }
 
+// decode a base64 string into out, returns the number of bytes decoded or -1 on a bad character or overflow
+// whitespace is ignored and decoding stops at the first padding character
+int base64_decode(const char *in, uint8_t *out, size_t outsize)
+{
+    size_t n= 0;
+    uint32_t acc= 0;
+    int bits= 0;
+    for (; *in && *in != '='; in++) {
+        char c= *in;
+        int v;
+        if(c >= 'A' && c <= 'Z') v= c - 'A';
+        else if(c >= 'a' && c <= 'z') v= c - 'a' + 26;
+        else if(c >= '0' && c <= '9') v= c - '0' + 52;
+        else if(c == '+') v= 62;
+        else if(c == '/') v= 63;
+        else if(is_whitespace(c)) continue;
+        else return -1;
+
+        acc= (acc << 6) | v;
+        bits += 6;
+        if(bits >= 8) {
+            bits -= 8;
+            if(n >= outsize) return -1;
+            out[n++]= (acc >> bits) & 0xFF;
+        }
+    }
+    return n;
+}
+
+// the standard CRC-32 as used by zlib and Ethernet, pass the previous result as crc to continue it over more data
+uint32_t crc32_ieee(const uint8_t *buf, size_t len, uint32_t crc)
+{
+    // a table per nibble keeps it small
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    crc= ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        crc= (crc >> 4) ^ table[crc & 0x0F];
+        crc= (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
 void safe_delay_ms(uint32_t delay)
 {
     safe_delay_us(delay*1000);
@@ -35,6 +35,8 @@ std::string absolute_from_relative( std::string path );
 
 int append_parameters(char *buf, std::vector<std::pair<char,float>> params, size_t bufsize);
 std::string wcs2gcode(int wcs);
+int base64_decode(const char *in, uint8_t *out, size_t outsize);
+uint32_t crc32_ieee(const uint8_t *buf, size_t len, uint32_t crc= 0);
 void safe_delay_us(uint32_t delay);
 void safe_delay_ms(uint32_t delay);
 
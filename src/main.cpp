@@ -13,6 +13,7 @@
 #include "modules/tools/temperaturecontrol/TemperatureControlPool.h"
 #include "modules/tools/endstops/Endstops.h"
 #include "modules/tools/zprobe/ZProbe.h"
+#include "modules/tools/zprobe/GridMesh.h"
 #include "modules/tools/scaracal/SCARAcal.h"
 #include "RotaryDeltaCalibration.h"
 #include "modules/tools/switch/SwitchPool.h"
@@ -65,6 +66,14 @@
 #define disable_msd_checksum  CHECKSUM("msd_disable")
 #define dfu_enable_checksum  CHECKSUM("dfu_enable")
 #define watchdog_timeout_checksum  CHECKSUM("watchdog_timeout")
+#define sd_spi_frequency_checksum  CHECKSUM("sd_spi_frequency")
+#define sd_cache_sectors_checksum  CHECKSUM("sd_cache_sectors")
+
+// AHB0 memory left free after the sd card cache is made, on top of what the grid compensation has reserved,
+// for shapers set up later with M593 and other small allocations made after boot
+#define AHB0_RESERVE 2048
+// sectors cached while booting, for the FAT and directory sectors the config-override and file checks re-read
+#define BOOT_CACHE_SECTORS 2
 
 
 // USB Stuff
@@ -82,6 +91,12 @@ USBMSD *msc= NULL;
 
 SDFAT mounter __attribute__ ((section ("AHBSRAM0"))) ("sd", &sd);
 
+// the host writes straight to the card so whatever the cache holds may now be wrong
+static void msd_written()
+{
+    mounter.invalidate_cache();
+}
+
 GPIO leds[5] = {
     GPIO(P1_18),
     GPIO(P1_19),
@@ -103,9 +118,16 @@ void init() {
     kernel->streams->printf("Smoothie Running @%ldMHz\r\n", SystemCoreClock / 1000000);
     SimpleShell::version_command("", kernel->streams);
 
+    // the card clock is the lower of this and the speed the card reports it supports
+    sd.set_max_frequency(kernel->config->value( sd_spi_frequency_checksum )->by_default(12000000)->as_number());
     bool sdok= (sd.disk_initialize() == 0);
     if(!sdok) kernel->streams->printf("SDCard failed to initialize\r\n");
 
+    // the full cache is made last so it does not take AHB0 memory the modules and planner queue need,
+    // until then a small one covers the files read while booting
+    int cache_sectors= kernel->config->value( sd_cache_sectors_checksum )->by_default(8)->as_int();
+    if(sdok && cache_sectors > 0) mounter.set_cache_size(min(cache_sectors, BOOT_CACHE_SECTORS));
+
     #ifdef NONETWORK
         kernel->streams->printf("NETWORK is disabled\r\n");
     #endif
@@ -195,9 +217,11 @@ void init() {
 
 #ifdef DISABLEMSD
     if(sdok && msc != NULL){
+        msc->set_write_callback(msd_written);
         kernel->add_module( msc );
     }
 #else
+    msc.set_write_callback(msd_written);
     kernel->add_module( &msc );
 #endif
 
@@ -253,8 +277,20 @@ void init() {
         }
     }
 
+    // the boot cache is given back so the planner queue can use it
+    mounter.set_cache_size(0);
+
     // start the timers and interrupts
     THEKERNEL->conveyor->start(THEROBOT->get_number_registered_motors());
+
+    // the sd card cache gets what is left of AHB0, less what the grid compensation will take when it is turned on
+    // and some for things allocated later on
+    uint32_t reserve= AHB0_RESERVE + GridMesh::get_reserved();
+    uint32_t spare= AHB0.free();
+    spare= (spare > reserve) ? spare - reserve : 0;
+    if(cache_sectors > (int)(spare / 512)) cache_sectors= spare / 512;
+    if(cache_sectors > 0) mounter.set_cache_size(cache_sectors);
+
     THEKERNEL->step_ticker->start();
     THEKERNEL->slow_ticker->start();
 }
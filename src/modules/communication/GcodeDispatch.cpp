@@ -28,6 +28,8 @@
 
 #define panel_display_message_checksum CHECKSUM("display_message")
 #define panel_checksum             CHECKSUM("panel")
+#define laser_checksum             CHECKSUM("laser")
+#define raster_data_checksum       CHECKSUM("raster_data")
 
 // goes in Flash, list of Mxxx codes that are allowed when in Halted state
 static const int allowed_mcodes[]= {2,5,9,30,105,114,119,80,81,911,503,106,107}; // get temp, get pos, get endstops etc
@@ -261,6 +263,22 @@ try_again:
                                 return;
                             }
 
+                            case 650: // M650 is a special non compliant Gcode, the rest of the line is base64 laser raster data for the next G1
+                            {
+                                string str= single_command.substr(4) + possible_command;
+                                delete gcode;
+                                if(PublicData::set_value( laser_checksum, raster_data_checksum, &str )) {
+                                    new_message.stream->printf("ok\r\n");
+
+                                }else{
+                                    // no laser module or bad data, we cannot continue the raster safely
+                                    new_message.stream->printf("%s: Raster data rejected\r\n", THEKERNEL->is_grbl_mode() ? "error" : "Error");
+                                    new_message.stream->printf("Entering Alarm/Halt state\n");
+                                    THEKERNEL->call_event(ON_HALT, nullptr);
+                                }
+                                return;
+                            }
+
                             case 1000: // M1000 is a special command that will pass thru the raw lowercased command to the simpleshell (for hosts that do not allow such things)
                             {
                                 // reconstruct entire command line again
@@ -27,6 +27,7 @@ using std::string;
 #define STEP_TICKER_FREQUENCY THEKERNEL->step_ticker->get_frequency()
 
 uint8_t Block::n_actuators= 0;
+uint16_t Block::raster_max_size= 0;
 double Block::fp_scale= 0;
 
 // A block represents a movement, it's length for each stepper motor, and the corresponding acceleration curves.
@@ -37,6 +38,7 @@ double Block::fp_scale= 0;
 Block::Block()
 {
     tick_info= nullptr;
+    raster_data= nullptr;
     clear();
 }
 
@@ -71,6 +73,9 @@ void Block::clear()
     locked              = false;
     s_value             = 0.0F;
 
+    // the raster slot is kept for the next raster block
+    raster_size= 0;
+
     total_move_ticks= 0;
     if(tick_info == nullptr) {
         // we create this once for this block
@@ -68,7 +68,13 @@ class Block {
         // need info for each active motor
         tickinfo_t *tick_info;
 
+        // optional row of laser raster intensities spread evenly over this block, 0-255 each
+        // the slot is created the first time the block has raster data and is raster_max_size long
+        uint8_t *raster_data;
+        uint16_t raster_size;
+
         static uint8_t n_actuators;
+        static uint16_t raster_max_size;
 
         struct {
             bool recalculate_flag:1;             // Planner flag to recalculate trapezoids on entry junction
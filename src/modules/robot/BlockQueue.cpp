@@ -182,6 +182,7 @@ bool BlockQueue::resize(unsigned int length)
 
         // Note: we don't use realloc so we can fall back to the existing ring if allocation fails
         void *v= AHB0.alloc(sizeof(Block) * length);
+        if (v == nullptr) return false;
         Block* newring = new(v) Block[length];
 
         if (newring != nullptr)
@@ -14,6 +14,7 @@
 #include "Block.h"
 #include "Conveyor.h"
 #include "Planner.h"
+#include "StreamOutputPool.h"
 #include "mri.h"
 #include "checksumm.h"
 #include "Config.h"
@@ -81,7 +82,21 @@ void Conveyor::on_module_loaded()
 void Conveyor::start(uint8_t n)
 {
     Block::init(n); // set the number of motors which determines how big the tick info vector is
-    queue.resize(queue_size);
+
+    // fall back to a smaller queue if there is not enough memory for the configured one
+    size_t size= queue_size;
+    while(!queue.resize(size)) {
+        size /= 2;
+        if(size < 2) {
+            THEKERNEL->streams->printf("ERROR: not enough memory for the planner queue\n");
+            THEKERNEL->call_event(ON_HALT, nullptr);
+            return;
+        }
+    }
+    if(size != queue_size) {
+        THEKERNEL->streams->printf("WARNING: not enough memory for planner_queue_size %u, using %u\n", queue_size, size);
+        queue_size= size;
+    }
     running = true;
 }
 
@@ -121,7 +136,8 @@ bool Conveyor::is_idle() const
         for(auto &a : THEROBOT->actuators) {
             if(a->is_moving()) return false;
         }
-        return true;
+        // input shapers and pressure advance may still be issuing delayed steps
+        return THEKERNEL->step_ticker->is_shaper_idle() && THEKERNEL->step_ticker->is_advance_idle();
     }
 
     return false;
@@ -225,6 +241,18 @@ bool Conveyor::get_next_block(Block **block)
     return false;
 }
 
+// returns the block that will follow the one currently being ticked without fetching it, or nullptr if there is none yet
+// only called from the step tick ISR, used to setup direction pins early
+const Block *Conveyor::peek_next_block()
+{
+    if(flush || !allow_fetch || THEKERNEL->is_halted() || queue.isr_tail_i == queue.head_i) return nullptr;
+
+    unsigned int i= queue.next(queue.isr_tail_i);
+    if(i == queue.head_i) return nullptr;
+
+    return queue.item_ref(i);
+}
+
 // called from step ticker ISR when block is finished, do not do anything slow here
 void Conveyor::block_finished()
 {
@@ -29,6 +29,7 @@ public:
 
     // returns next available block writes it to block and returns true
     bool get_next_block(Block **block);
+    const Block *peek_next_block();
     void block_finished();
 
     void dump_queue(void);
@@ -81,6 +81,16 @@ bool Planner::append_block( ActuatorCoordinates &actuator_pos, uint8_t n_motors,
     block->s_value = roundf(s_value*(1<<11)); // 1.11 fixed point
     block->is_g123 = g123;
 
+    // copy the part of any raster row that this block covers
+    if(g123 && THEROBOT->raster_segment_size > 0) {
+        if(block->raster_data == nullptr) {
+            // we create this once for this block, it is big enough for any segment of a row
+            block->raster_data= new uint8_t[Block::raster_max_size];
+        }
+        block->raster_size= std::min(THEROBOT->raster_segment_size, Block::raster_max_size);
+        memcpy(block->raster_data, THEROBOT->raster_segment, block->raster_size);
+    }
+
     // use default JD
     float junction_deviation = this->junction_deviation;
 
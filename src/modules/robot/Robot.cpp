@@ -25,6 +25,7 @@
 #include "arm_solutions/CoreXZSolution.h"
 #include "arm_solutions/MorganSCARASolution.h"
 #include "StepTicker.h"
+#include "InputShaper.h"
 #include "checksumm.h"
 #include "utils.h"
 #include "ConfigValue.h"
@@ -87,6 +88,8 @@
 
 #define laser_module_default_power_checksum     CHECKSUM("laser_module_default_power")
 
+#define input_shaper_buffer_size_checksum       CHECKSUM("input_shaper_buffer_size")
+
 #define ARC_ANGULAR_TRAVEL_EPSILON 5E-7F // Float (radians)
 #define PI 3.14159265358979323846F // force to be float, do not use M_PI
 
@@ -105,6 +108,7 @@ Robot::Robot()
     seconds_per_minute = 60.0F;
     this->clearToolOffset();
     this->compensationTransform = nullptr;
+    this->compensationSplits = nullptr;
     this->get_e_scale_fnc= nullptr;
     this->wcs_offsets.fill(wcs_t(0.0F, 0.0F, 0.0F));
     this->g92_offset = wcs_t(0.0F, 0.0F, 0.0F);
@@ -118,11 +122,21 @@ Robot::Robot()
 void Robot::on_module_loaded()
 {
     this->register_for_event(ON_GCODE_RECEIVED);
+    this->register_for_event(ON_HALT);
 
     // Configuration
     this->load_config();
 }
 
+void Robot::on_halt(void *argument)
+{
+    if(argument == nullptr) {
+        // a raster row left from an aborted job must not be burned by the next G1
+        raster_row.clear();
+        raster_segment_size= 0;
+    }
+}
+
 #define ACTUATOR_CHECKSUMS(X) {     \
     CHECKSUM(X "_step_pin"),        \
     CHECKSUM(X "_dir_pin"),         \
@@ -132,6 +146,12 @@ void Robot::on_module_loaded()
     CHECKSUM(X "_acceleration")     \
 }
 
+#define SHAPER_CHECKSUMS(X) {           \
+    CHECKSUM(X "_shaper_type"),         \
+    CHECKSUM(X "_shaper_frequency"),    \
+    CHECKSUM(X "_shaper_damping")       \
+}
+
 void Robot::load_config()
 {
     // Arm solutions are used to convert positions in millimeters into position in steps for each stepper motor.
@@ -209,6 +229,14 @@ void Robot::load_config()
         #endif
     };
 
+    // optional input shaping for the primary actuators
+    uint16_t const shaper_checksums[][3] = {
+        SHAPER_CHECKSUMS("alpha"),
+        SHAPER_CHECKSUMS("beta"),
+        SHAPER_CHECKSUMS("gamma")
+    };
+    this->shaper_buffer_size= THEKERNEL->config->value(input_shaper_buffer_size_checksum)->by_default(0)->as_number();
+
     // default acceleration setting, can be overriden with newer per axis settings
     this->default_acceleration= THEKERNEL->config->value(acceleration_checksum)->by_default(100.0F )->as_number(); // Acceleration is in mm/s^2
 
@@ -240,6 +268,16 @@ void Robot::load_config()
         actuators[a]->change_steps_per_mm(THEKERNEL->config->value(checksums[a][3])->by_default(a == 2 ? 2560.0F : 80.0F)->as_number());
         actuators[a]->set_max_rate(THEKERNEL->config->value(checksums[a][4])->by_default(30000.0F)->as_number()/60.0F); // it is in mm/min and converted to mm/sec
         actuators[a]->set_acceleration(THEKERNEL->config->value(checksums[a][5])->by_default(NAN)->as_number()); // mm/secs²
+
+        if(a <= Z_AXIS) {
+            InputShaper::TYPE type= InputShaper::type_from_string(THEKERNEL->config->value(shaper_checksums[a][0])->by_default("none")->as_string().c_str());
+            if(type != InputShaper::NONE) {
+                float f= THEKERNEL->config->value(shaper_checksums[a][1])->by_default(40.0F)->as_number();
+                float d= THEKERNEL->config->value(shaper_checksums[a][2])->by_default(0.1F)->as_number();
+                InputShaper *shaper= make_shaper(a, nullptr, type, f, d, THEKERNEL->streams);
+                if(shaper != nullptr) THEKERNEL->step_ticker->set_shaper(a, shaper);
+            }
+        }
     }
 
     check_max_actuator_speeds(); // check the configs are sane
@@ -401,6 +439,59 @@ Robot::wcs_t Robot::mcs2wcs(const Robot::wcs_t& pos) const
     );
 }
 
+// sets up a shaper for actuator a, reusing shaper if its buffer is big enough, returns nullptr and deletes shaper if it can't be done
+// the buffer must hold every step pushed within the longest impulse delay at the actuators maximum step rate
+InputShaper *Robot::make_shaper(size_t a, InputShaper *shaper, InputShaper::TYPE type, float f, float d, StreamOutput *stream)
+{
+    float step_rate= std::min(actuators[a]->get_max_rate() * actuators[a]->get_steps_per_mm(), (float)THEKERNEL->base_stepping_frequency);
+    uint16_t needed= InputShaper::needed_size(type, f, d, step_rate);
+    uint16_t size= (shaper_buffer_size > 0) ? shaper_buffer_size : needed;
+    if(size < needed) {
+        stream->printf("ERROR: input shaper for motor %c needs input_shaper_buffer_size of at least %u\n", 'X'+a, needed);
+        delete shaper;
+        return nullptr;
+    }
+
+    if(shaper != nullptr && shaper->get_size() < size) {
+        delete shaper;
+        shaper= nullptr;
+    }
+    if(shaper == nullptr) {
+        shaper= new InputShaper(size);
+        if(shaper->get_size() == 0) {
+            stream->printf("ERROR: not enough memory for input shaper for motor %c, %u steps\n", 'X'+a, size);
+            delete shaper;
+            return nullptr;
+        }
+    }
+
+    if(!shaper->set_parameters(type, f, d, THEKERNEL->step_ticker->get_frequency())) {
+        stream->printf("ERROR: input shaper for motor %c could not be set\n", 'X'+a);
+        delete shaper;
+        return nullptr;
+    }
+    return shaper;
+}
+
+// the shaper buffers are sized for the step rate when they were made, so after M92 or M203 changes it
+// any that are now too small are made again with the same settings
+void Robot::resize_shapers(StreamOutput *stream)
+{
+    for (int i = X_AXIS; i <= Z_AXIS && i < n_motors; ++i) {
+        InputShaper *shaper= THEKERNEL->step_ticker->get_shaper(i);
+        if(shaper == nullptr) continue;
+
+        float step_rate= std::min(actuators[i]->get_max_rate() * actuators[i]->get_steps_per_mm(), (float)THEKERNEL->base_stepping_frequency);
+        if(shaper->get_size() >= InputShaper::needed_size(shaper->get_type(), shaper->get_frequency(), shaper->get_damping(), step_rate)) continue;
+
+        // the shaper can only be changed when it has no pending steps
+        THEKERNEL->conveyor->wait_for_idle();
+        THEKERNEL->step_ticker->set_shaper(i, nullptr);
+        shaper= make_shaper(i, shaper, shaper->get_type(), shaper->get_frequency(), shaper->get_damping(), stream);
+        if(shaper != nullptr) THEKERNEL->step_ticker->set_shaper(i, shaper);
+    }
+}
+
 // this does a sanity check that actuator speeds do not exceed steps rate capability
 // we will override the actuator max_rate if the combination of max_rate and steps/sec exceeds base_stepping_frequency
 void Robot::check_max_actuator_speeds()
@@ -626,6 +717,7 @@ void Robot::on_gcode_received(void *argument)
                 }
                 gcode->add_nl = true;
                 check_max_actuator_speeds();
+                resize_shapers(gcode->stream);
                 return;
 
             case 114:{
@@ -691,6 +783,7 @@ void Robot::on_gcode_received(void *argument)
                         }
 
                         if(gcode->subcode == 1) check_max_actuator_speeds();
+                        resize_shapers(gcode->stream);
                     }
                     break;
 
@@ -757,6 +850,43 @@ void Robot::on_gcode_received(void *argument)
                 THEKERNEL->conveyor->wait_for_idle();
                 break;
 
+            case 593: // M593 X Pn Fnnn Dnnn - set input shaper type (0 none, 1 ZV, 2 ZVD, 3 EI), frequency and damping for an axis
+                if(gcode->subcode == 1) {
+                    // M593.1 X Snnn Lnnn Annn print the shaped velocity profile of a move for plotting on a host
+                    print_shaper_profile(gcode);
+                    break;
+                }
+
+                for (int i = X_AXIS; i <= Z_AXIS && i < n_motors; ++i) {
+                    if(!gcode->has_letter('X'+i)) continue;
+
+                    InputShaper *shaper= THEKERNEL->step_ticker->get_shaper(i);
+                    InputShaper::TYPE type= shaper ? shaper->get_type() : InputShaper::NONE;
+                    float f= shaper ? shaper->get_frequency() : 40.0F;
+                    float d= shaper ? shaper->get_damping() : 0.1F;
+                    if(gcode->has_letter('P')) type= (InputShaper::TYPE)confine(gcode->get_int('P'), 0, 3);
+                    if(gcode->has_letter('F')) f= gcode->get_value('F');
+                    if(gcode->has_letter('D')) d= gcode->get_value('D');
+
+                    // the shaper can only be changed when it has no pending steps
+                    THEKERNEL->conveyor->wait_for_idle();
+                    THEKERNEL->step_ticker->set_shaper(i, nullptr);
+                    if(type == InputShaper::NONE) {
+                        delete shaper;
+                        continue;
+                    }
+
+                    shaper= make_shaper(i, shaper, type, f, d, gcode->stream);
+                    if(shaper != nullptr) THEKERNEL->step_ticker->set_shaper(i, shaper);
+                }
+
+                for (int i = X_AXIS; i <= Z_AXIS && i < n_motors; ++i) {
+                    InputShaper *shaper= THEKERNEL->step_ticker->get_shaper(i);
+                    if(shaper == nullptr) continue;
+                    gcode->stream->printf("%c: %s %1.2fHz damping %1.3f\n", 'X'+i, InputShaper::type_to_string(shaper->get_type()), shaper->get_frequency(), shaper->get_damping());
+                }
+                break;
+
             case 500: // M500 saves some volatile settings to config override file
             case 503: { // M503 just prints the settings
                 gcode->stream->printf(";Steps per unit:\nM92 ");
@@ -788,6 +918,12 @@ void Robot::on_gcode_received(void *argument)
                 }
                 gcode->stream->printf("\n");
 
+                for (int i = X_AXIS; i <= Z_AXIS && i < n_motors; ++i) {
+                    InputShaper *shaper= THEKERNEL->step_ticker->get_shaper(i);
+                    if(shaper == nullptr) continue;
+                    gcode->stream->printf(";Input shaper type, frequency and damping:\nM593 %c P%d F%1.4f D%1.4f\n", 'X'+i, shaper->get_type(), shaper->get_frequency(), shaper->get_damping());
+                }
+
                 // get or save any arm solution specific optional values
                 BaseSolution::arm_options_t options;
                 if(arm_solution->get_optional(options) && !options.empty()) {
@@ -1308,8 +1444,9 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
     // In delta robots either mm_per_line_segment can be used OR delta_segments_per_second
     // The latter is more efficient and avoids splitting fast long lines into very small segments, like initial z move to 0, it is what Johanns Marlin delta port does
     uint16_t segments;
+    bool no_segments= this->disable_segmentation || (!segment_z_moves && !gcode->has_letter('X') && !gcode->has_letter('Y'));
 
-    if(this->disable_segmentation || (!segment_z_moves && !gcode->has_letter('X') && !gcode->has_letter('Y'))) {
+    if(no_segments) {
         segments= 1;
 
     } else if(this->delta_segments_per_second > 1.0F) {
@@ -1329,8 +1466,27 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
         }
     }
 
+    // a pending laser raster row is consumed by this G1 and spread evenly over its segments
+    bool raster= !raster_row.empty() && gcode->has_g && gcode->g == 1;
+
     bool moved= false;
-    if (segments > 1) {
+    if (segments == 1 && !no_segments && !raster && compensationTransform && compensationSplits) {
+        // only split where the move crosses the compensation grid, and inside a cell where it gets too far from the surface
+        float t[24];
+        int n= compensationSplits(machine_position, target, t, 24);
+        float start[n_motors];
+        float segment_end[n_motors];
+        memcpy(start, machine_position, n_motors*sizeof(float));
+        for (int s = 0; s < n; s++) {
+            if(THEKERNEL->is_halted()) return false; // don't queue any more segments
+            for (int i = 0; i < n_motors; i++)
+                segment_end[i] = start[i] + (target[i] - start[i]) * t[s];
+
+            bool b= this->append_milestone(segment_end, rate_mm_s);
+            moved= moved || b;
+        }
+
+    } else if (segments > 1) {
         // A vector to keep track of the endpoint of each segment
         float segment_delta[n_motors];
         float segment_end[n_motors];
@@ -1343,10 +1499,15 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
         // segment 0 is already done - it's the end point of the previous move so we start at segment 1
         // We always add another point after this loop so we stop at segments-1, ie i < segments
         for (int i = 1; i < segments; i++) {
-            if(THEKERNEL->is_halted()) return false; // don't queue any more segments
+            if(THEKERNEL->is_halted()) {
+                raster_segment_size= 0;
+                return false; // don't queue any more segments
+            }
             for (int i = 0; i < n_motors; i++)
                 segment_end[i] += segment_delta[i];
 
+            if(raster) set_raster_segment(i-1, segments);
+
             // Append the end of this segment to the queue
             // this can block waiting for free block queue or if in feed hold
             bool b= this->append_milestone(segment_end, rate_mm_s);
@@ -1355,13 +1516,78 @@ bool Robot::append_line(Gcode *gcode, const float target[], float rate_mm_s, flo
     }
 
     // Append the end of this full move to the queue
+    if(raster) set_raster_segment(segments-1, segments);
     if(this->append_milestone(target, rate_mm_s)) moved= true;
 
+    if(raster) {
+        // the row has been copied into the blocks so release it
+        raster_segment_size= 0;
+        std::vector<uint8_t>().swap(raster_row);
+    }
+
     this->next_command_is_MCS = false; // always reset this
 
     return moved;
 }
 
+// prints the velocity of a trapezoid move along one axis and the velocity after input shaping as csv, sampled every millisecond
+// M593.1 X S(speed mm/s) L(length mm) A(acceleration mm/s²)
+void Robot::print_shaper_profile(Gcode *gcode)
+{
+    int axis= -1;
+    for (int i = X_AXIS; i <= Z_AXIS && i < n_motors; ++i) {
+        if(gcode->has_letter('X'+i)) axis= i;
+    }
+    InputShaper *shaper= (axis >= 0) ? THEKERNEL->step_ticker->get_shaper(axis) : nullptr;
+    if(shaper == nullptr) {
+        gcode->stream->printf("error: no input shaper set for that axis\n");
+        return;
+    }
+
+    float amplitudes[InputShaper::max_impulses], times[InputShaper::max_impulses];
+    int n= InputShaper::calculate(shaper->get_type(), shaper->get_frequency(), shaper->get_damping(), amplitudes, times);
+
+    float speed= gcode->has_letter('S') ? gcode->get_value('S') : 100.0F;
+    float length= gcode->has_letter('L') ? gcode->get_value('L') : 10.0F;
+    float accel= gcode->has_letter('A') ? gcode->get_value('A') : default_acceleration;
+    if(speed <= 0 || length <= 0 || accel <= 0) return;
+
+    // trapezoid, or triangle if the speed cannot be reached
+    if(speed * speed / accel > length) speed= sqrtf(accel * length);
+    float ta= speed / accel;
+    float tc= (length - speed * ta) / speed;
+    float total= 2 * ta + tc;
+
+    auto velocity= [=](float t) -> float {
+        if(t < 0 || t >= total) return 0;
+        if(t < ta) return accel * t;
+        if(t < ta + tc) return speed;
+        return speed - accel * (t - ta - tc);
+    };
+
+    gcode->stream->printf("time_ms,velocity,shaped_velocity\n");
+    float end= total + times[n-1];
+    for (float t = 0; t <= end; t += 0.001F) {
+        float vs= 0;
+        for (int i = 0; i < n; ++i) {
+            vs += amplitudes[i] * velocity(t - times[i]);
+        }
+        gcode->stream->printf("%1.1f,%1.4f,%1.4f\n", t * 1000, velocity(t), vs);
+        THEKERNEL->call_event(ON_IDLE);
+    }
+}
+
+// point raster_segment at the part of the pending raster row covered by the given segment of a line
+void Robot::set_raster_segment(uint16_t segment, uint16_t segments)
+{
+    size_t n= raster_row.size();
+    size_t start= (n * segment) / segments;
+    size_t end= (n * (segment + 1)) / segments;
+    if(end == start) end= start + 1; // more segments than pixels so repeat the pixel
+    raster_segment= raster_row.data() + start;
+    raster_segment_size= end - start;
+}
+
 
 // Append an arc to the queue ( cutting it into segments as needed )
 // TODO does not support any E parameters so cannot be used for 3D printing.
@@ -18,8 +18,10 @@ using std::string;
 #include "libs/Module.h"
 #include "ActuatorCoordinates.h"
 #include "nuts_bolts.h"
+#include "InputShaper.h"
 
 class Gcode;
+class StreamOutput;
 class BaseSolution;
 class StepperMotor;
 
@@ -32,6 +34,7 @@ class Robot : public Module {
         Robot();
         void on_module_loaded();
         void on_gcode_received(void* argument);
+        void on_halt(void* argument);
 
         void reset_axis_position(float position, int axis);
         void reset_axis_position(float x, float y, float z);
@@ -44,6 +47,8 @@ class Robot : public Module {
         float get_feed_rate() const;
         float get_s_value() const { return s_value; }
         void set_s_value(float s) { s_value= s; }
+        void add_raster_data(const uint8_t *data, size_t n) { raster_row.insert(raster_row.end(), data, data+n); }
+        size_t get_raster_size() const { return raster_row.size(); }
         void  push_state();
         void  pop_state();
         void check_max_actuator_speeds();
@@ -69,6 +74,8 @@ class Robot : public Module {
 
         // set by a leveling strategy to transform the target of a move according to the current plan
         std::function<void(float*, bool)> compensationTransform;
+        // optionally set with it, fills in where a move crosses the compensation grid so moves are only split there
+        std::function<int(const float*, const float*, float*, int)> compensationSplits;
         // set by an active extruder, returns the amount to scale the E parameter by (to convert mm³ to mm)
         std::function<float(void)> get_e_scale_fnc;
 
@@ -111,6 +118,10 @@ class Robot : public Module {
         void select_plane(uint8_t axis_0, uint8_t axis_1, uint8_t axis_2);
         void clearToolOffset();
         int get_active_extruder() const;
+        void set_raster_segment(uint16_t segment, uint16_t segments);
+        void print_shaper_profile(Gcode *gcode);
+        InputShaper *make_shaper(size_t a, InputShaper *shaper, InputShaper::TYPE type, float f, float d, StreamOutput *stream);
+        void resize_shapers(StreamOutput *stream);
 
         std::array<wcs_t, MAX_WCS> wcs_offsets; // these are persistent once saved with M500
         uint8_t current_wcs{0}; // 0 means G54 is enabled this is persistent once saved with M500
@@ -134,6 +145,11 @@ class Robot : public Module {
         float default_acceleration;                          // the defualt accleration if not set for each axis
         float s_value;                                       // modal S value
 
+        std::vector<uint8_t> raster_row;                     // pending laser raster row, consumed by the next G1
+        const uint8_t *raster_segment{nullptr};              // part of raster_row for the block being planned
+        uint16_t raster_segment_size{0};
+        uint16_t shaper_buffer_size;                         // Setting : delayed steps each input shaper holds, 0 sizes it from the max step rate
+
         // Number of arc generation iterations by small angle approximation before exact arc trajectory
         // correction. This parameter may be decreased if there are issues with the accuracy of the arc
         // generations. In general, the default value is more than enough for the intended CNC applications
@@ -29,6 +29,7 @@
 #include "StepTicker.h"
 #include "BaseSolution.h"
 #include "SerialMessage.h"
+#include "InterruptIn.h"
 
 #include <ctype.h>
 #include <algorithm>
@@ -60,6 +61,7 @@ enum DEFNS {MIN_PIN, MAX_PIN, MAX_TRAVEL, FAST_RATE, SLOW_RATE, RETRACT, DIRECTI
 
 #define endstop_debounce_count_checksum  CHECKSUM("endstop_debounce_count")
 #define endstop_debounce_ms_checksum     CHECKSUM("endstop_debounce_ms")
+#define endstop_use_interrupt_checksum   CHECKSUM("endstop_use_interrupt")
 
 #define home_z_first_checksum            CHECKSUM("home_z_first")
 #define homing_order_checksum            CHECKSUM("homing_order")
@@ -131,6 +133,22 @@ void Endstops::on_module_loaded()
 
 
     THEKERNEL->slow_ticker->attach(1000, this, &Endstops::read_endstops);
+
+    // optionally stop on the edge of the homing endstops as well, the timer still checks pins that can't interrupt
+    if(THEKERNEL->config->value(endstop_use_interrupt_checksum)->by_default(false)->as_bool()) {
+        for(auto& h : homing_axis) {
+            if(h.pin_info == nullptr || h.pin_info->edge) continue;
+            Pin p= h.pin_info->pin; // interrupt_pin() invalidates the pin if it can't interrupt
+            mbed::InterruptIn *in= p.interrupt_pin();
+            if(in == nullptr) {
+                THEKERNEL->streams->printf("WARNING: endstop_use_interrupt needs the %c endstop on port 0 or 2, using polling\n", h.pin_info->axis);
+                continue;
+            }
+            in->rise(this, &Endstops::endstop_edge);
+            in->fall(this, &Endstops::endstop_edge);
+            h.pin_info->edge= true;
+        }
+    }
 }
 
 // Get config using old deprecated syntax Does not support ABC
@@ -188,6 +206,7 @@ bool Endstops::load_old_config()
 
             // init struct
             info->debounce= 0;
+            info->edge= false;
             info->axis= 'X'+i;
             info->axis_index= i;
 
@@ -275,6 +294,7 @@ bool Endstops::load_config()
 
         // init pin struct
         pin_info->debounce= 0;
+        pin_info->edge= false;
         pin_info->axis= toupper(axis[0]);
         pin_info->axis_index= i;
 
@@ -532,11 +552,25 @@ void Endstops::move_to_origin(axis_bitmap_t axis)
 // Called every millisecond in an ISR
 uint32_t Endstops::read_endstops(uint32_t dummy)
 {
-    if(this->status != MOVING_TO_ENDSTOP_SLOW && this->status != MOVING_TO_ENDSTOP_FAST) return 0; // not doing anything we need to monitor for
+    check_homing_endstops(false);
+    return 0;
+}
+
+// Called from the pin interrupt on either edge of a homing endstop, the pin is checked as the edge may be it releasing
+// the motor is stopped straight away and the debounce is done by confirm_triggers() once it has stopped
+void Endstops::endstop_edge()
+{
+    check_homing_endstops(true);
+}
+
+void Endstops::check_homing_endstops(bool on_edge)
+{
+    if(this->status != MOVING_TO_ENDSTOP_SLOW && this->status != MOVING_TO_ENDSTOP_FAST) return; // not doing anything we need to monitor for
 
     // check each homing endstop
     for(auto& e : homing_axis) { // check all axis homing endstops
         if(e.pin_info == nullptr) continue; // ignore if not a homing endstop
+        if(on_edge && !e.pin_info->edge) continue;
         int m= e.axis_index;
 
         // for corexy homing in X or Y we must only check the associated endstop, works as we only home one axis at a time for corexy
@@ -545,7 +579,7 @@ uint32_t Endstops::read_endstops(uint32_t dummy)
         if(STEPPER[m]->is_moving()) {
             // if it is moving then we check the associated endstop, and debounce it
             if(e.pin_info->pin.get()) {
-                if(e.pin_info->debounce < debounce_ms) {
+                if(!on_edge && e.pin_info->debounce < debounce_ms) {
                     e.pin_info->debounce++;
 
                 } else {
@@ -558,17 +592,36 @@ uint32_t Endstops::read_endstops(uint32_t dummy)
                         // we signal the motor to stop, which will preempt any moves on that axis
                         STEPPER[m]->stop_moving();
                     }
+                    e.pin_info->edge_triggered= on_edge;
                     e.pin_info->triggered= true;
                 }
 
-            } else {
+            } else if(!on_edge) {
                 // The endstop was not hit yet
                 e.pin_info->debounce= 0;
             }
         }
     }
+}
 
-    return 0;
+// an endstop that stopped its motor on an edge must stay triggered for endstop_debounce_ms now the motor has stopped,
+// otherwise it was noise and is no longer counted as triggered, returns false if any were not confirmed
+bool Endstops::confirm_triggers()
+{
+    bool ok= true;
+    for(auto& e : homing_axis) {
+        if(e.pin_info == nullptr || !e.pin_info->edge_triggered) continue;
+        e.pin_info->edge_triggered= false;
+        for (uint32_t i = 0; i < debounce_ms; ++i) {
+            if(!e.pin_info->pin.get()) {
+                e.pin_info->triggered= false;
+                ok= false;
+                break;
+            }
+            safe_delay_ms(1);
+        }
+    }
+    return ok;
 }
 
 void Endstops::home_xy()
@@ -604,6 +657,7 @@ void Endstops::home(axis_bitmap_t a)
     for(auto& e : endstops) {
        e->debounce= 0;
        e->triggered= false;
+       e->edge_triggered= false;
     }
 
     if (is_scara) {
@@ -646,6 +700,9 @@ void Endstops::home(axis_bitmap_t a)
         }
     }
 
+    // a trigger on an edge is debounced now, if it was noise the axis is not counted as triggered
+    confirm_triggers();
+
     // check that the endstops were hit and it did not stop short for some reason
     // if the endstop is not triggered then enter ALARM state
     // with deltas we check all three axis were triggered, but at least one of XYZ must be set to home
@@ -712,6 +769,13 @@ void Endstops::home(axis_bitmap_t a)
     // wait until finished
     THECONVEYOR->wait_for_idle();
 
+    if(!confirm_triggers()) {
+        // the slow approach stopped on noise so the home position is wrong
+        this->status = NOT_HOMING;
+        THEKERNEL->call_event(ON_HALT, nullptr);
+        return;
+    }
+
     // we did not complete movement the full distance if we hit the endstops
     // TODO Maybe only reset axis involved in the homing cycle
     THEROBOT->reset_position_from_current_actuator_position();
@@ -40,6 +40,9 @@ class Endstops : public Module{
         void process_home_command(Gcode* gcode);
         void set_homing_offset(Gcode* gcode);
         uint32_t read_endstops(uint32_t dummy);
+        void check_homing_endstops(bool on_edge);
+        void endstop_edge();
+        bool confirm_triggers();
         void handle_park(Gcode * gcode);
 
         // global settings
@@ -59,6 +62,8 @@ class Endstops : public Module{
                 uint8_t axis_index:3;
                 bool limit_enable:1;
                 bool triggered:1;
+                bool edge:1; // an edge interrupt is attached to the pin
+                bool edge_triggered:1; // stopped on an edge, not debounced yet
             };
         };
 
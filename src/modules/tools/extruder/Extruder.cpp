@@ -24,6 +24,7 @@
 #include "PublicDataRequest.h"
 #include "StreamOutputPool.h"
 #include "ExtruderPublicAccess.h"
+#include "StepTicker.h"
 
 #include <mri.h>
 
@@ -45,6 +46,8 @@
 #define retract_recover_feedrate_checksum    CHECKSUM("retract_recover_feedrate")
 #define retract_zlift_length_checksum        CHECKSUM("retract_zlift_length")
 #define retract_zlift_feedrate_checksum      CHECKSUM("retract_zlift_feedrate")
+#define pressure_advance_checksum            CHECKSUM("pressure_advance")
+#define pressure_advance_max_rate_checksum   CHECKSUM("pressure_advance_max_rate")
 
 #define PI 3.14159265358979F
 
@@ -121,6 +124,12 @@ void Extruder::config_load()
     stepper_motor->change_steps_per_mm(steps_per_millimeter);
     stepper_motor->set_selected(false); // not selected by default
     stepper_motor->set_extruder(true);  // indicates it is an extruder
+
+    // pressure advance time in seconds, 0 disables it
+    this->pressure_advance = THEKERNEL->config->value(extruder_checksum, this->identifier, pressure_advance_checksum)->by_default(0)->as_number();
+    // fastest the advance is applied or taken back in mm/s, on top of the extrusion itself
+    this->pressure_advance_max_rate = THEKERNEL->config->value(extruder_checksum, this->identifier, pressure_advance_max_rate_checksum)->by_default(10)->as_number();
+    THEKERNEL->step_ticker->set_pressure_advance(motor_id, this->pressure_advance, this->pressure_advance_max_rate * stepper_motor->get_steps_per_mm());
 }
 
 void Extruder::select()
@@ -312,6 +321,17 @@ void Extruder::on_gcode_received(void *argument)
             if(gcode->has_letter('S')) retract_recover_length = gcode->get_value('S');
             if(gcode->has_letter('F')) retract_recover_feedrate = gcode->get_value('F') / 60.0F; // specified in mm/min converted to mm/sec
 
+        } else if (gcode->m == 900 && ( (this->selected && !gcode->has_letter('P')) || (gcode->has_letter('P') && gcode->get_value('P') == this->identifier)) ) {
+            // M900 K[pressure advance in seconds]
+            if(gcode->has_letter('K')) {
+                // the step ticker can only change it when no extruder steps are outstanding
+                THEKERNEL->conveyor->wait_for_idle();
+                this->pressure_advance = gcode->get_value('K');
+                THEKERNEL->step_ticker->set_pressure_advance(motor_id, this->pressure_advance, this->pressure_advance_max_rate * stepper_motor->get_steps_per_mm());
+            } else {
+                gcode->stream->printf("Pressure advance K:%1.4f\n", this->pressure_advance);
+            }
+
         } else if (gcode->m == 221 && this->selected) { // M221 S100 change flow rate by percentage
             if(gcode->has_letter('S')) {
                 float last_scale = this->extruder_multiplier;
@@ -337,6 +357,7 @@ void Extruder::on_gcode_received(void *argument)
             if(this->max_volumetric_rate > 0) {
                 gcode->stream->printf(";E max volumetric rate mm³/sec:\nM203 V%1.4f P%d\n", this->max_volumetric_rate, this->identifier);
             }
+            gcode->stream->printf(";E pressure advance secs:\nM900 K%1.4f P%d\n", this->pressure_advance, this->identifier);
         }
 
     } else if( gcode->has_g && this->selected ) {
@@ -43,6 +43,8 @@ class Extruder : public Tool {
         float filament_diameter;            // filament diameter
         float volumetric_multiplier;
         float max_volumetric_rate;      // used for calculating volumetric rate in mm³/sec
+        float pressure_advance;         // seconds of extruder velocity to advance the extruder by during acceleration
+        float pressure_advance_max_rate; // mm/s the advance can change at
 
         // for firmware retract
         float retract_length;               // firmware retract length
@@ -25,6 +25,7 @@
 #include "PublicDataRequest.h"
 
 #include <algorithm>
+#include <functional>
 
 #define laser_checksum                          CHECKSUM("laser")
 #define laser_module_enable_checksum            CHECKSUM("laser_module_enable")
@@ -37,6 +38,10 @@
 #define laser_module_tickle_power_checksum      CHECKSUM("laser_module_tickle_power")
 #define laser_module_max_power_checksum         CHECKSUM("laser_module_max_power")
 #define laser_module_maximum_s_value_checksum   CHECKSUM("laser_module_maximum_s_value")
+#define laser_module_step_sync_checksum         CHECKSUM("laser_module_step_sync")
+#define laser_module_step_sync_interval_checksum CHECKSUM("laser_module_step_sync_interval")
+#define laser_module_raster_max_pixels_checksum CHECKSUM("laser_module_raster_max_pixels")
+#define raster_data_checksum                    CHECKSUM("raster_data")
 
 
 Laser::Laser()
@@ -44,6 +49,7 @@ Laser::Laser()
     laser_on = false;
     scale= 1;
     manual_fire= false;
+    step_sync= false;
 }
 
 void Laser::on_module_loaded()
@@ -104,6 +110,10 @@ void Laser::on_module_loaded()
     // S value that represents maximum (default 1)
     this->laser_maximum_s_value = THEKERNEL->config->value(laser_module_maximum_s_value_checksum)->by_default(1.0f)->as_number() ;
 
+    // maximum number of pixels that can be sent with M650 for one raster line
+    this->raster_max_pixels = THEKERNEL->config->value(laser_module_raster_max_pixels_checksum)->by_default(512)->as_number();
+    Block::raster_max_size = this->raster_max_pixels; // a G1 that is not segmented carries the whole row
+
     set_laser_power(0);
 
     //register for events
@@ -111,9 +121,18 @@ void Laser::on_module_loaded()
     this->register_for_event(ON_GCODE_RECEIVED);
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
     this->register_for_event(ON_GET_PUBLIC_DATA);
+    this->register_for_event(ON_SET_PUBLIC_DATA);
+
+    this->step_sync = THEKERNEL->config->value(laser_module_step_sync_checksum)->by_default(false)->as_bool();
+    if(this->step_sync) {
+        // update the power from the step ticker on trapezoid phase changes and every n steps of the primary axis
+        uint32_t interval= THEKERNEL->config->value(laser_module_step_sync_interval_checksum)->by_default(10)->as_number();
+        StepTicker::getInstance()->set_sync_callback(std::bind(&Laser::update_proportional_power, this, std::placeholders::_1), interval);
 
-    // no point in updating the power more than the PWM frequency, but no more than 1KHz
-    THEKERNEL->slow_ticker->attach(std::min(1000UL, 1000000/period), this, &Laser::set_proportional_power);
+    }else{
+        // no point in updating the power more than the PWM frequency, but no more than 1KHz
+        THEKERNEL->slow_ticker->attach(std::min(1000UL, 1000000/period), this, &Laser::set_proportional_power);
+    }
 }
 
 void Laser::on_console_line_received( void *argument )
@@ -164,6 +183,27 @@ void Laser::on_get_public_data(void* argument)
     pdr->set_taken();
 }
 
+// M650 raster data for the next G1 is passed here by GcodeDispatch as a base64 string
+void Laser::on_set_public_data(void* argument)
+{
+    PublicDataRequest* pdr = static_cast<PublicDataRequest*>(argument);
+
+    if(!pdr->starts_with(laser_checksum) || !pdr->second_element_is(raster_data_checksum)) return;
+
+    const string *str = static_cast<const string *>(pdr->get_data_ptr());
+    size_t have= THEROBOT->get_raster_size();
+    if(have >= raster_max_pixels) return;
+
+    // several M650 can be sent to build up a row that is longer than a line
+    size_t max= raster_max_pixels - have;
+    uint8_t *buf= new uint8_t[max];
+    int n= base64_decode(str->c_str(), buf, max);
+    if(n > 0) {
+        THEROBOT->add_raster_data(buf, n);
+        pdr->set_taken();
+    }
+    delete [] buf;
+}
 
 void Laser::on_gcode_received(void *argument)
 {
@@ -182,10 +222,9 @@ void Laser::on_gcode_received(void *argument)
     }
 }
 
-// calculates the current speed ratio from the currently executing block
-float Laser::current_speed_ratio(const Block *block) const
+// find the primary moving actuator (the one with the most steps)
+size_t Laser::primary_motor(const Block *block) const
 {
-    // find the primary moving actuator (the one with the most steps)
     size_t pm= 0;
     uint32_t max_steps= 0;
     for (size_t i = 0; i < THEROBOT->get_number_registered_motors(); i++) {
@@ -195,7 +234,12 @@ float Laser::current_speed_ratio(const Block *block) const
             pm= i;
         }
     }
+    return pm;
+}
 
+// calculates the current speed ratio from the currently executing block
+float Laser::current_speed_ratio(const Block *block, size_t pm) const
+{
     // figure out the ratio of its speed, from 0 to 1 based on where it is on the trapezoid,
     // this is based on the fraction it is of the requested rate (nominal rate)
     float ratio= block->get_trapezoid_rate(pm) / block->nominal_rate;
@@ -203,16 +247,36 @@ float Laser::current_speed_ratio(const Block *block) const
     return ratio;
 }
 
-// get laser power for the currently executing block, returns false if nothing running or a G0
-bool Laser::get_laser_power(float& power) const
+// gets the raster intensity (0 to 1) for the current position in the block, and the number of steps until the next pixel
+float Laser::current_raster_value(const Block *block, size_t pm, uint32_t& next_steps) const
 {
-    const Block *block = StepTicker::getInstance()->get_current_block();
+    // pixels are spread evenly over the steps of the primary actuator
+    uint32_t total= block->steps[pm];
+    uint32_t count= block->tick_info[pm].step_count;
+    uint32_t i= ((uint64_t)count * block->raster_size) / total;
+    if(i >= block->raster_size) i= block->raster_size - 1;
+
+    // first step of the next pixel
+    uint32_t next= ((uint64_t)(i + 1) * total + block->raster_size - 1) / block->raster_size;
+    next_steps= (next > count) ? next - count : 0;
 
+    return block->raster_data[i] / 255.0F;
+}
+
+// get laser power for the given executing block, returns false if nothing running or a G0
+// next_steps is set to the number of primary steps until the power needs updating for raster blocks
+bool Laser::get_laser_power(const Block *block, float& power, uint32_t& next_steps) const
+{
     // Note to avoid a race condition where the block is being cleared we check the is_ready flag which gets cleared first,
     // as this is an interrupt if that flag is not clear then it cannot be cleared while this is running and the block will still be valid (albeit it may have finished)
     if(block != nullptr && block->is_ready && block->is_g123) {
         float requested_power = ((float)block->s_value/(1<<11)) / this->laser_maximum_s_value; // s_value is 1.11 Fixed point
-        float ratio = current_speed_ratio(block);
+        size_t pm= primary_motor(block);
+        float ratio = current_speed_ratio(block, pm);
+        if(block->raster_size > 0) {
+            // for a raster line the S value is the power of a full intensity pixel
+            requested_power *= current_raster_value(block, pm, next_steps);
+        }
         power = requested_power * ratio * scale;
 
         return true;
@@ -223,11 +287,19 @@ bool Laser::get_laser_power(float& power) const
 
 // called every millisecond from timer ISR
 uint32_t Laser::set_proportional_power(uint32_t dummy)
+{
+    update_proportional_power(StepTicker::getInstance()->get_current_block());
+    return 0;
+}
+
+// also called directly from the step ticker ISR when laser_module_step_sync is set, block is nullptr when motion has stopped
+uint32_t Laser::update_proportional_power(const Block *block)
 {
     if(manual_fire) return 0;
 
     float power;
-    if(get_laser_power(power)) {
+    uint32_t next_steps= 0;
+    if(get_laser_power(block, power, next_steps)) {
         // adjust power to maximum power and actual velocity
         float proportional_power = ( (this->laser_maximum_power - this->laser_minimum_power) * power ) + this->laser_minimum_power;
         set_laser_power(proportional_power);
@@ -236,7 +308,7 @@ uint32_t Laser::set_proportional_power(uint32_t dummy)
         // turn laser off
         set_laser_power(0);
     }
-    return 0;
+    return next_steps;
 }
 
 bool Laser::set_laser_power(float power)
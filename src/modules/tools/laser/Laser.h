@@ -26,6 +26,7 @@ class Laser : public Module{
         void on_gcode_received(void *argument);
         void on_console_line_received(void *argument);
         void on_get_public_data(void* argument);
+        void on_set_public_data(void* argument);
 
         void set_scale(float s) { scale= s/100; }
         float get_scale() const { return scale*100; }
@@ -34,8 +35,11 @@ class Laser : public Module{
 
     private:
         uint32_t set_proportional_power(uint32_t dummy);
-        bool get_laser_power(float& power) const;
-        float current_speed_ratio(const Block *block) const;
+        uint32_t update_proportional_power(const Block *block);
+        bool get_laser_power(const Block *block, float& power, uint32_t& next_steps) const;
+        size_t primary_motor(const Block *block) const;
+        float current_speed_ratio(const Block *block, size_t pm) const;
+        float current_raster_value(const Block *block, size_t pm, uint32_t& next_steps) const;
 
         mbed::PwmOut *pwm_pin;    // PWM output to regulate the laser power
         Pin *ttl_pin;				// TTL output to fire laser
@@ -43,11 +47,13 @@ class Laser : public Module{
         float laser_minimum_power; // value used to tickle the laser on moves.  Also minimum value for auto-scaling
         float laser_maximum_s_value; // Value of S code that will represent max power
         float scale;
+        uint16_t raster_max_pixels; // maximum size of a raster row sent with M650
         struct {
             bool laser_on:1;      // set if the laser is on
             bool pwm_inverting:1; // stores whether the PWM period should be inverted
             bool ttl_used:1;		// stores whether we have a TTL output
             bool ttl_inverting:1;   // stores whether the TTL output should be inverted
             bool manual_fire:1;     // set when manually firing
+            bool step_sync:1;       // set when power is updated from the step ticker rather than the slow ticker
         };
 };
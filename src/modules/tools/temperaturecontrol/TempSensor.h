@@ -20,8 +20,12 @@ public:
     virtual void UpdateConfig(uint16_t module_checksum, uint16_t name_checksum) {}
 
     // Return temperature in degrees Celsius.
+    // This is called from the SlowTicker interrupt so sensors that are slow to read do the reading in on_idle()
     virtual float get_temperature() { return -1.0F; }
 
+    // Called on each ON_IDLE
+    virtual void on_idle() {}
+
     typedef std::map<char, float> sensor_options_t;
     virtual bool set_optional(const sensor_options_t& options) { return false; }
     virtual bool get_optional(sensor_options_t& options) { return false; }
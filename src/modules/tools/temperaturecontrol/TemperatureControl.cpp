@@ -41,6 +41,7 @@
 #define readings_per_second_checksum       CHECKSUM("readings_per_second")
 #define max_pwm_checksum                   CHECKSUM("max_pwm")
 #define pwm_frequency_checksum             CHECKSUM("pwm_frequency")
+#define hardware_pwm_checksum              CHECKSUM("hardware_pwm")
 #define bang_bang_checksum                 CHECKSUM("bang_bang")
 #define hysteresis_checksum                CHECKSUM("hysteresis")
 #define heater_pin_checksum                CHECKSUM("heater_pin")
@@ -97,6 +98,7 @@ void TemperatureControl::on_module_loaded()
     // Register for events
     this->register_for_event(ON_GCODE_RECEIVED);
     this->register_for_event(ON_GET_PUBLIC_DATA);
+    this->register_for_event(ON_IDLE);
 
     if(!this->readonly) {
         this->register_for_event(ON_SECOND_TICK);
@@ -126,6 +128,11 @@ void TemperatureControl::on_main_loop(void *argument)
     }
 }
 
+void TemperatureControl::on_idle(void *argument)
+{
+    sensor->on_idle();
+}
+
 // Get configuration from the config file
 void TemperatureControl::load_config()
 {
@@ -201,8 +208,13 @@ void TemperatureControl::load_config()
         this->heater_pin.max_pwm( THEKERNEL->config->value(temperature_control_checksum, this->name_checksum, max_pwm_checksum)->by_default(255)->as_number() );
         this->heater_pin.set(0);
         set_low_on_debug(heater_pin.port_number, heater_pin.pin);
-        // activate SD-DAC timer
-        THEKERNEL->slow_ticker->attach( THEKERNEL->config->value(temperature_control_checksum, this->name_checksum, pwm_frequency_checksum)->by_default(2000)->as_number(), &heater_pin, &Pwm::on_tick);
+        // use the PWM peripheral if asked to and the pin has a free channel, it runs at the period any hwpwm switch sets, 20ms by default
+        bool hardware= THEKERNEL->config->value(temperature_control_checksum, this->name_checksum, hardware_pwm_checksum)->by_default(false)->as_bool();
+        if(!hardware || !this->heater_pin.use_hardware()) {
+            if(hardware) THEKERNEL->streams->printf("Warning: %s heater pin has no free hardware PWM channel, using sigma-delta\n", this->designator.c_str());
+            // activate SD-DAC timer
+            this->heater_pin.attach( THEKERNEL->config->value(temperature_control_checksum, this->name_checksum, pwm_frequency_checksum)->by_default(2000)->as_number() );
+        }
     }
 
 
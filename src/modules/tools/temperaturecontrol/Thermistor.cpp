@@ -20,6 +20,7 @@
 #include "predefined_thermistors.h"
 
 #include <fastmath.h>
+#include "cmsis.h"
 
 #include "MRI_Hooks.h"
 
@@ -47,10 +48,15 @@ Thermistor::Thermistor()
     min_temp= 999;
     max_temp= 0;
     this->thermistor_number= 0; // not a predefined thermistor
+    this->table= nullptr;
+    this->table_size= 0;
+    this->table_half= 0;
+    this->open_adc= 0;
 }
 
 Thermistor::~Thermistor()
 {
+    delete [] table;
 }
 
 // Get configuration from the config file
@@ -180,6 +186,7 @@ void Thermistor::UpdateConfig(uint16_t module_checksum, uint16_t name_checksum)
         return;
     }
 
+    build_table();
 }
 
 // print out predefined thermistors
@@ -251,11 +258,9 @@ void Thermistor::get_raw()
     }
 
     int adc_value= new_thermistor_reading();
-    const uint32_t max_adc_value= THEKERNEL->adc->get_max_value();
 
      // resistance of the thermistor in ohms
-    float r = r2 / (((float)max_adc_value / adc_value) - 1.0F);
-    if (r1 > 0.0F) r = (r1 * r) / (r1 - r);
+    float r = adc_value_to_resistance(adc_value);
 
     THEKERNEL->streams->printf("adc= %d, resistance= %f\n", adc_value, r);
 
@@ -280,17 +285,19 @@ void Thermistor::get_raw()
     min_temp= max_temp= t;
 }
 
-float Thermistor::adc_value_to_temperature(uint32_t adc_value)
+// resistance of the thermistor in ohms
+float Thermistor::adc_value_to_resistance(uint32_t adc_value)
 {
     const uint32_t max_adc_value= THEKERNEL->adc->get_max_value();
-    if ((adc_value >= max_adc_value) || (adc_value == 0))
-        return infinityf();
-
-    // resistance of the thermistor in ohms
     float r = r2 / (((float)max_adc_value / adc_value) - 1.0F);
     if (r1 > 0.0F) r = (r1 * r) / (r1 - r);
+    return r;
+}
 
-    if(r > this->r0 * 8) return infinityf(); // 800k is probably open circuit
+// the beta or Steinhart-Hart equation, too slow to run for every reading in the ticker so it is only used to build the table
+float Thermistor::calculate_temperature(uint32_t adc_value)
+{
+    float r = adc_value_to_resistance(adc_value);
 
     float t;
     if(this->use_steinhart_hart) {
@@ -304,6 +311,80 @@ float Thermistor::adc_value_to_temperature(uint32_t adc_value)
     return t;
 }
 
+// Each half of the table has an entry for every adc value up to 16, then 8 for each doubling of the adc value,
+// the low half counts up from 0 and the high half down from the max adc value, so the entries are closest where the
+// curve bends most and linear interpolation between them is within a fraction of a degree
+static inline int table_index(uint32_t a)
+{
+    if(a < 8) return a;
+    int k= 28 - __builtin_clz(a); // entries are 1<<k apart from 8<<k up
+    return k * 8 + (a >> k);
+}
+
+static inline uint32_t table_adc(int i)
+{
+    if(i < 16) return i;
+    int k= i / 8 - 1;
+    return (i - k * 8) << k;
+}
+
+void Thermistor::build_table()
+{
+    if(bad_config) return;
+
+    const uint32_t max_adc_value= THEKERNEL->adc->get_max_value();
+    uint16_t half= max_adc_value / 2;
+    uint8_t n= table_index(half) + 2; // so every adc value in a half has an entry above it
+
+    int16_t *t= new int16_t[n * 2];
+    for (int i = 0; i < n; ++i) {
+        float lo= calculate_temperature(table_adc(i));
+        float hi= calculate_temperature(max_adc_value - table_adc(i));
+        // the entries at either end are only there to interpolate towards and get clamped
+        t[i]=     isnan(lo) ? -273 * 16 : roundf(confine(lo, -2047.0F, 2047.0F) * 16);
+        t[n + i]= isnan(hi) ? -273 * 16 : roundf(confine(hi, -2047.0F, 2047.0F) * 16);
+    }
+
+    // the first adc value that is open circuit, 800k is probably open circuit and so is past the parallel resistor r1
+    uint32_t lo= 1, hi= max_adc_value;
+    while(lo < hi) {
+        uint32_t mid= (lo + hi) / 2;
+        float r= adc_value_to_resistance(mid);
+        if(r >= 0 && r <= this->r0 * 8) lo= mid + 1;
+        else hi= mid;
+    }
+
+    // the ticker may be reading it so swap the new one in
+    __disable_irq();
+    int16_t *old= table;
+    table= t;
+    table_size= n;
+    table_half= half;
+    open_adc= lo;
+    __enable_irq();
+    delete [] old;
+}
+
+float Thermistor::adc_value_to_temperature(uint32_t adc_value)
+{
+    if ((adc_value >= open_adc) || (adc_value == 0) || table == nullptr)
+        return infinityf();
+
+    // interpolate between the entries either side of the adc value
+    const int16_t *t= table;
+    uint32_t a= adc_value;
+    if(adc_value > table_half) {
+        t += table_size;
+        a= THEKERNEL->adc->get_max_value() - adc_value;
+    }
+    int i= table_index(a);
+    int a0= table_adc(i);
+    int a1= table_adc(i + 1);
+    int v= t[i] + (t[i + 1] - t[i]) * ((int)a - a0) / (a1 - a0);
+
+    return v * (1.0F / 16);
+}
+
 int Thermistor::new_thermistor_reading()
 {
     // filtering now done in ADC
@@ -352,6 +433,7 @@ bool Thermistor::set_optional(const sensor_options_t& options) {
             calc_jk();
             thermistor_number= predefined;
             this->bad_config= false;
+            build_table();
             return true;
 
         }else {
@@ -370,6 +452,7 @@ bool Thermistor::set_optional(const sensor_options_t& options) {
             use_steinhart_hart= true;
             thermistor_number= predefined;
             this->bad_config= false;
+            build_table();
             return true;
         }
     }
@@ -396,6 +479,7 @@ bool Thermistor::set_optional(const sensor_options_t& options) {
     }
 
     if(this->bad_config) this->bad_config= false;
+    build_table();
 
     return true;
 }
@@ -36,6 +36,9 @@ class Thermistor : public TempSensor
     private:
         int new_thermistor_reading();
         float adc_value_to_temperature(uint32_t adc_value);
+        float adc_value_to_resistance(uint32_t adc_value);
+        float calculate_temperature(uint32_t adc_value);
+        void build_table();
         void calc_jk();
 
         // Thermistor computation settings using beta, not used if using Steinhart-Hart
@@ -62,6 +65,13 @@ class Thermistor : public TempSensor
 
         Pin  thermistor_pin;
 
+        // temperatures in 1/16°C at adc values that are closer together near the ends of the range where the curve bends most
+        // the first half is for adc values up to table_half, the second half for max adc - adc above that
+        int16_t *table;
+        uint32_t open_adc; // adc values from here up are an open circuit
+        uint16_t table_half;
+        uint8_t table_size; // entries in each half
+
         float min_temp, max_temp;
         struct {
             bool bad_config:1;
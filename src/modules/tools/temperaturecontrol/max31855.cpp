@@ -18,10 +18,15 @@
 
 #define chip_select_checksum CHECKSUM("chip_select_pin")
 #define spi_channel_checksum CHECKSUM("spi_channel")
+#define read_timeout_checksum CHECKSUM("read_timeout")
 
 Max31855::Max31855() :
     spi(nullptr)
 {
+    average= infinityf();
+    read_pending= false;
+    last_good_read= 0;
+    read_timeout= 5000000;
 }
 
 Max31855::~Max31855()
@@ -55,11 +60,33 @@ void Max31855::UpdateConfig(uint16_t module_checksum, uint16_t name_checksum)
 
     // Spi settings: 1MHz (default), 16 bits, mode 0 (default)
     spi->format(16);
+
+    // seconds without a good reading before the heater is tripped, long enough to ride out the main loop
+    // being held up by a long command or an SD card write
+    this->read_timeout = THEKERNEL->config->value(module_checksum, name_checksum, read_timeout_checksum)->by_default(5.0F)->as_number() * 1000000;
+    this->last_good_read = us_ticker_read();
 }
 
+// This is called in the SlowTicker interrupt, the SPI transfer is too slow to do there
+// so it asks for a reading to be done in on_idle() and returns the latest average
+// if there has not been a good reading for read_timeout, because on_idle() has not run or the thermocouple
+// keeps reporting errors, the average is stale, so it reports a bad reading which trips the heater
 float Max31855::get_temperature()
 {
-	// Return an average of the last readings
+    read_pending= true;
+
+    if(us_ticker_read() - last_good_read > read_timeout) return infinityf();
+    return average;
+}
+
+// reads the thermocouple when get_temperature() has asked for it and publishes the new average,
+// the float is written in one store so the interrupt never sees part of it
+void Max31855::on_idle()
+{
+    if(!read_pending) return;
+    read_pending= false;
+
+	// Keep the last readings to average
     if (readings.size() >= readings.capacity()) {
         readings.delete_tail();
     }
@@ -70,16 +97,20 @@ float Max31855::get_temperature()
 	if(!isinf(temp))
 	{
 		readings.push_back(temp);
+		last_good_read= us_ticker_read();
 	}
 
-	if(readings.size()==0) return infinityf();
+	if(readings.size()==0) {
+        average= infinityf();
+        return;
+    }
 
 	float sum = 0;
     for (int i=0; i<readings.size(); i++) {
         sum += *readings.get_ref(i);
     }
 
-	return sum / readings.size();
+	average= sum / readings.size();
 }
 
 float Max31855::read_temp()
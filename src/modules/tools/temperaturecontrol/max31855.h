@@ -21,12 +21,21 @@ public:
     ~Max31855();
     void UpdateConfig(uint16_t module_checksum, uint16_t name_checksum);
     float get_temperature();
+    void on_idle();
 
 private:
 	float read_temp();
     Pin spi_cs_pin;
     mbed::SPI *spi;
     RingBuffer<float,16> readings;
+    // the average of the readings, set in on_idle() and returned by get_temperature()
+    volatile float average;
+    // set by get_temperature() to ask for a new reading
+    volatile bool read_pending;
+    // us_ticker time of the last reading that was not an error, written in on_idle()
+    volatile uint32_t last_good_read;
+    // how long without a good reading before get_temperature() reports a bad one, in microseconds
+    uint32_t read_timeout;
 };
 
 #endif
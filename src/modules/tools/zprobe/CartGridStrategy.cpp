@@ -53,6 +53,16 @@
     Display mode of current grid can be changed to human redable mode (table with coordinates) by using
        leveling-strategy.rectangular-grid.human_readable  true
 
+    The grid is interpolated bilinearly between the 4 nearest points, a smooth bicubic surface through the points can be used instead with...
+       leveling-strategy.rectangular-grid.bicubic  true
+
+    Rather than setting mm_per_line_segment so moves follow the grid, moves can be split where they cross a grid line with...
+       leveling-strategy.rectangular-grid.split_at_cells  true
+      mm_per_line_segment must be 0 for this to be used. Inside a cell the surface is not linear along a diagonal move, with bilinear
+      it can be up to a quarter of the cell's twist away (one pair of opposite corners minus the other), so a piece is split again
+      until it is within this many mm of the surface, 0 only splits at the grid lines...
+       leveling-strategy.rectangular-grid.split_tolerance  0.01
+
     Usage
     -----
     G29 test probes a rectangle which defaults to the width and height, can be overidden with Xnnn and Ynnn
@@ -61,9 +71,10 @@
         optional parameters {{Xn}} {{Yn}} sets the size for this rectangular probe, which gets saved with M375
 
     M370 clears the grid and turns off compensation
-    M374 Save grid to /sd/cartesian.grid
-    M374.1 delete /sd/cartesian.grid
-    M375 Load the grid from /sd/cartesian.grid and enable compensation
+    M374 Save grid to /sd/cartesian.mesh, or with a name as M374 name to /sd/cartesian-name.mesh
+    M374.1 delete /sd/cartesian.mesh, or M374.1 name to delete a named one
+    M375 Load the grid from /sd/cartesian.mesh and enable compensation, M375 name loads a named one so build plates can be switched
+           if there is no /sd/cartesian.mesh the /sd/cartesian.grid or /sd/cartesian_nm.grid saved by older firmware is loaded
     M375.1 display the current grid
     M561 clears the grid and turns off compensation
     M565 defines the probe offsets from the nozzle or tool head
@@ -103,14 +114,16 @@
 #define save_checksum                CHECKSUM("save")
 #define probe_offsets_checksum       CHECKSUM("probe_offsets")
 #define initial_height_checksum      CHECKSUM("initial_height")
+#define bicubic_checksum             CHECKSUM("bicubic")
+#define split_at_cells_checksum      CHECKSUM("split_at_cells")
+#define split_tolerance_checksum     CHECKSUM("split_tolerance")
 #define x_size_checksum              CHECKSUM("x_size")
 #define y_size_checksum              CHECKSUM("y_size")
 #define do_home_checksum             CHECKSUM("do_home")
 #define only_by_two_corners_checksum CHECKSUM("only_by_two_corners")
 #define human_readable_checksum      CHECKSUM("human_readable")
 
-#define GRIDFILE "/sd/cartesian.grid"
-#define GRIDFILE_NM "/sd/cartesian_nm.grid"
+#define MESHFILE "cartesian"
 
 CartGridStrategy::CartGridStrategy(ZProbe *zprobe) : LevelingStrategy(zprobe)
 {
@@ -133,6 +146,9 @@ bool CartGridStrategy::handleConfig()
     do_home = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, do_home_checksum)->by_default(true)->as_bool();
     only_by_two_corners = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, only_by_two_corners_checksum)->by_default(false)->as_bool();
     human_readable = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, human_readable_checksum)->by_default(false)->as_bool();
+    split_at_cells = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, split_at_cells_checksum)->by_default(false)->as_bool();
+    bicubic = THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, bicubic_checksum)->by_default(false)->as_bool();
+    mesh.set_tolerance(THEKERNEL->config->value(leveling_strategy_checksum, cart_grid_leveling_strategy_checksum, split_tolerance_checksum)->by_default(0.01F)->as_number());
 
     this->x_start = 0.0F;
     this->y_start = 0.0F;
@@ -163,155 +179,46 @@ bool CartGridStrategy::handleConfig()
         THEKERNEL->streams->printf("Error: Not enough memory\n");
         return false;
     }
+    GridMesh::reserve(configured_grid_x_size * configured_grid_y_size, bicubic);
 
     reset_bed_level();
 
     return true;
 }
 
-void CartGridStrategy::save_grid(StreamOutput *stream)
+void CartGridStrategy::save_grid(StreamOutput *stream, const std::string& name)
 {
-    if(only_by_two_corners){
-        stream->printf("error:Unable to save grid in only_by_two_corners mode\n");
-        return;
-    }
-
     if(isnan(grid[0])) {
         stream->printf("error:No grid to save\n");
         return;
     }
 
-    if((current_grid_x_size != configured_grid_x_size) || (current_grid_y_size != configured_grid_y_size)) {
-        stream->printf("error:Unable to save grid with size different from configured\n");
-        return;
-    }
-
-    FILE *fp = (configured_grid_x_size == configured_grid_y_size)?fopen(GRIDFILE, "w"):fopen(GRIDFILE_NM, "w");
-    if(fp == NULL) {
-        stream->printf("error:Failed to open grid file %s\n", GRIDFILE);
-        return;
-    }
-    uint8_t tmp_configured_grid_size = configured_grid_x_size;
-    if(fwrite(&tmp_configured_grid_size, sizeof(uint8_t), 1, fp) != 1) {
-        stream->printf("error:Failed to write grid x size\n");
-        fclose(fp);
-        return;
-    }
-
-    tmp_configured_grid_size = configured_grid_y_size;
-    if(configured_grid_y_size != configured_grid_x_size){
-        if(fwrite(&tmp_configured_grid_size, sizeof(uint8_t), 1, fp) != 1) {
-            stream->printf("error:Failed to write grid y size\n");
-            fclose(fp);
-            return;
-        }
-    }
-
-    if(fwrite(&x_size, sizeof(float), 1, fp) != 1)  {
-        stream->printf("error:Failed to write x_size\n");
-        fclose(fp);
-        return;
-    }
-
-    if(fwrite(&y_size, sizeof(float), 1, fp) != 1)  {
-        stream->printf("error:Failed to write y_size\n");
-        fclose(fp);
-        return;
-    }
-
-    int cnt= 0;
-    for (int y = 0; y < configured_grid_y_size; y++) {
-        for (int x = 0; x < configured_grid_x_size; x++) {
-            if(fwrite(&grid[x + (configured_grid_x_size * y)], sizeof(float), 1, fp) != 1) {
-                stream->printf("error:Failed to write grid\n");
-                fclose(fp);
-                return;
-            }
-            cnt += 4;
-            if ((cnt % 400) == 0) {
-                // HACK ALERT to get around fwrite corruption close and re open for append
-                fclose(fp);
-                fp = fopen(GRIDFILE, "a");
-            }
-        }
+    float geometry[4] = {x_start, y_start, x_size, y_size};
+    if(GridMesh::save_file(GridMesh::filename(MESHFILE, name), grid, current_grid_x_size, current_grid_y_size, geometry, stream)) {
+        mesh_name = name;
     }
-    stream->printf("grid saved to %s\n", GRIDFILE);
-    fclose(fp);
 }
 
-bool CartGridStrategy::load_grid(StreamOutput *stream)
+bool CartGridStrategy::load_grid(StreamOutput *stream, const std::string& name)
 {
-    if(only_by_two_corners){
-        stream->printf("error:Unable to load grid in only_by_two_corners mode\n");
-        return false;
-    }
-
-    FILE *fp = (configured_grid_x_size == configured_grid_y_size)?fopen(GRIDFILE, "r"):fopen(GRIDFILE_NM, "r");
-    if(fp == NULL) {
-        stream->printf("error:Failed to open grid %s\n", GRIDFILE);
-        return false;
-    }
-
-    uint8_t load_grid_x_size, load_grid_y_size;
-    float x, y;
-
-    if(fread(&load_grid_x_size, sizeof(uint8_t), 1, fp) != 1) {
-        stream->printf("error:Failed to read grid size\n");
-        fclose(fp);
-        return false;
-    }
-
-    if(load_grid_x_size != configured_grid_x_size) {
-        stream->printf("error:grid size x is different read %d - config %d\n", load_grid_x_size, configured_grid_x_size);
-        fclose(fp);
+    // any size up to the configured one can be loaded
+    int nx = 0, ny = 0;
+    float geometry[4];
+    GridMesh::LEGACY legacy = (configured_grid_x_size == configured_grid_y_size) ? GridMesh::CARTESIAN : GridMesh::CARTESIAN_NM;
+    std::string fn = GridMesh::load_filename(MESHFILE, name, legacy);
+    if(!GridMesh::load_file(fn, grid, configured_grid_x_size * configured_grid_y_size, nx, ny, geometry, legacy, stream)) {
         return false;
     }
 
-    load_grid_y_size = load_grid_x_size;
-
-    if(configured_grid_x_size != configured_grid_y_size){
-        if(fread(&load_grid_y_size, sizeof(uint8_t), 1, fp) != 1) {
-            stream->printf("error:Failed to read grid size\n");
-            fclose(fp);
-            return false;
-        }
-
-        if(load_grid_y_size != configured_grid_y_size) {
-            stream->printf("error:grid size y is different read %d - config %d\n", load_grid_y_size, configured_grid_x_size);
-            fclose(fp);
-            return false;
-        }
-    }
-
-    if(fread(&x, sizeof(float), 1, fp) != 1) {
-        stream->printf("error:Failed to read grid x size\n");
-        fclose(fp);
-        return false;
-    }
-
-    if(fread(&y, sizeof(float), 1, fp) != 1) {
-        stream->printf("error:Failed to read grid y size\n");
-        fclose(fp);
-        return false;
-    }
-
-    if(x != x_size || y != y_size) {
-        stream->printf("error:bed dimensions changed read (%f, %f) - config (%f,%f)\n", x, y, x_size, y_size);
-        fclose(fp);
-        return false;
-    }
-
-    for (int y = 0; y < configured_grid_y_size; y++) {
-        for (int x = 0; x < configured_grid_x_size; x++) {
-            if(fread(&grid[x + (configured_grid_x_size * y)], sizeof(float), 1, fp) != 1) {
-                stream->printf("error:Failed to read grid\n");
-                fclose(fp);
-                return false;
-            }
-        }
-    }
-    stream->printf("grid loaded, grid: (%f, %f), size: %d x %d\n", x_size, y_size, load_grid_x_size, load_grid_y_size);
-    fclose(fp);
+    // the grid is used where it was probed, which may not be the configured rectangle
+    current_grid_x_size = nx;
+    current_grid_y_size = ny;
+    x_start = geometry[0];
+    y_start = geometry[1];
+    x_size = geometry[2];
+    y_size = geometry[3];
+    mesh_name = name;
+    stream->printf("grid loaded, grid: (%f, %f), size: %d x %d\n", x_size, y_size, nx, ny);
     return true;
 }
 
@@ -327,14 +234,22 @@ bool CartGridStrategy::probe_grid(int n, int m, float _x_start, float _y_start,
 
     float x_step = _x_size / n;
     float y_step = _y_size / m;
+    std::vector<std::pair<float, float>> points;
+    points.reserve(n * m);
     for (int c = 0; c < m; ++c) {
         float y = _y_start + y_step * c;
         for (int r = 0; r < n; ++r) {
             float x = _x_start + x_step * r;
-            float z = 0.0F;
-            float mm;
-            if(!zprobe->doProbeAt(mm, x, y)) return false;
-            z = zprobe->getProbeHeight() - mm;
+            points.push_back(std::make_pair(x, y));
+        }
+    }
+
+    std::vector<float> mm(points.size());
+    if(!zprobe->probe_points(points, mm.data(), stream)) return false;
+
+    for (int c = 0; c < m; ++c) {
+        for (int r = 0; r < n; ++r) {
+            float z = zprobe->getProbeHeight() - mm[r + n * c];
             stream->printf("%1.4f ", z);
         }
         stream->printf("\n");
@@ -395,11 +310,14 @@ bool CartGridStrategy::handleGcode(Gcode *gcode)
             return true;
 
         } else if(gcode->m == 374) { // M374: Save grid, M374.1: delete saved grid
+            std::string args = get_arguments(gcode->get_command());
+            std::string name = shift_parameter(args);
             if(gcode->subcode == 1) {
-                remove(GRIDFILE);
-                gcode->stream->printf("%s deleted\n", GRIDFILE);
+                std::string fn = GridMesh::filename(MESHFILE, name);
+                remove(fn.c_str());
+                gcode->stream->printf("%s deleted\n", fn.c_str());
             } else {
-                save_grid(gcode->stream);
+                save_grid(gcode->stream, name);
             }
 
             return true;
@@ -408,7 +326,8 @@ bool CartGridStrategy::handleGcode(Gcode *gcode)
             if(gcode->subcode == 1) {
                 print_bed_level(gcode->stream);
             } else {
-                if(load_grid(gcode->stream)) setAdjustFunction(true);
+                std::string args = get_arguments(gcode->get_command());
+                if(load_grid(gcode->stream, shift_parameter(args))) setAdjustFunction(true);
             }
             return true;
 
@@ -425,7 +344,7 @@ bool CartGridStrategy::handleGcode(Gcode *gcode)
             std::tie(x, y, z) = probe_offsets;
             gcode->stream->printf(";Probe offsets:\nM565 X%1.5f Y%1.5f Z%1.5f\n", x, y, z);
             if(save) {
-                if(!isnan(grid[0])) gcode->stream->printf(";Load saved grid\nM375\n");
+                if(!isnan(grid[0])) gcode->stream->printf(";Load saved grid\nM375%s%s\n", mesh_name.empty() ? "" : " ", mesh_name.c_str());
                 else if(gcode->m == 503) gcode->stream->printf(";WARNING No grid to save\n");
             }
             return true;
@@ -442,13 +361,30 @@ bool CartGridStrategy::handleGcode(Gcode *gcode)
 void CartGridStrategy::setAdjustFunction(bool on)
 {
     if(on) {
+        // the coefficients only take AHB0 once compensation is used, which is after the planner queue and SD cache have theirs
+        if(!mesh.is_allocated()) {
+            if(!mesh.allocate(configured_grid_x_size * configured_grid_y_size, bicubic)) {
+                THEKERNEL->streams->printf("Error: Not enough memory for the grid compensation\n");
+                setAdjustFunction(false);
+                return;
+            }
+            if(bicubic && !mesh.is_bicubic()) THEKERNEL->streams->printf("Warning: Not enough memory for bicubic, using bilinear\n");
+        }
+        // the coefficients for each cell are worked out once here rather than on every move
+        float dx = this->x_size / (this->current_grid_x_size - 1);
+        float dy = this->y_size / (this->current_grid_y_size - 1);
+        mesh.build(grid, current_grid_x_size, current_grid_y_size, x_start, y_start, dx, dy);
         // set the compensationTransform in robot
-        using std::placeholders::_1;
-        using std::placeholders::_2;
-        THEROBOT->compensationTransform = std::bind(&CartGridStrategy::doCompensation, this, _1, _2); // [this](float *target, bool inverse) { doCompensation(target, inverse); };
+        THEROBOT->compensationTransform = [this](float *target, bool inverse) { doCompensation(target, inverse); };
+        if(split_at_cells) {
+            THEROBOT->compensationSplits = [this](const float *from, const float *to, float *t, int max) { return mesh.crossings(from, to, t, max); };
+        } else {
+            THEROBOT->compensationSplits = nullptr;
+        }
     } else {
         // clear it
         THEROBOT->compensationTransform = nullptr;
+        THEROBOT->compensationSplits = nullptr;
     }
 }
 
@@ -516,28 +452,25 @@ bool CartGridStrategy::doProbe(Gcode *gc)
     float z_reference = zprobe->getProbeHeight() - mm; // this should be zero
     gc->stream->printf("probe at 0,0 is %f mm\n", z_reference);
 
-    // probe all the points of the grid
+    // probe all the points of the grid, the points are in the same order as the grid
+    int n = this->current_grid_x_size * this->current_grid_y_size;
+    std::vector<std::pair<float, float>> points;
+    points.reserve(n);
     for (int yCount = 0; yCount < this->current_grid_y_size; yCount++) {
         float yProbe = this->y_start + (this->y_size / (this->current_grid_y_size - 1)) * yCount;
-        int xStart, xStop, xInc;
-        if (yCount % 2) {
-            xStart = this->current_grid_x_size - 1;
-            xStop = -1;
-            xInc = -1;
-        } else {
-            xStart = 0;
-            xStop = this->current_grid_x_size;
-            xInc = 1;
+        for (int xCount = 0; xCount < this->current_grid_x_size; xCount++) {
+            float xProbe = this->x_start + (this->x_size / (this->current_grid_x_size - 1)) * xCount;
+            points.push_back(std::make_pair(xProbe - X_PROBE_OFFSET_FROM_EXTRUDER, yProbe - Y_PROBE_OFFSET_FROM_EXTRUDER));
         }
+    }
 
-        for (int xCount = xStart; xCount != xStop; xCount += xInc) {
-            float xProbe = this->x_start + (this->x_size / (this->current_grid_x_size - 1)) * xCount;
+    std::vector<float> probed(n);
+    if(!zprobe->probe_points(points, probed.data(), gc->stream)) return false;
 
-            if(!zprobe->doProbeAt(mm, xProbe - X_PROBE_OFFSET_FROM_EXTRUDER, yProbe - Y_PROBE_OFFSET_FROM_EXTRUDER)) return false;
-            float measured_z = zprobe->getProbeHeight() - mm - z_reference; // this is the delta z from bed at 0,0
-            gc->stream->printf("DEBUG: X%1.4f, Y%1.4f, Z%1.4f\n", xProbe, yProbe, measured_z);
-            grid[xCount + (this->current_grid_x_size * yCount)] = measured_z;
-        }
+    for (int i = 0; i < n; i++) {
+        float measured_z = zprobe->getProbeHeight() - probed[i] - z_reference; // this is the delta z from bed at 0,0
+        gc->stream->printf("DEBUG: X%1.4f, Y%1.4f, Z%1.4f\n", points[i].first + X_PROBE_OFFSET_FROM_EXTRUDER, points[i].second + Y_PROBE_OFFSET_FROM_EXTRUDER, measured_z);
+        grid[i] = measured_z;
     }
 
     print_bed_level(gc->stream);
@@ -549,47 +482,16 @@ bool CartGridStrategy::doProbe(Gcode *gc)
 
 void CartGridStrategy::doCompensation(float *target, bool inverse)
 {
-    // Adjust print surface height by linear interpolation over the bed_level array.
+    // Adjust print surface height by interpolation over the bed_level array, only inside the probed rectangle
     if ((std::min(this->x_start, this->x_start + this->x_size) <= target[X_AXIS]) && (target[X_AXIS] <= std::max(this->x_start, this->x_start + this->x_size)) &&
         (std::min(this->y_start, this->y_start + this->y_size) <= target[Y_AXIS]) && (target[Y_AXIS] <= std::max(this->y_start, this->y_start + this->y_size))) {
 
-            float grid_x = std::max(0.001F, (target[X_AXIS] - this->x_start) / (this->x_size / (this->current_grid_x_size - 1)));
-            float grid_y = std::max(0.001F, (target[Y_AXIS] - this->y_start) / (this->y_size / (this->current_grid_y_size - 1)));
-            int floor_x = floorf(grid_x);
-            int floor_y = floorf(grid_y);
-            float ratio_x = grid_x - floor_x;
-            float ratio_y = grid_y - floor_y;
-            float z1 = grid[(floor_x) + ((floor_y) * this->current_grid_x_size)];
-            float z2 = grid[(floor_x) + ((floor_y + 1) * this->current_grid_x_size)];
-            float z3 = grid[(floor_x + 1) + ((floor_y) * this->current_grid_x_size)];
-            float z4 = grid[(floor_x + 1) + ((floor_y + 1) * this->current_grid_x_size)];
-            float left = (1 - ratio_y) * z1 + ratio_y * z2;
-            float right = (1 - ratio_y) * z3 + ratio_y * z4;
-            float offset = (1 - ratio_x) * left + ratio_x * right;
-
-            if(inverse)
-                target[Z_AXIS] -= offset;
-            else
-                target[Z_AXIS] += offset;
-
-
-    /*
-        THEKERNEL->streams->printf("//DEBUG: TARGET: %f, %f, %f\n", target[0], target[1], target[2]);
-        THEKERNEL->streams->printf("//DEBUG: grid_x= %f\n", grid_x);
-        THEKERNEL->streams->printf("//DEBUG: grid_y= %f\n", grid_y);
-        THEKERNEL->streams->printf("//DEBUG: floor_x= %d\n", floor_x);
-        THEKERNEL->streams->printf("//DEBUG: floor_y= %d\n", floor_y);
-        THEKERNEL->streams->printf("//DEBUG: ratio_x= %f\n", ratio_x);
-        THEKERNEL->streams->printf("//DEBUG: ratio_y= %f\n", ratio_y);
-        THEKERNEL->streams->printf("//DEBUG: z1= %f\n", z1);
-        THEKERNEL->streams->printf("//DEBUG: z2= %f\n", z2);
-        THEKERNEL->streams->printf("//DEBUG: z3= %f\n", z3);
-        THEKERNEL->streams->printf("//DEBUG: z4= %f\n", z4);
-        THEKERNEL->streams->printf("//DEBUG: left= %f\n", left);
-        THEKERNEL->streams->printf("//DEBUG: right= %f\n", right);
-        THEKERNEL->streams->printf("//DEBUG: offset= %f\n", offset);
-    */
-        }
+        float offset = mesh.get(target[X_AXIS], target[Y_AXIS]);
+        if(inverse)
+            target[Z_AXIS] -= offset;
+        else
+            target[Z_AXIS] += offset;
+    }
 }
 
 
@@ -638,6 +540,7 @@ void CartGridStrategy::print_bed_level(StreamOutput *stream)
 // Reset calibration results to zero.
 void CartGridStrategy::reset_bed_level()
 {
+    mesh_name.clear();
     for (int y = 0; y < current_grid_y_size; y++) {
         for (int x = 0; x < current_grid_x_size; x++) {
             grid[x + (current_grid_x_size * y)] = NAN;
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "LevelingStrategy.h"
+#include "GridMesh.h"
 
 #include <string.h>
+#include <string>
 #include <tuple>
 
 #define cart_grid_leveling_strategy_checksum CHECKSUM("rectangular-grid")
@@ -26,14 +28,16 @@ private:
     void print_bed_level(StreamOutput *stream);
     void doCompensation(float *target, bool inverse);
     void reset_bed_level();
-    void save_grid(StreamOutput *stream);
-    bool load_grid(StreamOutput *stream);
+    void save_grid(StreamOutput *stream, const std::string& name);
+    bool load_grid(StreamOutput *stream, const std::string& name);
     bool probe_grid(int n, int m, float _x_start, float _y_start, float _x_size, float _y_size, StreamOutput *stream);
 
     float initial_height;
     float tolerance;
 
     float *grid;
+    GridMesh mesh;
+    std::string mesh_name; // the saved grid this is, empty for the unnamed one
     std::tuple<float, float, float> probe_offsets;
     float x_start,y_start;
     float x_size,y_size;
@@ -50,5 +54,7 @@ private:
         bool do_home:1;
         bool only_by_two_corners:1;
         bool human_readable:1;
+        bool split_at_cells:1;
+        bool bicubic:1;
     };
 };
@@ -0,0 +1,158 @@
+#include "DeltaCalibrationSolver.h"
+
+#include <math.h>
+
+#define PIOVER180 0.01745329251994329576923690768489
+
+static void tower_positions(const DeltaCalibrationSolver::geometry_t& g, double tx[3], double ty[3])
+{
+    // the same as LinearDeltaSolution::init()
+    static const double base[3] = {210.0, 330.0, 90.0};
+    for (int i = 0; i < 3; ++i) {
+        double r = (double)g.arm_radius + g.tower_offset[i];
+        tx[i] = r * cos((base[i] + g.tower_angle[i]) * PIOVER180);
+        ty[i] = r * sin((base[i] + g.tower_angle[i]) * PIOVER180);
+    }
+}
+
+void DeltaCalibrationSolver::carriage_heights(const geometry_t& g, double x, double y, double z, double h[3])
+{
+    double tx[3], ty[3];
+    tower_positions(g, tx, ty);
+    double l2 = (double)g.arm_length * g.arm_length;
+    for (int i = 0; i < 3; ++i) {
+        h[i] = sqrt(l2 - (tx[i] - x) * (tx[i] - x) - (ty[i] - y) * (ty[i] - y)) + z;
+    }
+}
+
+double DeltaCalibrationSolver::effector_z(const geometry_t& g, const double h[3])
+{
+    // the same circumcenter method as LinearDeltaSolution::actuator_to_cartesian()
+    double tx[3], ty[3];
+    tower_positions(g, tx, ty);
+
+    double s12[3] = {tx[0] - tx[1], ty[0] - ty[1], h[0] - h[1]};
+    double s23[3] = {tx[1] - tx[2], ty[1] - ty[2], h[1] - h[2]};
+    double s13[3] = {tx[0] - tx[2], ty[0] - ty[2], h[0] - h[2]};
+    auto dot = [](const double *a, const double *b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+    double n[3] = {s12[1] * s23[2] - s12[2] * s23[1], s12[2] * s23[0] - s12[0] * s23[2], s12[0] * s23[1] - s12[1] * s23[0]};
+
+    double m12 = dot(s12, s12), m23 = dot(s23, s23), m13 = dot(s13, s13);
+    double inv_nmag_sq = 1.0 / dot(n, n);
+    double q = 0.5 * inv_nmag_sq;
+    double a = q * m23 * dot(s12, s13);
+    double b = -q * m13 * dot(s12, s23);
+    double c = q * m12 * dot(s13, s23);
+
+    double cz = h[0] * a + h[1] * b + h[2] * c;
+    double r_sq = 0.5 * q * m12 * m23 * m13;
+    double dist = sqrt(inv_nmag_sq * ((double)g.arm_length * g.arm_length - r_sq));
+    return cz - n[2] * dist;
+}
+
+void DeltaCalibrationSolver::add_point(float x, float y, float z)
+{
+    double h[3];
+    carriage_heights(current, x, y, z, h);
+    heights.insert(heights.end(), h, h + 3);
+}
+
+float& DeltaCalibrationSolver::parameter(geometry_t& g, int i)
+{
+    switch(i) {
+        case 0: case 1: case 2: return g.trim[i];
+        case 3: return g.arm_radius;
+        case 4: case 5: return g.tower_angle[i - 4]; // the Z tower is the reference for the angles
+        default: return g.arm_length;
+    }
+}
+
+// the effector Z a point would have been at with geometry g
+// homing sets the carriages to the height for the homed position less the trim, so that moves with the geometry too
+double DeltaCalibrationSolver::residual(const geometry_t& g, const double *h) const
+{
+    double home_current[3], home_g[3];
+    carriage_heights(current, 0, 0, 0, home_current);
+    carriage_heights(g, 0, 0, 0, home_g);
+
+    double hg[3];
+    for (int i = 0; i < 3; ++i) {
+        hg[i] = h[i] - home_current[i] + home_g[i] + current.trim[i] - g.trim[i];
+    }
+    return effector_z(g, hg);
+}
+
+float DeltaCalibrationSolver::deviation(const geometry_t& g) const
+{
+    size_t n = heights.size() / 3;
+    double sum = 0, sum2 = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double z = residual(g, &heights[i * 3]);
+        sum += z;
+        sum2 += z * z;
+    }
+    double mean = sum / n;
+    return sqrt(fmax(0, sum2 / n - mean * mean));
+}
+
+bool DeltaCalibrationSolver::solve(int factors, float& before, float& after)
+{
+    size_t n = heights.size() / 3;
+    if((factors != 4 && factors != 6 && factors != 7) || n < (size_t)factors) return false;
+
+    solved = current;
+    before = deviation(current);
+
+    // Gauss Newton, the residuals are the effector heights which should all be 0
+    // the probe trigger height is a common offset which goes into the trims
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        double ata[max_factors][max_factors + 1] = {{0}};
+        for (size_t p = 0; p < n; ++p) {
+            const double *h = &heights[p * 3];
+            double r = residual(solved, h);
+            double j[max_factors];
+            for (int k = 0; k < factors; ++k) {
+                geometry_t g = solved;
+                const float step = 0.01F;
+                parameter(g, k) += step;
+                j[k] = (residual(g, h) - r) / step;
+            }
+            for (int k = 0; k < factors; ++k) {
+                for (int l = 0; l < factors; ++l) ata[k][l] += j[k] * j[l];
+                ata[k][factors] -= j[k] * r;
+            }
+        }
+
+        // solve the normal equations by gaussian elimination with partial pivoting
+        for (int c = 0; c < factors; ++c) {
+            int pivot = c;
+            for (int r = c + 1; r < factors; ++r) {
+                if(fabs(ata[r][c]) > fabs(ata[pivot][c])) pivot = r;
+            }
+            if(fabs(ata[pivot][c]) < 1e-12) return false;
+            if(pivot != c) {
+                for (int k = 0; k <= factors; ++k) {
+                    double t = ata[c][k];
+                    ata[c][k] = ata[pivot][k];
+                    ata[pivot][k] = t;
+                }
+            }
+            for (int r = 0; r < factors; ++r) {
+                if(r == c) continue;
+                double f = ata[r][c] / ata[c][c];
+                for (int k = c; k <= factors; ++k) ata[r][k] -= f * ata[c][k];
+            }
+        }
+
+        double change = 0;
+        for (int k = 0; k < factors; ++k) {
+            double d = ata[k][factors] / ata[k][k];
+            parameter(solved, k) += d;
+            change = fmax(change, fabs(d));
+        }
+        if(change < 0.0001) break;
+    }
+
+    after = deviation(solved);
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+// Finds the delta geometry that makes a set of probed points flat, in one go from one pass of probing.
+// Each point is where the probe triggered with the current geometry, from that the carriage heights are known
+// and a least squares fit finds the geometry that puts all of them at the same height.
+// 4 factors are the endstop trims and delta radius, 6 adds the X and Y tower angles and 7 the arm length.
+class DeltaCalibrationSolver
+{
+public:
+    // as LinearDeltaSolution has it, angles are in degrees, trims are as set by M666
+    struct geometry_t {
+        float arm_length;
+        float arm_radius;
+        float tower_offset[3];
+        float tower_angle[3];
+        float trim[3];
+    };
+
+    DeltaCalibrationSolver(const geometry_t& current) : current(current), solved(current) {}
+
+    // x,y probed and the machine Z the probe triggered at
+    void add_point(float x, float y, float z);
+    // factors is 4, 6 or 7, before and after are the standard deviation of the points from flat in mm
+    bool solve(int factors, float& before, float& after);
+    const geometry_t& get_geometry() const { return solved; }
+
+    // the carriage heights for a position, and the effector Z for carriage heights
+    static void carriage_heights(const geometry_t& g, double x, double y, double z, double h[3]);
+    static double effector_z(const geometry_t& g, const double h[3]);
+
+private:
+    static const int max_factors = 7;
+    double residual(const geometry_t& g, const double *h) const;
+    float deviation(const geometry_t& g) const;
+    static float& parameter(geometry_t& g, int i);
+
+    geometry_t current;
+    geometry_t solved;
+    std::vector<double> heights; // carriage heights of each point with the current geometry, 3 per point
+};
@@ -13,6 +13,7 @@
 #include "ZProbe.h"
 #include "BaseSolution.h"
 #include "StepperMotor.h"
+#include "DeltaCalibrationSolver.h"
 
 #include <cmath>
 #include <tuple>
@@ -50,6 +51,17 @@ bool DeltaCalibrationStrategy::handleGcode(Gcode *gcode)
 
             // turn off any compensation transform as it will be invalidated anyway by this
             THEROBOT->compensationTransform= nullptr;
+            THEROBOT->compensationSplits= nullptr;
+
+            if(gcode->has_letter('S')) {
+                // one probe pass and a least squares fit of S factors
+                if(!calibrate_least_squares(gcode)) {
+                    gcode->stream->printf("Calibration failed to complete, check the initial probe height and/or initial_height settings\n");
+                    return true;
+                }
+                gcode->stream->printf("Calibration complete, save settings with M500\n");
+                return true;
+            }
 
             if(!gcode->has_letter('R')) {
                 if(!calibrate_delta_endstops(gcode)) {
@@ -390,6 +402,85 @@ bool DeltaCalibrationStrategy::calibrate_delta_radius(Gcode *gcode)
     return true;
 }
 
+/*
+    probe the center and two rings of 6 points in one pass, then find the trims and geometry that make them flat
+    G32 S4 fits the endstop trims and delta radius, S6 adds the X and Y tower angles and S7 the arm length
+    the Z tower angle is the reference so it is not changed
+*/
+
+bool DeltaCalibrationStrategy::calibrate_least_squares(Gcode *gcode)
+{
+    int factors = gcode->get_value('S');
+    if(factors != 4 && factors != 6 && factors != 7) {
+        gcode->stream->printf("S must be 4, 6 or 7 factors\n");
+        return false;
+    }
+    if(gcode->has_letter('J')) this->probe_radius = gcode->get_value('J'); // override default probe radius
+
+    BaseSolution::arm_options_t options;
+    if(!THEROBOT->arm_solution->get_optional(options, true) || options.find('H') == options.end()) {
+        gcode->stream->printf("This appears to not be a delta arm solution\n");
+        return false;
+    }
+
+    DeltaCalibrationSolver::geometry_t geometry{options['L'], options['R'], {options['A'], options['B'], options['C']}, {options['D'], options['E'], options['H']}, {0, 0, 0}};
+    if(!get_trim(geometry.trim[0], geometry.trim[1], geometry.trim[2])) {
+        gcode->stream->printf("Could not get current trim, are endstops enabled?\n");
+        return false;
+    }
+
+    gcode->stream->printf("Calibrating %d factors: radius %fmm\n", factors, this->probe_radius);
+
+    float bedht= findBed();
+    if(isnan(bedht)) return false;
+    gcode->stream->printf("initial Bed ht is %f mm\n", bedht);
+
+    // the center, a ring of 6 at the probe radius through the towers and a ring of 6 at half the radius between them
+    std::vector<std::pair<float, float>> points;
+    points.push_back(std::make_pair(0.0F, 0.0F));
+    for (int i = 0; i < 6; ++i) {
+        float a = i * M_PI / 3;
+        points.push_back(std::make_pair(this->probe_radius * sinf(a), this->probe_radius * cosf(a)));
+        a += M_PI / 6;
+        points.push_back(std::make_pair(this->probe_radius / 2 * sinf(a), this->probe_radius / 2 * cosf(a)));
+    }
+
+    std::vector<float> mm(points.size());
+    if(!zprobe->probe_points(points, mm.data(), gcode->stream)) return false;
+
+    // all the points are probed from the same height, which is where the fit puts Z 0
+    DeltaCalibrationSolver solver(geometry);
+    for (size_t i = 0; i < points.size(); ++i) {
+        solver.add_point(points[i].first, points[i].second, -mm[i]);
+    }
+
+    float before, after;
+    if(!solver.solve(factors, before, after)) {
+        gcode->stream->printf("Could not find a solution\n");
+        return false;
+    }
+    gcode->stream->printf("deviation before %1.4f after %1.4f mm\n", before, after);
+
+    const DeltaCalibrationSolver::geometry_t& g = solver.get_geometry();
+    options.clear();
+    options['R'] = g.arm_radius;
+    if(factors >= 6) {
+        options['D'] = g.tower_angle[0];
+        options['E'] = g.tower_angle[1];
+    }
+    if(factors == 7) options['L'] = g.arm_length;
+    THEROBOT->arm_solution->set_optional(options);
+    gcode->stream->printf("delta radius: %1.4f, tower angles X: %1.4f Y: %1.4f, arm length: %1.4f\n", g.arm_radius, g.tower_angle[0], g.tower_angle[1], g.arm_length);
+
+    // trims must all be negative, moving them together only moves the height of the bed
+    float m = std::max({g.trim[0], g.trim[1], g.trim[2]});
+    if(!set_trim(g.trim[0] - m, g.trim[1] - m, g.trim[2] - m, gcode->stream)) return false;
+
+    zprobe->home();
+    gcode->stream->printf("the Z height has changed, set it again with G30 Z or M306\n");
+    return true;
+}
+
 bool DeltaCalibrationStrategy::set_trim(float x, float y, float z, StreamOutput *stream)
 {
     float t[3] {x, y, z};
@@ -40,6 +40,15 @@
     Optionally an initial_height can be set that tell the intial probe where to stop the fast decent before it probes, this should be around 5-10mm above the bed
       leveling-strategy.delta-grid.initial_height  10
 
+    The grid is interpolated bilinearly between the 4 nearest points, a smooth bicubic surface through the points can be used instead with...
+      leveling-strategy.delta-grid.bicubic  true
+
+    Moves are split by delta_segments_per_second or mm_per_line_segment, if both are 0 they can be split where they cross a grid line instead with...
+      leveling-strategy.delta-grid.split_at_cells  true
+      Inside a cell the surface is not linear along a diagonal move, with bilinear it can be up to a quarter of the cell's twist
+      away (one pair of opposite corners minus the other), so a piece is split again until it is within this many mm of the surface, 0 only splits at the grid lines...
+      leveling-strategy.delta-grid.split_tolerance  0.01
+
 
     Usage
     -----
@@ -50,9 +59,10 @@
         optional parameters {{Jn}} sets the radius for this probe, which gets saved with M375
 
     M370 clears the grid and turns off compensation
-    M374 Save grid to /sd/delta.grid
-    M374.1 delete /sd/delta.grid
-    M375 Load the grid from /sd/delta.grid and enable compensation
+    M374 Save grid to /sd/delta.mesh, or with a name as M374 name to /sd/delta-name.mesh
+    M374.1 delete /sd/delta.mesh, or M374.1 name to delete a named one
+    M375 Load the grid from /sd/delta.mesh and enable compensation, M375 name loads a named one so build plates can be switched
+           if there is no /sd/delta.mesh the /sd/delta.grid saved by older firmware is loaded
     M375.1 display the current grid
     M561 clears the grid and turns off compensation
     M565 defines the probe offsets from the nozzle or tool head
@@ -91,10 +101,13 @@
 #define save_checksum                CHECKSUM("save")
 #define probe_offsets_checksum       CHECKSUM("probe_offsets")
 #define initial_height_checksum      CHECKSUM("initial_height")
+#define bicubic_checksum             CHECKSUM("bicubic")
+#define split_at_cells_checksum      CHECKSUM("split_at_cells")
+#define split_tolerance_checksum     CHECKSUM("split_tolerance")
 #define do_home_checksum             CHECKSUM("do_home")
 #define is_square_checksum           CHECKSUM("is_square") // deprecated
 
-#define GRIDFILE "/sd/delta.grid"
+#define MESHFILE "delta"
 
 DeltaGridStrategy::DeltaGridStrategy(ZProbe *zprobe) : LevelingStrategy(zprobe)
 {
@@ -114,6 +127,9 @@ bool DeltaGridStrategy::handleConfig()
     do_home = THEKERNEL->config->value(leveling_strategy_checksum, delta_grid_leveling_strategy_checksum, do_home_checksum)->by_default(true)->as_bool();
     is_square = THEKERNEL->config->value(leveling_strategy_checksum, delta_grid_leveling_strategy_checksum, is_square_checksum)->by_default(false)->as_bool();
     grid_radius = THEKERNEL->config->value(leveling_strategy_checksum, delta_grid_leveling_strategy_checksum, grid_radius_checksum)->by_default(50.0F)->as_number();
+    split_at_cells = THEKERNEL->config->value(leveling_strategy_checksum, delta_grid_leveling_strategy_checksum, split_at_cells_checksum)->by_default(false)->as_bool();
+    bicubic = THEKERNEL->config->value(leveling_strategy_checksum, delta_grid_leveling_strategy_checksum, bicubic_checksum)->by_default(false)->as_bool();
+    mesh.set_tolerance(THEKERNEL->config->value(leveling_strategy_checksum, delta_grid_leveling_strategy_checksum, split_tolerance_checksum)->by_default(0.01F)->as_number());
 
     // the initial height above the bed we stop the intial move down after home to find the bed
     // this should be a height that is enough that the probe will not hit the bed and is an offset from max_z (can be set to 0 if max_z takes into account the probe offset)
@@ -135,102 +151,44 @@ bool DeltaGridStrategy::handleConfig()
         THEKERNEL->streams->printf("Error: Not enough memory\n");
         return false;
     }
+    GridMesh::reserve(grid_size * grid_size, bicubic);
 
     reset_bed_level();
 
     return true;
 }
 
-void DeltaGridStrategy::save_grid(StreamOutput *stream)
+void DeltaGridStrategy::save_grid(StreamOutput *stream, const std::string& name)
 {
     if(isnan(grid[0])) {
         stream->printf("error:No grid to save\n");
         return;
     }
 
-    FILE *fp = fopen(GRIDFILE, "w");
-    if(fp == NULL) {
-        stream->printf("error:Failed to open grid file %s\n", GRIDFILE);
-        return;
-    }
-
-    if(fwrite(&grid_size, sizeof(uint8_t), 1, fp) != 1) {
-        stream->printf("error:Failed to write grid size\n");
-        fclose(fp);
-        return;
+    float geometry[4] = {-grid_radius, -grid_radius, grid_radius * 2, grid_radius * 2};
+    if(GridMesh::save_file(GridMesh::filename(MESHFILE, name), grid, grid_size, grid_size, geometry, stream)) {
+        mesh_name = name;
     }
-
-    if(fwrite(&grid_radius, sizeof(float), 1, fp) != 1) {
-        stream->printf("error:Failed to write grid radius\n");
-        fclose(fp);
-        return;
-    }
-
-    int cnt= 0;
-    for (int y = 0; y < grid_size; y++) {
-        for (int x = 0; x < grid_size; x++) {
-            if(fwrite(&grid[x + (grid_size * y)], sizeof(float), 1, fp) != 1) {
-                stream->printf("error:Failed to write grid\n");
-                fclose(fp);
-                return;
-            }
-            cnt += 4;
-            if ((cnt % 400) == 0) {
-                // HACK ALERT to get around fwrite corruption close and re open for append
-                fclose(fp);
-                fp = fopen(GRIDFILE, "a");
-            }
-        }
-    }
-    stream->printf("grid saved to %s\n", GRIDFILE);
-    fclose(fp);
 }
 
-bool DeltaGridStrategy::load_grid(StreamOutput *stream)
+bool DeltaGridStrategy::load_grid(StreamOutput *stream, const std::string& name)
 {
-    FILE *fp = fopen(GRIDFILE, "r");
-    if(fp == NULL) {
-        stream->printf("error:Failed to open grid %s\n", GRIDFILE);
-        return false;
-    }
-
-    uint8_t size;
-    float radius;
-
-    if(fread(&size, sizeof(uint8_t), 1, fp) != 1) {
-        stream->printf("error:Failed to read grid size\n");
-        fclose(fp);
-        return false;
-    }
-
-    if(size != grid_size) {
-        stream->printf("error:grid size is different read %d - config %d\n", size, grid_size);
-        fclose(fp);
-        return false;
-    }
-
-    if(fread(&radius, sizeof(float), 1, fp) != 1) {
-        stream->printf("error:Failed to read grid radius\n");
-        fclose(fp);
+    // only the configured size can be loaded
+    int nx = grid_size, ny = grid_size;
+    float geometry[4];
+    std::string fn = GridMesh::load_filename(MESHFILE, name, GridMesh::DELTA);
+    if(!GridMesh::load_file(fn, grid, grid_size * grid_size, nx, ny, geometry, GridMesh::DELTA, stream)) {
         return false;
     }
 
+    float radius = geometry[2] / 2;
     if(radius != grid_radius) {
         stream->printf("warning:grid radius is different read %f - config %f, overriding config\n", radius, grid_radius);
         grid_radius = radius;
     }
 
-    for (int y = 0; y < grid_size; y++) {
-        for (int x = 0; x < grid_size; x++) {
-            if(fread(&grid[x + (grid_size * y)], sizeof(float), 1, fp) != 1) {
-                stream->printf("error:Failed to read grid\n");
-                fclose(fp);
-                return false;
-            }
-        }
-    }
+    mesh_name = name;
     stream->printf("grid loaded, radius: %f, size: %d\n", grid_radius, grid_size);
-    fclose(fp);
     return true;
 }
 
@@ -246,18 +204,26 @@ bool DeltaGridStrategy::probe_grid(int n, float radius, StreamOutput *stream)
 
     float d = ((radius * 2) / (n - 1));
 
+    // Avoid probing the corners (outside the round or hexagon print surface) on a delta printer.
+    std::vector<std::pair<float, float>> points;
+    for (int c = 0; c < n; ++c) {
+        float y = -radius + d * c;
+        for (int r = 0; r < n; ++r) {
+            float x = -radius + d * r;
+            if (sqrtf(x * x + y * y) <= radius) points.push_back(std::make_pair(x, y));
+        }
+    }
+
+    std::vector<float> mm(points.size());
+    if(!zprobe->probe_points(points, mm.data(), stream)) return false;
+
+    size_t i = 0;
     for (int c = 0; c < n; ++c) {
         float y = -radius + d * c;
         for (int r = 0; r < n; ++r) {
             float x = -radius + d * r;
-            // Avoid probing the corners (outside the round or hexagon print surface) on a delta printer.
-            float distance_from_center = sqrtf(x * x + y * y);
             float z = 0.0F;
-            if (distance_from_center <= radius) {
-                float mm;
-                if(!zprobe->doProbeAt(mm, x, y)) return false;
-                z = zprobe->getProbeHeight() - mm;
-            }
+            if (sqrtf(x * x + y * y) <= radius) z = zprobe->getProbeHeight() - mm[i++];
             stream->printf("%8.4f ", z);
         }
         stream->printf("\n");
@@ -344,11 +310,14 @@ bool DeltaGridStrategy::handleGcode(Gcode *gcode)
             return true;
 
         } else if(gcode->m == 374) { // M374: Save grid, M374.1: delete saved grid
+            std::string args = get_arguments(gcode->get_command());
+            std::string name = shift_parameter(args);
             if(gcode->subcode == 1) {
-                remove(GRIDFILE);
-                gcode->stream->printf("%s deleted\n", GRIDFILE);
+                std::string fn = GridMesh::filename(MESHFILE, name);
+                remove(fn.c_str());
+                gcode->stream->printf("%s deleted\n", fn.c_str());
             } else {
-                save_grid(gcode->stream);
+                save_grid(gcode->stream, name);
             }
 
             return true;
@@ -357,7 +326,8 @@ bool DeltaGridStrategy::handleGcode(Gcode *gcode)
             if(gcode->subcode == 1) {
                 print_bed_level(gcode->stream);
             } else {
-                if(load_grid(gcode->stream)) setAdjustFunction(true);
+                std::string args = get_arguments(gcode->get_command());
+                if(load_grid(gcode->stream, shift_parameter(args))) setAdjustFunction(true);
             }
             return true;
 
@@ -374,7 +344,7 @@ bool DeltaGridStrategy::handleGcode(Gcode *gcode)
             std::tie(x, y, z) = probe_offsets;
             gcode->stream->printf(";Probe offsets:\nM565 X%1.5f Y%1.5f Z%1.5f\n", x, y, z);
             if(save) {
-                if(!isnan(grid[0])) gcode->stream->printf(";Load saved grid\nM375\n");
+                if(!isnan(grid[0])) gcode->stream->printf(";Load saved grid\nM375%s%s\n", mesh_name.empty() ? "" : " ", mesh_name.c_str());
                 else if(gcode->m == 503) gcode->stream->printf(";WARNING No grid to save\n");
             }
             return true;
@@ -402,13 +372,29 @@ bool DeltaGridStrategy::handleGcode(Gcode *gcode)
 void DeltaGridStrategy::setAdjustFunction(bool on)
 {
     if(on) {
+        // the coefficients only take AHB0 once compensation is used, which is after the planner queue and SD cache have theirs
+        if(!mesh.is_allocated()) {
+            if(!mesh.allocate(grid_size * grid_size, bicubic)) {
+                THEKERNEL->streams->printf("Error: Not enough memory for the grid compensation\n");
+                setAdjustFunction(false);
+                return;
+            }
+            if(bicubic && !mesh.is_bicubic()) THEKERNEL->streams->printf("Warning: Not enough memory for bicubic, using bilinear\n");
+        }
+        // the coefficients for each cell are worked out once here rather than on every move
+        float d = (grid_radius * 2) / (grid_size - 1);
+        mesh.build(grid, grid_size, grid_size, -grid_radius, -grid_radius, d, d);
         // set the compensationTransform in robot
-        using std::placeholders::_1;
-        using std::placeholders::_2;
-        THEROBOT->compensationTransform = std::bind(&DeltaGridStrategy::doCompensation, this, _1, _2); // [this](float *target, bool inverse) { doCompensation(target, inverse); };
+        THEROBOT->compensationTransform = [this](float *target, bool inverse) { doCompensation(target, inverse); };
+        if(split_at_cells) {
+            THEROBOT->compensationSplits = [this](const float *from, const float *to, float *t, int max) { return mesh.crossings(from, to, t, max); };
+        } else {
+            THEROBOT->compensationSplits = nullptr;
+        }
     } else {
         // clear it
         THEROBOT->compensationTransform = nullptr;
+        THEROBOT->compensationSplits = nullptr;
     }
 }
 
@@ -455,33 +441,31 @@ bool DeltaGridStrategy::doProbe(Gcode *gc)
     gc->stream->printf("probe at 0,0 is %f mm\n", z_reference);
 
     // probe all the points in the grid within the given radius
+    std::vector<std::pair<float, float>> points;
+    std::vector<int> index; // where in the grid each point goes
     for (int yCount = 0; yCount < grid_size; yCount++) {
         float yProbe = FRONT_PROBE_BED_POSITION + AUTO_BED_LEVELING_GRID_Y * yCount;
-        int xStart, xStop, xInc;
-        if (yCount % 2) {
-            xStart = 0;
-            xStop = grid_size;
-            xInc = 1;
-        } else {
-            xStart = grid_size - 1;
-            xStop = -1;
-            xInc = -1;
-        }
-
-        for (int xCount = xStart; xCount != xStop; xCount += xInc) {
+        for (int xCount = 0; xCount < grid_size; xCount++) {
             float xProbe = LEFT_PROBE_BED_POSITION + AUTO_BED_LEVELING_GRID_X * xCount;
 
             // Avoid probing the corners (outside the round or hexagon print surface) on a delta printer.
             float distance_from_center = sqrtf(xProbe * xProbe + yProbe * yProbe);
             if (distance_from_center > radius) continue;
 
-            if(!zprobe->doProbeAt(mm, xProbe - X_PROBE_OFFSET_FROM_EXTRUDER, yProbe - Y_PROBE_OFFSET_FROM_EXTRUDER)) return false;
-            float measured_z = zprobe->getProbeHeight() - mm - z_reference; // this is the delta z from bed at 0,0
-            gc->stream->printf("DEBUG: X%1.4f, Y%1.4f, Z%1.4f\n", xProbe, yProbe, measured_z);
-            grid[xCount + (grid_size * yCount)] = measured_z;
+            points.push_back(std::make_pair(xProbe - X_PROBE_OFFSET_FROM_EXTRUDER, yProbe - Y_PROBE_OFFSET_FROM_EXTRUDER));
+            index.push_back(xCount + (grid_size * yCount));
         }
     }
 
+    std::vector<float> probed(points.size());
+    if(!zprobe->probe_points(points, probed.data(), gc->stream)) return false;
+
+    for (size_t i = 0; i < points.size(); i++) {
+        float measured_z = zprobe->getProbeHeight() - probed[i] - z_reference; // this is the delta z from bed at 0,0
+        gc->stream->printf("DEBUG: X%1.4f, Y%1.4f, Z%1.4f\n", points[i].first + X_PROBE_OFFSET_FROM_EXTRUDER, points[i].second + Y_PROBE_OFFSET_FROM_EXTRUDER, measured_z);
+        grid[index[i]] = measured_z;
+    }
+
     extrapolate_unprobed_bed_level();
     print_bed_level(gc->stream);
 
@@ -527,44 +511,12 @@ void DeltaGridStrategy::extrapolate_unprobed_bed_level()
 
 void DeltaGridStrategy::doCompensation(float *target, bool inverse)
 {
-    // Adjust print surface height by linear interpolation over the bed_level array.
-    int half = (grid_size - 1) / 2;
-    float grid_x = std::max(0.001F - half, std::min(half - 0.001F, target[X_AXIS] / AUTO_BED_LEVELING_GRID_X));
-    float grid_y = std::max(0.001F - half, std::min(half - 0.001F, target[Y_AXIS] / AUTO_BED_LEVELING_GRID_Y));
-    int floor_x = floorf(grid_x);
-    int floor_y = floorf(grid_y);
-    float ratio_x = grid_x - floor_x;
-    float ratio_y = grid_y - floor_y;
-    float z1 = grid[(floor_x + half) + ((floor_y + half) * grid_size)];
-    float z2 = grid[(floor_x + half) + ((floor_y + half + 1) * grid_size)];
-    float z3 = grid[(floor_x + half + 1) + ((floor_y + half) * grid_size)];
-    float z4 = grid[(floor_x + half + 1) + ((floor_y + half + 1) * grid_size)];
-    float left = (1 - ratio_y) * z1 + ratio_y * z2;
-    float right = (1 - ratio_y) * z3 + ratio_y * z4;
-    float offset = (1 - ratio_x) * left + ratio_x * right;
-
+    // Adjust print surface height by interpolation over the bed_level array, outside it the nearest edge is used
+    float offset = mesh.get(target[X_AXIS], target[Y_AXIS]);
     if(inverse)
         target[Z_AXIS] -= offset;
     else
         target[Z_AXIS] += offset;
-
-
-    /*
-        THEKERNEL->streams->printf("//DEBUG: TARGET: %f, %f, %f\n", target[0], target[1], target[2]);
-        THEKERNEL->streams->printf("//DEBUG: grid_x= %f\n", grid_x);
-        THEKERNEL->streams->printf("//DEBUG: grid_y= %f\n", grid_y);
-        THEKERNEL->streams->printf("//DEBUG: floor_x= %d\n", floor_x);
-        THEKERNEL->streams->printf("//DEBUG: floor_y= %d\n", floor_y);
-        THEKERNEL->streams->printf("//DEBUG: ratio_x= %f\n", ratio_x);
-        THEKERNEL->streams->printf("//DEBUG: ratio_y= %f\n", ratio_y);
-        THEKERNEL->streams->printf("//DEBUG: z1= %f\n", z1);
-        THEKERNEL->streams->printf("//DEBUG: z2= %f\n", z2);
-        THEKERNEL->streams->printf("//DEBUG: z3= %f\n", z3);
-        THEKERNEL->streams->printf("//DEBUG: z4= %f\n", z4);
-        THEKERNEL->streams->printf("//DEBUG: left= %f\n", left);
-        THEKERNEL->streams->printf("//DEBUG: right= %f\n", right);
-        THEKERNEL->streams->printf("//DEBUG: offset= %f\n", offset);
-    */
 }
 
 
@@ -582,6 +534,7 @@ void DeltaGridStrategy::print_bed_level(StreamOutput *stream)
 // Reset calibration results to zero.
 void DeltaGridStrategy::reset_bed_level()
 {
+    mesh_name.clear();
     for (int y = 0; y < grid_size; y++) {
         for (int x = 0; x < grid_size; x++) {
             grid[x + (grid_size * y)] = NAN;
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "LevelingStrategy.h"
+#include "GridMesh.h"
 
 #include <string.h>
+#include <string>
 #include <tuple>
 
 #define delta_grid_leveling_strategy_checksum CHECKSUM("delta-grid")
@@ -28,8 +30,8 @@ private:
     void print_bed_level(StreamOutput *stream);
     void doCompensation(float *target, bool inverse);
     void reset_bed_level();
-    void save_grid(StreamOutput *stream);
-    bool load_grid(StreamOutput *stream);
+    void save_grid(StreamOutput *stream, const std::string& name);
+    bool load_grid(StreamOutput *stream, const std::string& name);
     bool probe_spiral(int n, float radius, StreamOutput *stream);
     bool probe_grid(int n, float radius, StreamOutput *stream);
 
@@ -37,6 +39,8 @@ private:
     float tolerance;
 
     float *grid;
+    GridMesh mesh;
+    std::string mesh_name; // the saved grid this is, empty for the unnamed one
     float grid_radius;
     std::tuple<float, float, float> probe_offsets;
     uint8_t grid_size;
@@ -45,5 +49,7 @@ private:
         bool save:1;
         bool do_home:1;
         bool is_square:1;
+        bool split_at_cells:1;
+        bool bicubic:1;
     };
 };
@@ -0,0 +1,320 @@
+#include "GridMesh.h"
+
+#include "nuts_bolts.h"
+#include "platform_memory.h"
+#include "StreamOutput.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#define MESH_MAGIC 0x4853454D // MESH
+#define MESH_VERSION 1
+
+// the header of a mesh file, the heights follow it
+struct mesh_file_header_t {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t nx, ny;
+    uint8_t unused;
+    float geometry[4];
+    uint32_t crc; // of the header with this as 0, then the heights
+};
+
+uint32_t GridMesh::reserved = 0;
+
+GridMesh::~GridMesh()
+{
+    if(coeffs != nullptr) AHB0.dealloc(coeffs);
+}
+
+bool GridMesh::allocate(int max_points, bool bicubic)
+{
+    // there are fewer cells than points so this is enough for any grid of up to max_points
+    if(coeffs != nullptr) return true;
+    this->bicubic = bicubic;
+    if(bicubic) {
+        coeffs = (float *)AHB0.alloc(max_points * 16 * sizeof(float));
+        if(coeffs != nullptr) return true;
+        this->bicubic = false;
+    }
+    coeffs = (float *)AHB0.alloc(max_points * 4 * sizeof(float));
+    return coeffs != nullptr;
+}
+
+void GridMesh::reserve(int max_points, bool bicubic)
+{
+    reserved += max_points * (bicubic ? 16 : 4) * sizeof(float);
+}
+
+void GridMesh::build(const float *grid, int nx, int ny, float x0, float y0, float dx, float dy)
+{
+    this->nx = nx;
+    this->ny = ny;
+    this->x0 = x0;
+    this->y0 = y0;
+    this->dx = dx;
+    this->dy = dy;
+    this->inv_dx = 1.0F / dx;
+    this->inv_dy = 1.0F / dy;
+
+    auto z = [grid, nx](int i, int j) { return grid[i + j * nx]; };
+
+    if(!bicubic) {
+        for (int j = 0; j < ny - 1; ++j) {
+            for (int i = 0; i < nx - 1; ++i) {
+                float *c = &coeffs[(i + j * (nx - 1)) * 4];
+                c[0] = z(i, j);
+                c[1] = z(i + 1, j) - z(i, j);
+                c[2] = z(i, j + 1) - z(i, j);
+                c[3] = z(i + 1, j + 1) - z(i + 1, j) - z(i, j + 1) + z(i, j);
+            }
+        }
+        return;
+    }
+
+    // slopes in grid units, central differences inside and one sided at the edges
+    auto du = [&z, nx](int i, int j) {
+        if(i == 0) return z(1, j) - z(0, j);
+        if(i == nx - 1) return z(i, j) - z(i - 1, j);
+        return (z(i + 1, j) - z(i - 1, j)) / 2;
+    };
+    auto dv = [&z, ny](int i, int j) {
+        if(j == 0) return z(i, 1) - z(i, 0);
+        if(j == ny - 1) return z(i, j) - z(i, j - 1);
+        return (z(i, j + 1) - z(i, j - 1)) / 2;
+    };
+    auto duv = [&du, ny](int i, int j) {
+        if(j == 0) return du(i, 1) - du(i, 0);
+        if(j == ny - 1) return du(i, j) - du(i, j - 1);
+        return (du(i, j + 1) - du(i, j - 1)) / 2;
+    };
+
+    // the cubic Hermite basis, coefficients are M * F * transpose(M)
+    static const float m[4][4] = {{1, 0, 0, 0}, {0, 0, 1, 0}, {-3, 3, -2, -1}, {2, -2, 1, 1}};
+    for (int j = 0; j < ny - 1; ++j) {
+        for (int i = 0; i < nx - 1; ++i) {
+            float f[4][4] = {
+                {z(i, j),        z(i, j + 1),        dv(i, j),        dv(i, j + 1)},
+                {z(i + 1, j),    z(i + 1, j + 1),    dv(i + 1, j),    dv(i + 1, j + 1)},
+                {du(i, j),       du(i, j + 1),       duv(i, j),       duv(i, j + 1)},
+                {du(i + 1, j),   du(i + 1, j + 1),   duv(i + 1, j),   duv(i + 1, j + 1)},
+            };
+            float mf[4][4];
+            for (int r = 0; r < 4; ++r) {
+                for (int k = 0; k < 4; ++k) {
+                    mf[r][k] = m[r][0] * f[0][k] + m[r][1] * f[1][k] + m[r][2] * f[2][k] + m[r][3] * f[3][k];
+                }
+            }
+            float *c = &coeffs[(i + j * (nx - 1)) * 16];
+            for (int r = 0; r < 4; ++r) {
+                for (int k = 0; k < 4; ++k) {
+                    c[r * 4 + k] = mf[r][0] * m[k][0] + mf[r][1] * m[k][1] + mf[r][2] * m[k][2] + mf[r][3] * m[k][3];
+                }
+            }
+        }
+    }
+}
+
+int GridMesh::crossings(const float *from, const float *to, float *t, int max) const
+{
+    int n = 0;
+    // keeps t sorted and drops the furthest when full
+    auto add = [t, max, &n](float f) {
+        if(f <= 0.0001F || f >= 0.9999F) return;
+        int k = 0;
+        while(k < n && t[k] < f) ++k;
+        // a move through a corner crosses both lines at the same point
+        if((k < n && t[k] - f < 0.0001F) || (k > 0 && f - t[k - 1] < 0.0001F)) return;
+        if(k >= max) return;
+        for (int l = (n < max ? n : max - 1); l > k; --l) t[l] = t[l - 1];
+        t[k] = f;
+        if(n < max) ++n;
+    };
+
+    float mx = to[X_AXIS] - from[X_AXIS];
+    float my = to[Y_AXIS] - from[Y_AXIS];
+    if(mx != 0) {
+        for (int i = 0; i < nx; ++i) add((x0 + dx * i - from[X_AXIS]) / mx);
+    }
+    if(my != 0) {
+        for (int j = 0; j < ny; ++j) add((y0 + dy * j - from[Y_AXIS]) / my);
+    }
+    if(tolerance <= 0 || (mx == 0 && my == 0)) return n;
+
+    // each piece is within one cell, the distance of its middle from the surface is the furthest it gets for bilinear
+    // and splitting it into k equal pieces divides that by k squared, working from the end keeps the earlier ones in place
+    auto z = [this, from, mx, my](float f) { return get(from[X_AXIS] + mx * f, from[Y_AXIS] + my * f); };
+    for (int i = n; i >= 0 && n < max; --i) {
+        float a = (i == 0) ? 0 : t[i - 1];
+        float b = (i == n) ? 1 : t[i];
+        float error = fabsf(z((a + b) / 2) - (z(a) + z(b)) / 2);
+        if(error <= tolerance) continue;
+
+        int k = std::min((int)ceilf(sqrtf(error / tolerance)), max - n + 1);
+        for (int l = n - 1; l >= i; --l) t[l + k - 1] = t[l];
+        for (int l = 1; l < k; ++l) t[i + l - 1] = a + (b - a) * l / k;
+        n += k - 1;
+    }
+    return n;
+}
+
+static const char *legacy_filename(GridMesh::LEGACY legacy)
+{
+    switch(legacy) {
+        case GridMesh::CARTESIAN: return "/sd/cartesian.grid";
+        case GridMesh::CARTESIAN_NM: return "/sd/cartesian_nm.grid";
+        default: return "/sd/delta.grid";
+    }
+}
+
+// reads the header of a version 0 grid file, the sizes are bytes and the geometry floats
+static bool read_legacy_header(FILE *fp, GridMesh::LEGACY legacy, mesh_file_header_t& h)
+{
+    h.nx = h.ny = 0;
+    if(fread(&h.nx, sizeof(uint8_t), 1, fp) != 1) return false;
+    h.ny = h.nx;
+    if(legacy == GridMesh::CARTESIAN_NM && fread(&h.ny, sizeof(uint8_t), 1, fp) != 1) return false;
+
+    if(legacy == GridMesh::DELTA) {
+        // the radius of a grid centered on 0,0
+        float radius;
+        if(fread(&radius, sizeof(float), 1, fp) != 1) return false;
+        h.geometry[0] = h.geometry[1] = -radius;
+        h.geometry[2] = h.geometry[3] = radius * 2;
+    } else {
+        // the size of a grid starting at 0,0
+        h.geometry[0] = h.geometry[1] = 0;
+        if(fread(&h.geometry[2], sizeof(float), 2, fp) != 2) return false;
+    }
+    return true;
+}
+
+std::string GridMesh::load_filename(const char *prefix, const std::string& name, LEGACY legacy)
+{
+    std::string fn = filename(prefix, name);
+    if(name.empty()) {
+        FILE *fp = fopen(fn.c_str(), "r");
+        if(fp != NULL) {
+            fclose(fp);
+        } else {
+            fp = fopen(legacy_filename(legacy), "r");
+            if(fp != NULL) {
+                fclose(fp);
+                fn = legacy_filename(legacy);
+            }
+        }
+    }
+    return fn;
+}
+
+std::string GridMesh::filename(const char *prefix, const std::string& name)
+{
+    std::string fn("/sd/");
+    fn.append(prefix);
+    if(!name.empty()) {
+        fn.append("-");
+        fn.append(name);
+    }
+    fn.append(".mesh");
+    return fn;
+}
+
+bool GridMesh::save_file(const std::string& filename, const float *grid, int nx, int ny, const float geometry[4], StreamOutput *stream)
+{
+    mesh_file_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.magic = MESH_MAGIC;
+    h.version = MESH_VERSION;
+    h.nx = nx;
+    h.ny = ny;
+    memcpy(h.geometry, geometry, sizeof(h.geometry));
+    uint32_t crc = crc32_ieee((const uint8_t *)&h, sizeof(h));
+    h.crc = crc32_ieee((const uint8_t *)grid, nx * ny * sizeof(float), crc);
+
+    FILE *fp = fopen(filename.c_str(), "w");
+    if(fp == NULL) {
+        stream->printf("error:Failed to open grid file %s\n", filename.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    // HACK ALERT to get around fwrite corruption the heights are written 100 at a time, closing and re opening for append in between
+    for (int i = 0; ok && i < nx * ny; i += 100) {
+        int n = std::min(100, nx * ny - i);
+        fclose(fp);
+        fp = fopen(filename.c_str(), "a");
+        ok = fp != NULL && fwrite(&grid[i], sizeof(float), n, fp) == (size_t)n;
+    }
+    if(fp != NULL) fclose(fp);
+
+    if(!ok) {
+        stream->printf("error:Failed to write grid to %s\n", filename.c_str());
+        return false;
+    }
+    stream->printf("grid saved to %s\n", filename.c_str());
+    return true;
+}
+
+bool GridMesh::load_file(const std::string& filename, float *grid, int max_points, int& nx, int& ny, float geometry[4], LEGACY legacy, StreamOutput *stream)
+{
+    FILE *fp = fopen(filename.c_str(), "r");
+    if(fp == NULL) {
+        stream->printf("error:Failed to open grid %s\n", filename.c_str());
+        return false;
+    }
+
+    // a file without the magic is a version 0 .grid file, which has no crc
+    mesh_file_header_t h;
+    if(fread(&h, sizeof(h), 1, fp) != 1 || h.magic != MESH_MAGIC) {
+        rewind(fp);
+        if(!read_legacy_header(fp, legacy, h)) {
+            stream->printf("error:%s is not a grid file\n", filename.c_str());
+            fclose(fp);
+            return false;
+        }
+        h.version = 0;
+    }
+    if(h.version != 0 && h.version != MESH_VERSION) {
+        stream->printf("error:%s is version %d, only version %d can be read\n", filename.c_str(), h.version, MESH_VERSION);
+        fclose(fp);
+        return false;
+    }
+    if(h.nx < 2 || h.ny < 2 || h.nx * h.ny > max_points) {
+        stream->printf("error:grid size %d x %d in %s is bigger than configured\n", h.nx, h.ny, filename.c_str());
+        fclose(fp);
+        return false;
+    }
+    if(nx != 0 && ny != 0 && (h.nx != nx || h.ny != ny)) {
+        stream->printf("error:grid size is different read %d x %d - config %d x %d\n", h.nx, h.ny, nx, ny);
+        fclose(fp);
+        return false;
+    }
+
+    // read into a copy so a bad file leaves the current grid alone
+    int n = h.nx * h.ny;
+    float *heights = new float[n];
+    bool ok = fread(heights, sizeof(float), n, fp) == (size_t)n;
+    fclose(fp);
+
+    if(ok && h.version != 0) {
+        uint32_t file_crc = h.crc;
+        h.crc = 0;
+        uint32_t crc = crc32_ieee((const uint8_t *)&h, sizeof(h));
+        ok = crc32_ieee((const uint8_t *)heights, n * sizeof(float), crc) == file_crc;
+    }
+    if(!ok) {
+        stream->printf("error:%s is damaged\n", filename.c_str());
+        delete [] heights;
+        return false;
+    }
+
+    memcpy(grid, heights, n * sizeof(float));
+    delete [] heights;
+    nx = h.nx;
+    ny = h.ny;
+    memcpy(geometry, h.geometry, sizeof(h.geometry));
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+class StreamOutput;
+
+// Interpolates a grid of heights with coefficients precomputed for each cell,
+// so a lookup is one cell index and a polynomial in the position within the cell.
+// Bilinear uses 4 coefficients per cell, bicubic 16 and gives a smooth surface through the same points.
+class GridMesh
+{
+public:
+    GridMesh() : coeffs(nullptr), tolerance(0), nx(0), ny(0), bicubic(false) {}
+    ~GridMesh();
+
+    // allocates room for a grid of up to max_points, falls back to bilinear if there is not enough memory for bicubic
+    // does nothing if it is already allocated
+    bool allocate(int max_points, bool bicubic);
+    bool is_allocated() const { return coeffs != nullptr; }
+    // counts what allocate will need so it can be kept out of the SD cache, which is made before compensation is turned on
+    static void reserve(int max_points, bool bicubic);
+    static uint32_t get_reserved() { return reserved; }
+    bool is_bicubic() const { return bicubic; }
+    // how far a straight piece of a split move may be from the surface, 0 to only split at the grid lines
+    void set_tolerance(float t) { tolerance = t; }
+
+    // grid is nx by ny heights a row of x at a time, grid[0] is at x0,y0 and they are dx,dy apart
+    void build(const float *grid, int nx, int ny, float x0, float y0, float dx, float dy);
+
+    // the height at x,y, outside the grid it is the height at the nearest edge
+    float get(float x, float y) const
+    {
+        float gx = (x - x0) * inv_dx;
+        float gy = (y - y0) * inv_dy;
+        int i = gx, j = gy;
+        if(i < 0) i = 0; else if(i > nx - 2) i = nx - 2;
+        if(j < 0) j = 0; else if(j > ny - 2) j = ny - 2;
+        float u = gx - i, v = gy - j;
+        if(u < 0) u = 0; else if(u > 1) u = 1;
+        if(v < 0) v = 0; else if(v > 1) v = 1;
+
+        int cell = i + j * (nx - 1);
+        if(!bicubic) {
+            const float *c = &coeffs[cell * 4];
+            return c[0] + c[1] * u + (c[2] + c[3] * u) * v;
+        }
+
+        const float *c = &coeffs[cell * 16];
+        float r[4];
+        for (int k = 0; k < 4; ++k, c += 4) {
+            r[k] = ((c[3] * v + c[2]) * v + c[1]) * v + c[0];
+        }
+        return ((r[3] * u + r[2]) * u + r[1]) * u + r[0];
+    }
+
+    // fills t with up to max fractions along the XY move from -> to where it crosses a grid line, in order.
+    // Inside a cell the surface is not linear along a move, bilinear has a c3*u*v term so it is a parabola
+    // which is up to |c3|/4 from a straight line across a cell, so pieces further than the tolerance from
+    // the surface at their middle are split again. When t is full the rest are left as they are.
+    int crossings(const float *from, const float *to, float *t, int max) const;
+
+    // the layouts of the .grid files saved before mesh files, these have no header and are read as version 0
+    enum LEGACY { CARTESIAN, CARTESIAN_NM, DELTA };
+
+    // the file for a named mesh, /sd/<prefix>.mesh or /sd/<prefix>-<name>.mesh
+    static std::string filename(const char *prefix, const std::string& name);
+    // the file to load, for the unnamed mesh this is the legacy .grid file if there is no .mesh file yet
+    static std::string load_filename(const char *prefix, const std::string& name, LEGACY legacy);
+    // a mesh file is a versioned header with the grid size and geometry, then the heights, and a crc32 of both
+    // geometry is the x,y of the first point and the x,y size of the grid, load reads the grid in one go
+    // and fails if it has more than max_points, or if nx and ny are not 0 and it is a different size,
+    // nx and ny are set to the size of the loaded grid
+    static bool save_file(const std::string& filename, const float *grid, int nx, int ny, const float geometry[4], StreamOutput *stream);
+    static bool load_file(const std::string& filename, float *grid, int max_points, int& nx, int& ny, float geometry[4], LEGACY legacy, StreamOutput *stream);
+
+private:
+    static uint32_t reserved;
+    float *coeffs;
+    float tolerance;
+    float x0, y0, dx, dy, inv_dx, inv_dy;
+    uint8_t nx, ny;
+    bool bicubic;
+};
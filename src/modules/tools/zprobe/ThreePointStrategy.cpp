@@ -360,9 +360,11 @@ void ThreePointStrategy::setAdjustFunction(bool on)
     if(on) {
         // set the compensationTransform in robot
         THEROBOT->compensationTransform= [this](float *target, bool inverse) { if(inverse) target[2] -= this->plane->getz(target[0], target[1]); else target[2] += this->plane->getz(target[0], target[1]); };
+        THEROBOT->compensationSplits= nullptr; // a plane does not need moves split
     }else{
         // clear it
         THEROBOT->compensationTransform= nullptr;
+        THEROBOT->compensationSplits= nullptr;
     }
 }
 
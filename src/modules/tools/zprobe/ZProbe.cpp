@@ -26,6 +26,10 @@
 #include "LevelingStrategy.h"
 #include "StepTicker.h"
 #include "utils.h"
+#include "InterruptIn.h"
+#include "us_ticker_api.h"
+
+#include <algorithm>
 
 // strategies we know about
 #include "DeltaCalibrationStrategy.h"
@@ -36,9 +40,13 @@
 #define enable_checksum          CHECKSUM("enable")
 #define probe_pin_checksum       CHECKSUM("probe_pin")
 #define debounce_ms_checksum     CHECKSUM("debounce_ms")
+#define use_interrupt_checksum   CHECKSUM("use_interrupt")
 #define slow_feedrate_checksum   CHECKSUM("slow_feedrate")
 #define fast_feedrate_checksum   CHECKSUM("fast_feedrate")
 #define return_feedrate_checksum CHECKSUM("return_feedrate")
+#define fast_tap_feedrate_checksum CHECKSUM("fast_tap_feedrate")
+#define tap_backoff_checksum     CHECKSUM("tap_backoff")
+#define hop_height_checksum      CHECKSUM("hop_height")
 #define probe_height_checksum    CHECKSUM("probe_height")
 #define gamma_max_checksum       CHECKSUM("gamma_max")
 #define max_z_checksum           CHECKSUM("max_z")
@@ -73,7 +81,20 @@ void ZProbe::on_module_loaded()
 
     // we read the probe in this timer
     probing= false;
+    latched= false;
     THEKERNEL->slow_ticker->attach(1000, this, &ZProbe::read_probe);
+
+    // optionally stop on the edge of the probe pin as well, the timer is kept for pins that miss an edge
+    if(THEKERNEL->config->value(zprobe_checksum, use_interrupt_checksum)->by_default(false)->as_bool() && this->pin.connected()) {
+        Pin p= this->pin; // interrupt_pin() invalidates the pin if it can't interrupt
+        this->edge_pin= p.interrupt_pin();
+        if(this->edge_pin != nullptr) {
+            this->edge_pin->rise(this, &ZProbe::probe_edge);
+            this->edge_pin->fall(this, &ZProbe::probe_edge);
+        } else {
+            THEKERNEL->streams->printf("WARNING: zprobe.use_interrupt needs a probe pin on port 0 or 2, using polling\n");
+        }
+    }
 }
 
 void ZProbe::config_load()
@@ -139,6 +160,9 @@ void ZProbe::config_load()
     this->slow_feedrate = THEKERNEL->config->value(zprobe_checksum, slow_feedrate_checksum)->by_default(5)->as_number(); // feedrate in mm/sec
     this->fast_feedrate = THEKERNEL->config->value(zprobe_checksum, fast_feedrate_checksum)->by_default(100)->as_number(); // feedrate in mm/sec
     this->return_feedrate = THEKERNEL->config->value(zprobe_checksum, return_feedrate_checksum)->by_default(0)->as_number(); // feedrate in mm/sec
+    this->fast_tap_feedrate = THEKERNEL->config->value(zprobe_checksum, fast_tap_feedrate_checksum)->by_default(0)->as_number(); // feedrate in mm/sec, 0 probes at slow_feedrate only
+    this->tap_backoff   = THEKERNEL->config->value(zprobe_checksum, tap_backoff_checksum)->by_default(1.0F)->as_number(); // backs off this far after the fast tap
+    this->hop_height    = THEKERNEL->config->value(zprobe_checksum, hop_height_checksum)->by_default(0)->as_number(); // between points lift only this far above the last one, 0 returns to the start height
     this->reverse_z     = THEKERNEL->config->value(zprobe_checksum, reverse_z_direction_checksum)->by_default(false)->as_bool(); // Z probe moves in reverse direction
     this->max_z         = THEKERNEL->config->value(zprobe_checksum, max_z_checksum)->by_default(NAN)->as_number(); // maximum zprobe distance
     if(isnan(this->max_z)){
@@ -159,10 +183,7 @@ uint32_t ZProbe::read_probe(uint32_t dummy)
             if(debounce < debounce_ms) {
                 debounce++;
             } else {
-                // we signal the motors to stop, which will preempt any moves on that axis
-                // we do all motors as it may be a delta
-                for(auto &a : THEROBOT->actuators) a->stop_moving();
-                probe_detected= true;
+                trigger();
                 debounce= 0;
             }
 
@@ -175,6 +196,43 @@ uint32_t ZProbe::read_probe(uint32_t dummy)
     return 0;
 }
 
+// called from the pin interrupt on either edge, the pin is checked as the edge may be the probe releasing
+// there is no debounce here, it is done after the motors stopped by confirm_trigger()
+void ZProbe::probe_edge()
+{
+    if(!probing || probe_detected) return;
+
+    if((STEPPER[X_AXIS]->is_moving() || STEPPER[Y_AXIS]->is_moving() || STEPPER[Z_AXIS]->is_moving()) && this->pin.get()) {
+        trigger();
+    }
+}
+
+// latch where Z was and signal the motors to stop, which will preempt any moves on that axis
+// we do all motors as it may be a delta
+void ZProbe::trigger()
+{
+    latched_z_steps= (int32_t)STEPPER[Z_AXIS]->get_current_step();
+    for(auto &a : THEROBOT->actuators) a->stop_moving();
+    latched= true;
+    probe_detected= true;
+}
+
+// a trigger from the interrupt has not been debounced, so check the probe stays triggered for debounce_ms
+// now that the motors have stopped, a glitch fails the probe rather than it ending up in the wrong place
+bool ZProbe::confirm_trigger()
+{
+    if(!probe_detected || edge_pin == nullptr) return probe_detected;
+
+    for (uint16_t i = 0; i < debounce_ms; ++i) {
+        if(!this->pin.get()) {
+            probe_detected= false;
+            break;
+        }
+        safe_delay_ms(1);
+    }
+    return probe_detected;
+}
+
 // single probe in Z with custom feedrate
 // returns boolean value indicating if probe was triggered
 bool ZProbe::run_probe(float& mm, float feedrate, float max_dist, bool reverse)
@@ -186,6 +244,7 @@ bool ZProbe::run_probe(float& mm, float feedrate, float max_dist, bool reverse)
 
     float maxz= max_dist < 0 ? this->max_z*2 : max_dist;
 
+    latched= false;
     probing= true;
     probe_detected= false;
     debounce= 0;
@@ -203,24 +262,40 @@ bool ZProbe::run_probe(float& mm, float feedrate, float max_dist, bool reverse)
 
     // wait until finished
     THECONVEYOR->wait_for_idle();
+    confirm_trigger();
 
-    // now see how far we moved, get delta in z we moved
+    // now see how far we moved, get delta in z we moved, from the step the probe triggered on if it did
     // NOTE this works for deltas as well as all three actuators move the same amount in Z
-    mm= z_start_pos - THEROBOT->actuators[2]->get_current_position();
+    if(probe_detected && latched) {
+        mm= z_start_pos - latched_z_steps / Z_STEPS_PER_MM;
+    } else {
+        mm= z_start_pos - THEROBOT->actuators[2]->get_current_position();
+    }
 
     // set the last probe position to the actuator units moved during this home
     THEROBOT->set_last_probe_position(std::make_tuple(0, 0, mm, probe_detected?1:0));
 
     probing= false;
 
-    if(probe_detected) {
+    if(latched) {
         // if the probe stopped the move we need to correct the last_milestone as it did not reach where it thought
+        // this is also needed when the trigger was not confirmed as the motors were still stopped
         THEROBOT->reset_position_from_current_actuator_position();
     }
 
     return probe_detected;
 }
 
+float ZProbe::get_return_feedrate() const
+{
+    if(this->return_feedrate != 0) { // use return_feedrate if set
+        return this->return_feedrate;
+    }
+    float fr = this->slow_feedrate*2; // nominally twice slow feedrate
+    if(fr > this->fast_feedrate) fr = this->fast_feedrate; // unless that is greater than fast feedrate
+    return fr;
+}
+
 // do probe then return to start position
 bool ZProbe::run_probe_return(float& mm, float feedrate, float max_dist, bool reverse)
 {
@@ -228,18 +303,28 @@ bool ZProbe::run_probe_return(float& mm, float feedrate, float max_dist, bool re
 
     bool ok= run_probe(mm, feedrate, max_dist, reverse);
 
-    // move probe back to where it was
-    float fr;
-    if(this->return_feedrate != 0) { // use return_feedrate if set
-        fr = this->return_feedrate;
-    } else {
-        fr = this->slow_feedrate*2; // nominally twice slow feedrate
-        if(fr > this->fast_feedrate) fr = this->fast_feedrate; // unless that is greater than fast feedrate
-    }
-
     // absolute move back to saved starting position
-    coordinated_move(NAN, NAN, save_z_pos, fr, false);
+    coordinated_move(NAN, NAN, save_z_pos, get_return_feedrate(), false);
+
+    return ok;
+}
 
+// probe in Z at the slow feedrate, or if fast_tap_feedrate is set find the bed at that rate first then back off
+// and probe again slowly from just above it, the probe is left where it triggered and mm is the total moved
+bool ZProbe::tap(float& mm)
+{
+    if(fast_tap_feedrate <= 0) return run_probe(mm, slow_feedrate);
+
+    float fast_mm, slow_mm;
+    if(!run_probe(fast_mm, fast_tap_feedrate)) {
+        mm= fast_mm;
+        return false;
+    }
+
+    float backoff= reverse_z ? -tap_backoff : tap_backoff;
+    coordinated_move(NAN, NAN, backoff, get_return_feedrate(), true); // relative move
+    bool ok= run_probe(slow_mm, slow_feedrate, tap_backoff * 2);
+    mm= fast_mm - backoff + slow_mm;
     return ok;
 }
 
@@ -247,7 +332,63 @@ bool ZProbe::doProbeAt(float &mm, float x, float y)
 {
     // move to xy
     coordinated_move(x, y, NAN, getFastFeedrate());
-    return run_probe_return(mm, slow_feedrate);
+
+    float save_z_pos= THEROBOT->get_axis_position(Z_AXIS);
+    bool ok= tap(mm);
+    coordinated_move(NAN, NAN, save_z_pos, get_return_feedrate(), false);
+    return ok;
+}
+
+// probe each of the points, mm[i] is set to how far below the starting height point i is, the same as doProbeAt() would give
+// the nearest point not yet probed is done next, so a grid given in serpentine order is probed in that order.
+// With hop_height set the probe only lifts that far above the last point, and the lift is done in the same move as XY.
+bool ZProbe::probe_points(const std::vector<std::pair<float, float>>& points, float *mm, StreamOutput *stream)
+{
+    size_t n= points.size();
+    float pos[3];
+    THEROBOT->get_axis_position(pos, 3);
+    float start_z= pos[Z_AXIS];
+    float last_z= start_z;
+    std::vector<bool> done(n, false);
+    uint32_t total_start= us_ticker_read();
+    bool ok= true;
+
+    for (size_t k = 0; k < n; ++k) {
+        // find the nearest point to where we are
+        size_t next= n;
+        float best= 0;
+        for (size_t i = 0; i < n; ++i) {
+            if(done[i]) continue;
+            float dx= points[i].first - pos[X_AXIS], dy= points[i].second - pos[Y_AXIS];
+            float d= dx*dx + dy*dy;
+            if(next == n || d < best) {
+                next= i;
+                best= d;
+            }
+        }
+        done[next]= true;
+
+        uint32_t t= us_ticker_read();
+        float z= start_z;
+        if(hop_height > 0 && !reverse_z && k > 0) z= std::min(start_z, last_z + hop_height);
+        pos[X_AXIS]= points[next].first;
+        pos[Y_AXIS]= points[next].second;
+        coordinated_move(pos[X_AXIS], pos[Y_AXIS], z, getFastFeedrate());
+
+        float d;
+        if(!tap(d)) {
+            ok= false;
+            break;
+        }
+        last_z= z - d;
+        mm[next]= start_z - last_z;
+
+        stream->printf("PROBE: X%1.4f, Y%1.4f took %lu ms\n", pos[X_AXIS], pos[Y_AXIS], (unsigned long)(us_ticker_read() - t) / 1000);
+    }
+
+    coordinated_move(NAN, NAN, start_z, getFastFeedrate());
+    if(ok) stream->printf("probed %u points in %1.1f seconds\n", (unsigned)n, (us_ticker_read() - total_start) / 1000000.0F);
+    return ok;
 }
 
 void ZProbe::on_gcode_received(void *argument)
@@ -406,6 +547,7 @@ void ZProbe::on_gcode_received(void *argument)
 void ZProbe::probe_XYZ(Gcode *gcode, int axis)
 {
     // enable the probe checking in the timer
+    latched= false;
     probing= true;
     probe_detected= false;
     THEROBOT->disable_segmentation= true; // we must disable segmentation as this won't work with it enabled (beware on deltas probing in X or Y)
@@ -423,6 +565,7 @@ void ZProbe::probe_XYZ(Gcode *gcode, int axis)
     // coordinated_move returns when the move is finished
 
     // disable probe checking
+    confirm_trigger();
     probing= false;
     THEROBOT->disable_segmentation= false;
 
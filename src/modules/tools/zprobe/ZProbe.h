@@ -12,6 +12,11 @@
 #include "Pin.h"
 
 #include <vector>
+#include <utility>
+
+namespace mbed {
+    class InterruptIn;
+}
 
 // defined here as they are used in multiple files
 #define zprobe_checksum            CHECKSUM("zprobe")
@@ -26,7 +31,7 @@ class ZProbe: public Module
 {
 
 public:
-    ZProbe() : invert_override(false) {};
+    ZProbe() : edge_pin(nullptr), invert_override(false) {};
     virtual ~ZProbe() {};
 
     void on_module_loaded();
@@ -35,6 +40,7 @@ public:
     bool run_probe(float& mm, float feedrate, float max_dist= -1, bool reverse= false);
     bool run_probe_return(float& mm, float feedrate, float max_dist= -1, bool reverse= false);
     bool doProbeAt(float &mm, float x, float y);
+    bool probe_points(const std::vector<std::pair<float, float>>& points, float *mm, StreamOutput *stream);
 
     void coordinated_move(float x, float y, float z, float feedrate, bool relative=false);
     void home();
@@ -49,15 +55,25 @@ private:
     void config_load();
     void probe_XYZ(Gcode *gc, int axis);
     uint32_t read_probe(uint32_t dummy);
+    bool tap(float& mm);
+    float get_return_feedrate() const;
+    void probe_edge();
+    void trigger();
+    bool confirm_trigger();
 
     float slow_feedrate;
     float fast_feedrate;
     float return_feedrate;
+    float fast_tap_feedrate;
+    float tap_backoff;
+    float hop_height;
     float probe_height;
     float max_z;
     float dwell_before_probing;
 
     Pin pin;
+    mbed::InterruptIn *edge_pin;
+    int32_t latched_z_steps; // Z actuator step the probe triggered at
     std::vector<LevelingStrategy*> strategies;
     uint16_t debounce_ms, debounce;
 
@@ -68,6 +84,7 @@ private:
         bool reverse_z:1;
         bool invert_override:1;
         volatile bool probe_detected:1;
+        volatile bool latched:1;
     };
 };
 
@@ -154,6 +154,15 @@ void Player::on_gcode_received(void *argument)
         } else if (gcode->m == 25) { // pause print
             this->playing_file = false;
 
+        } else if (gcode->m == 26 && gcode->has_letter('S')) { // set the file position in bytes like Marlin, used to resume a print
+            if(this->current_file_handler == NULL) {
+                gcode->stream->printf("No file loaded\r\n");
+            } else if(this->playing_file) {
+                gcode->stream->printf("Pause the print first\r\n");
+            } else if(!seek_file(gcode->get_uint('S'), false)) {
+                gcode->stream->printf("Position is beyond the end of the file\r\n");
+            }
+
         } else if (gcode->m == 26) { // Reset print. Slightly different than M26 in Marlin and the rest
             if(this->current_file_handler != NULL) {
                 string currentfn = this->filename.c_str();
@@ -310,6 +319,49 @@ void Player::play_command( string parameters, StreamOutput *stream )
     }
     this->played_cnt = 0;
     this->elapsed_secs = 0;
+
+    // start part way through the file if we were passed the -b<byte> or -l<line> option, used to resume a print
+    size_t pos= options.find_first_of("BbLl");
+    if(pos != string::npos) {
+        bool by_line= (options[pos] == 'L' || options[pos] == 'l');
+        unsigned long n= strtoul(options.c_str() + pos + 1, nullptr, 10);
+        if(seek_file(n, by_line)) {
+            stream->printf("  Starting at byte %lu\r\n", played_cnt);
+        } else {
+            stream->printf("WARNING - %s %lu is beyond the end of the file, starting at the beginning\r\n", by_line ? "line" : "byte", n);
+        }
+    }
+}
+
+// moves the file being played to the given byte, or to the start of the given line (the first line is 1)
+// seeks use the cluster link map so are fast, but finding a line has to read the file up to that line
+bool Player::seek_file(unsigned long n, bool by_line)
+{
+    if(by_line) {
+        if(fseek(this->current_file_handler, 0, SEEK_SET) != 0) return false;
+
+        char buf[256];
+        unsigned long line= 1, offset= 0;
+        size_t len;
+        while(line < n && (len= fread(buf, 1, sizeof(buf), this->current_file_handler)) > 0) {
+            for (size_t i = 0; i < len && line < n; ++i) {
+                ++offset;
+                if(buf[i] == '\n') ++line;
+            }
+        }
+        if(line < n) {
+            fseek(this->current_file_handler, this->played_cnt, SEEK_SET);
+            return false;
+        }
+        n= offset;
+    }
+
+    if(n > (unsigned long)this->file_size || fseek(this->current_file_handler, n, SEEK_SET) != 0) {
+        fseek(this->current_file_handler, this->played_cnt, SEEK_SET);
+        return false;
+    }
+    this->played_cnt= n;
+    return true;
 }
 
 void Player::progress_command( string parameters, StreamOutput *stream )
@@ -411,6 +463,7 @@ void Player::on_main_loop(void *argument)
         while(fgets(buf, sizeof(buf), this->current_file_handler) != NULL) {
             int len = strlen(buf);
             if(len == 0) continue; // empty line? should not be possible
+            played_cnt += len; // keep played_cnt at the file position so it can be used to resume
             if(buf[len - 1] == '\n' || feof(this->current_file_handler)) {
                 if(discard) { // we are discarding a long line
                     discard = false;
@@ -428,7 +481,6 @@ void Player::on_main_loop(void *argument)
 
                 // waits for the queue to have enough room
                 THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
-                played_cnt += len;
                 return; // we feed one line per main loop
 
             } else {
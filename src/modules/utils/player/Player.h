@@ -38,6 +38,7 @@ class Player : public Module {
         void suspend_command( string parameters, StreamOutput* stream );
         void resume_command( string parameters, StreamOutput* stream );
         string extract_options(string& args);
+        bool seek_file(unsigned long n, bool by_line);
         void suspend_part2();
 
         string filename;
@@ -0,0 +1,166 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The protocol, all numbers are decimal except the crc which is hex
+
+    host: upload -b [-r] filename       -r resumes at the end of an existing file
+    reply: #s <offset> <max block>      send blocks starting at offset
+
+    host: #b <offset> <crc32> <data>    data is base64, crc32 is of the decoded data (zlib crc32)
+    reply: #a <offset>                  all data before offset is received
+           #n <offset>                  a block was lost or bad, resend everything from offset
+
+    host: #e <size>                     the whole file has been sent
+    reply: #d <size>                    the file is complete and closed
+
+    host: #x                            abandon the upload, what was received is kept
+    reply: #f <reason>                  the upload failed and has finished
+
+    The host can have several blocks in flight without waiting for the acks, blocks that arrive
+    after a gap are dropped and the one nak tells it where to go back to. The data is written
+    to the card a few sectors at a time by FileWriter.
+*/
+
+#include "BlockUpload.h"
+
+#include "libs/utils.h"
+#include "libs/StreamOutput.h"
+
+#include <stdlib.h>
+
+BlockUpload *BlockUpload::instance= nullptr;
+
+BlockUpload::BlockUpload(StreamOutput *s)
+{
+    stream= s;
+    offset= 0;
+    idle_secs= 0;
+    nak_sent= false;
+}
+
+void BlockUpload::start(std::string parameters, StreamOutput *stream)
+{
+    bool resume= false;
+    std::string filename;
+    while(!parameters.empty()) {
+        std::string s= shift_parameter(parameters);
+        if(s == "-r") {
+            resume= true;
+        } else {
+            filename= s;
+            if(!parameters.empty()) {
+                filename.append(" ");
+                filename.append(parameters);
+            }
+            break;
+        }
+    }
+
+    if(filename.empty()) {
+        stream->printf("#f no filename\n");
+        return;
+    }
+
+    // a new upload replaces one that was not finished
+    if(instance != nullptr) instance->finish();
+
+    BlockUpload *bu= new BlockUpload(stream);
+    filename= absolute_from_relative(filename);
+    if(!bu->writer.open(filename.c_str(), resume ? "a" : "w")) {
+        stream->printf("#f failed to open file: %s\n", filename.c_str());
+        delete bu;
+        return;
+    }
+
+    instance= bu;
+    bu->offset= bu->writer.tell();
+    stream->printf("#s %lu %d\n", (unsigned long)bu->offset, MAX_BLOCK);
+}
+
+// returns true if the line was for the upload in progress on this stream
+bool BlockUpload::handle_line(const std::string& line, StreamOutput *stream)
+{
+    if(instance == nullptr || line.size() < 2 || line[0] != '#' || stream != instance->stream) return false;
+
+    instance->idle_secs= 0;
+    switch(line[1]) {
+        case 'b': instance->block(line.c_str() + 2); break;
+        case 'e': instance->end(line.c_str() + 2); break;
+        case 'x':
+            stream->printf("#f aborted at %lu\n", (unsigned long)instance->offset);
+            instance->finish();
+            break;
+        default: return false;
+    }
+    return true;
+}
+
+void BlockUpload::block(const char *args)
+{
+    char *e;
+    uint32_t off= strtoul(args, &e, 10);
+    uint32_t crc= strtoul(e, &e, 16);
+
+    if(off < offset) {
+        // we already have it so the ack must have been lost
+        stream->printf("#a %lu\n", (unsigned long)offset);
+        return;
+    }
+
+    uint8_t buf[MAX_BLOCK];
+    int n= base64_decode(e, buf, sizeof(buf));
+    if(off != offset || n <= 0 || crc32_ieee(buf, n) != crc) {
+        if(!nak_sent) {
+            stream->printf("#n %lu\n", (unsigned long)offset);
+            nak_sent= true;
+        }
+        return;
+    }
+
+    if(!writer.write(buf, n)) {
+        stream->printf("#f error writing to file at %lu\n", (unsigned long)offset);
+        finish();
+        return;
+    }
+
+    offset += n;
+    nak_sent= false;
+    stream->printf("#a %lu\n", (unsigned long)offset);
+}
+
+void BlockUpload::end(const char *args)
+{
+    uint32_t size= strtoul(args, nullptr, 10);
+    if(size != offset) {
+        // some of it is missing
+        stream->printf("#n %lu\n", (unsigned long)offset);
+        return;
+    }
+
+    if(writer.close()) {
+        stream->printf("#d %lu\n", (unsigned long)offset);
+    } else {
+        stream->printf("#f error writing to file\n");
+    }
+    finish();
+}
+
+void BlockUpload::finish()
+{
+    // the destructor closes the file, keeping whatever was written so far
+    if(instance == this) instance= nullptr;
+    delete this;
+}
+
+// the stream may be gone by now so nothing is sent on a timeout
+void BlockUpload::on_second_tick()
+{
+    if(instance != nullptr && ++instance->idle_secs >= TIMEOUT_SECS) {
+        instance->finish();
+    }
+}
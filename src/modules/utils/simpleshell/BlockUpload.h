@@ -0,0 +1,45 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "FileWriter.h"
+
+#include <string>
+#include <stdint.h>
+
+class StreamOutput;
+
+// Receives a file as blocks with a CRC, started with upload -b [-r] filename
+// Each block is one line so it works over any stream that delivers lines, USB serial, UART or telnet,
+// and the main loop keeps running while the file is received. See BlockUpload.cpp for the protocol.
+class BlockUpload
+{
+public:
+    static void start(std::string parameters, StreamOutput *stream);
+    static bool handle_line(const std::string& line, StreamOutput *stream);
+    static void on_second_tick();
+
+    // the most data in one block, as a line it has to fit in the USB serial receive buffer
+    static const int MAX_BLOCK= 128;
+
+private:
+    BlockUpload(StreamOutput *s);
+    void block(const char *args);
+    void end(const char *args);
+    void finish();
+
+    static BlockUpload *instance;
+    // an upload with no blocks for this long is abandoned, what was received is kept so it can be resumed
+    static const int TIMEOUT_SECS= 30;
+
+    FileWriter writer;
+    StreamOutput *stream;
+    uint32_t offset;     // file offset the next block has to be for
+    uint16_t idle_secs;
+    bool nak_sent;       // only nak a gap once, the sender resends everything after it
+};
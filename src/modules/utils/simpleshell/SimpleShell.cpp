@@ -18,6 +18,8 @@
 #include "version.h"
 #include "PublicDataRequest.h"
 #include "AppendFileStream.h"
+#include "FileWriter.h"
+#include "BlockUpload.h"
 #include "FileStream.h"
 #include "checksumm.h"
 #include "PublicData.h"
@@ -29,6 +31,7 @@
 #include "StepperMotor.h"
 #include "Configurator.h"
 #include "Block.h"
+#include "SlowTicker.h"
 
 #include "TemperatureControlPublicAccess.h"
 #include "EndstopsPublicAccess.h"
@@ -167,6 +170,8 @@ void SimpleShell::on_second_tick(void *)
             system_reset(false);
         }
     }
+
+    BlockUpload::on_second_tick();
 }
 
 void SimpleShell::on_gcode_received(void *argument)
@@ -205,6 +210,9 @@ void SimpleShell::on_console_line_received( void *argument )
     SerialMessage new_message = *static_cast<SerialMessage *>(argument);
     string possible_command = new_message.message;
 
+    // blocks of an upload -b
+    if(BlockUpload::handle_line(possible_command, new_message.stream)) return;
+
     // ignore anything that is not lowercase or a $ as it is not a command
     if(possible_command.size() == 0 || (!islower(possible_command[0]) && possible_command[0] != '$')) {
         return;
@@ -442,6 +450,12 @@ void SimpleShell::cat_command( string parameters, StreamOutput *stream )
 
 void SimpleShell::upload_command( string parameters, StreamOutput *stream )
 {
+    if(parameters.compare(0, 3, "-b ") == 0) {
+        // blocks with a crc, this does not block the main loop so is allowed at any time
+        BlockUpload::start(parameters.substr(3), stream);
+        return;
+    }
+
     // this needs to be a hack. it needs to read direct from serial and not allow on_main_loop run until done
     // NOTE this will block all operation until the upload is complete, so do not do while printing
     if(!THECONVEYOR->is_idle()) {
@@ -451,8 +465,8 @@ void SimpleShell::upload_command( string parameters, StreamOutput *stream )
 
     // open file to upload to
     string upload_filename = absolute_from_relative( parameters );
-    FILE *fd = fopen(upload_filename.c_str(), "w");
-    if(fd != NULL) {
+    FileWriter writer;
+    if(writer.open(upload_filename.c_str(), "w")) {
         stream->printf("uploading to file: %s, send control-D or control-Z to finish\r\n", upload_filename.c_str());
     } else {
         stream->printf("failed to open file: %s.\r\n", upload_filename.c_str());
@@ -472,28 +486,21 @@ void SimpleShell::upload_command( string parameters, StreamOutput *stream )
         if( c == 4 || c == 26) { // ctrl-D or ctrl-Z
             uploading = false;
             // close file
-            fclose(fd);
-            stream->printf("uploaded %d bytes\n", cnt);
+            if(writer.close()) {
+                stream->printf("uploaded %d bytes\n", cnt);
+            } else {
+                stream->printf("error writing to file\r\n");
+            }
             return;
 
         } else {
-            // write character to file
+            // write character to file, it is written to the card a few sectors at a time
             cnt++;
-            if(fputc(c, fd) != c) {
+            if(!writer.put(c)) {
                 // error writing to file
                 stream->printf("error writing to file. ignoring all characters until EOF\r\n");
-                fclose(fd);
-                fd = NULL;
+                writer.close();
                 uploading= false;
-
-            } else {
-                if ((cnt%400) == 0) {
-                    // HACK ALERT to get around fwrite corruption close and re open for append
-                    fclose(fd);
-                    fd = fopen(upload_filename.c_str(), "a");
-                    // we need to kick things or they die
-                    THEKERNEL->call_event(ON_IDLE);
-                }
             }
         }
     }
@@ -593,6 +600,9 @@ void SimpleShell::mem_command( string parameters, StreamOutput *stream)
     }
 
     stream->printf("Block size: %u bytes, Tickinfo size: %u bytes\n", sizeof(Block), sizeof(Block::tickinfo_t) * Block::n_actuators);
+
+    stream->printf("SD cache: %d sectors, hits: %lu, misses: %lu, writebacks: %lu\n", mounter.get_cache_size(),
+                   mounter.get_cache_hits(), mounter.get_cache_misses(), mounter.get_cache_writebacks());
 }
 
 static uint32_t getDeviceType()
@@ -849,6 +859,10 @@ void SimpleShell::get_command( string parameters, StreamOutput *stream)
         // also ? on serial and usb
         stream->printf("%s\n", THEKERNEL->get_query_string().c_str());
 
+    } else if (what == "ticker") {
+        // the slow ticker hooks and how often each has been late enough to miss a call
+        THEKERNEL->slow_ticker->print_hooks(stream);
+
     } else {
         stream->printf("error:unknown option %s\n", what.c_str());
     }
@@ -1145,7 +1159,7 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("rm file\r\n");
     stream->printf("mv file newfile\r\n");
     stream->printf("remount\r\n");
-    stream->printf("play file [-v]\r\n");
+    stream->printf("play file [-v] [-b<byte>|-l<line>]\r\n");
     stream->printf("progress - shows progress of current play\r\n");
     stream->printf("abort - abort currently playing file\r\n");
     stream->printf("reset - reset smoothie\r\n");
@@ -1153,7 +1167,7 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("break - break into debugger\r\n");
     stream->printf("config-get [<configuration_source>] <configuration_setting>\r\n");
     stream->printf("config-set [<configuration_source>] <configuration_setting> <value>\r\n");
-    stream->printf("get [pos|wcs|state|status|fk|ik]\r\n");
+    stream->printf("get [pos|wcs|state|status|fk|ik|ticker]\r\n");
     stream->printf("get temp [bed|hotend]\r\n");
     stream->printf("set_temp bed|hotend 185\r\n");
     stream->printf("switch name [value]\r\n");
@@ -1161,6 +1175,7 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("load [file] - loads a configuration override file from soecified name or config-override\r\n");
     stream->printf("save [file] - saves a configuration override file as specified filename or as config-override\r\n");
     stream->printf("upload filename - saves a stream of text to the named file\r\n");
+    stream->printf("upload -b [-r] filename - receives a file as blocks with a crc, -r resumes, see smoothie-block-upload.py\r\n");
     stream->printf("calc_thermistor [-s0] T1,R1,T2,R2,T3,R3 - calculate the Steinhart Hart coefficients for a thermistor\r\n");
     stream->printf("thermistors - print out the predefined thermistors\r\n");
     stream->printf("md5sum file - prints md5 sum of the given file\r\n");
@@ -0,0 +1,37 @@
+#include "Adc.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#include "easyunit/test.h"
+
+// the sum kept by add() must be the same as sorting the window and summing the middle half
+TEST(AdcTest,sorted_window_sum)
+{
+    const int n= Adc::num_samples;
+    Adc::channel_t c;
+    memset(&c, 0, sizeof(c));
+
+    uint16_t window[n];
+    memset(window, 0, sizeof(window));
+    uint32_t seed= 1;
+    for (int i = 0; i < 5000; ++i) {
+        // mostly a few close values so there are plenty of duplicates, with some spikes at either end
+        seed= seed * 1103515245 + 12345;
+        uint16_t v= 2000 + ((seed >> 16) % 8);
+        if((seed >> 8) % 16 == 0) v= ((seed >> 12) & 1) ? 4095 : 0;
+
+        c.add(v);
+        window[i % n]= v;
+
+        uint16_t sorted[n];
+        memcpy(sorted, window, sizeof(sorted));
+        std::sort(sorted, sorted + n);
+        uint32_t sum= 0;
+        for (int j = n / 4; j < n - n / 4; ++j) sum += sorted[j];
+
+        ASSERT_TRUE(memcmp(c.sorted, sorted, sizeof(sorted)) == 0);
+        ASSERT_TRUE(c.sum == sum);
+    }
+}
@@ -0,0 +1,102 @@
+#include "HookHeap.h"
+#include "Hook.h"
+
+#include <stdio.h>
+
+#include "easyunit/test.h"
+
+// the top must always be the hook due first, also when the deadlines wrap past zero
+TEST(HookHeapTest,order)
+{
+    const int n= 20;
+    Hook hooks[n];
+    HookHeap heap;
+
+    uint32_t now= 0xFFFF0000; // close to wrapping
+    for (int i = 0; i < n; ++i) {
+        hooks[i].interval= 1000 + (i * 7919) % 5000;
+        hooks[i].deadline= now + hooks[i].interval;
+        ASSERT_TRUE(heap.push(&hooks[i]));
+    }
+    ASSERT_TRUE(heap.size() == n);
+
+    for (int call = 0; call < 1000; ++call) {
+        Hook *top= heap.top();
+        for (int i = 0; i < n; ++i) {
+            ASSERT_TRUE((int32_t)(hooks[i].deadline - top->deadline) >= 0);
+            ASSERT_TRUE(hooks[i].index >= 0 && hooks[i].index < n);
+        }
+
+        // the deadlines come in order and each is reached in time
+        ASSERT_TRUE((int32_t)(top->deadline - now) >= 0);
+        now= top->deadline;
+        top->deadline += top->interval;
+        heap.update_top();
+    }
+    ASSERT_TRUE(now < 0xFFFF0000); // it did wrap
+}
+
+TEST(HookHeapTest,full)
+{
+    static Hook hooks[HookHeap::max_hooks + 1];
+    HookHeap heap;
+
+    for (int i = 0; i < HookHeap::max_hooks; ++i) {
+        hooks[i].deadline= HookHeap::max_hooks - i;
+        ASSERT_TRUE(heap.push(&hooks[i]));
+    }
+    ASSERT_TRUE(!heap.push(&hooks[HookHeap::max_hooks]));
+    ASSERT_TRUE(heap.top() == &hooks[HookHeap::max_hooks - 1]);
+}
+
+// detached hooks are popped off the top as they get there, the rest must stay in order with their indexes right
+TEST(HookHeapTest,pop)
+{
+    const int n= 16;
+    Hook hooks[n];
+    bool detached[n];
+    HookHeap heap;
+
+    for (int i = 0; i < n; ++i) {
+        hooks[i].interval= 100 + i * 13;
+        hooks[i].deadline= hooks[i].interval;
+        detached[i]= (i % 3) == 0;
+        ASSERT_TRUE(heap.push(&hooks[i]));
+    }
+
+    uint32_t now= 0;
+    int dropped= 0;
+    for (int call = 0; call < 500 && heap.size() > 0; ++call) {
+        Hook *top= heap.top();
+        int i= top - hooks;
+        if(detached[i]) {
+            ASSERT_TRUE(heap.pop() == top);
+            ASSERT_TRUE(top->index == -1);
+            ++dropped;
+            continue;
+        }
+
+        ASSERT_TRUE((int32_t)(top->deadline - now) >= 0);
+        now= top->deadline;
+        top->deadline += top->interval;
+        heap.update_top();
+
+        for (int j = 0; j < n; ++j) {
+            ASSERT_TRUE(hooks[j].index < 0 || (int32_t)(hooks[j].deadline - heap.top()->deadline) >= 0);
+        }
+    }
+
+    ASSERT_TRUE(dropped == (n + 2) / 3);
+    ASSERT_TRUE(heap.size() == n - dropped);
+    for (int i = 0; i < n; ++i) {
+        ASSERT_TRUE(detached[i] ? hooks[i].index == -1 : (hooks[i].index >= 0 && hooks[i].index < heap.size()));
+    }
+
+    // popping everything leaves it empty in deadline order
+    uint32_t last= heap.top()->deadline;
+    while(heap.size() > 0) {
+        Hook *h= heap.pop();
+        ASSERT_TRUE((int32_t)(h->deadline - last) >= 0);
+        last= h->deadline;
+    }
+}
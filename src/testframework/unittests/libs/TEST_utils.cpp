@@ -45,3 +45,44 @@ TEST(UtilsTest,append_parameters)
     ASSERT_TRUE(n == 24);
     ASSERT_TRUE(strcmp(buf, "X1.0000 Y2.0000 Z3.0000 ") == 0);
 }
+
+TEST(UtilsTest,base64_decode)
+{
+    uint8_t buf[16];
+
+    int n= base64_decode("TWFu", buf, sizeof(buf));
+    ASSERT_TRUE(n == 3);
+    ASSERT_TRUE(memcmp(buf, "Man", 3) == 0);
+
+    // padding and whitespace
+    n= base64_decode("TW E=", buf, sizeof(buf));
+    ASSERT_TRUE(n == 2);
+    ASSERT_TRUE(memcmp(buf, "Ma", 2) == 0);
+    n= base64_decode("TQ==", buf, sizeof(buf));
+    ASSERT_TRUE(n == 1);
+    ASSERT_TRUE(buf[0] == 'M');
+
+    // all 8 bit values
+    n= base64_decode("AP+A", buf, sizeof(buf));
+    ASSERT_TRUE(n == 3);
+    ASSERT_TRUE(buf[0] == 0x00 && buf[1] == 0xFF && buf[2] == 0x80);
+
+    ASSERT_TRUE(base64_decode("", buf, sizeof(buf)) == 0);
+    ASSERT_TRUE(base64_decode("TW*u", buf, sizeof(buf)) == -1);
+    ASSERT_TRUE(base64_decode("TWFuTWFu", buf, 5) == -1);
+}
+
+TEST(UtilsTest,crc32_ieee)
+{
+    // the standard check value
+    const char *s= "123456789";
+    ASSERT_TRUE(crc32_ieee((const uint8_t *)s, 9) == 0xCBF43926);
+    ASSERT_TRUE(crc32_ieee((const uint8_t *)s, 0) == 0);
+
+    // continuing over a split buffer gives the same result as one pass
+    uint32_t crc= crc32_ieee((const uint8_t *)s, 4);
+    ASSERT_TRUE(crc32_ieee((const uint8_t *)s + 4, 5, crc) == 0xCBF43926);
+    crc= crc32_ieee((const uint8_t *)s, 1);
+    crc= crc32_ieee((const uint8_t *)s + 1, 7, crc);
+    ASSERT_TRUE(crc32_ieee((const uint8_t *)s + 8, 1, crc) == 0xCBF43926);
+}
@@ -0,0 +1,342 @@
+/*
+    Loopback harness for the uIP TCP send buffers.
+
+    uip.c is compiled into this file with the application call pointed at a
+    bulk sender, and a scripted peer stands in for the network and the remote
+    host, so no ethernet hardware is involved. The peer delays its acks like
+    a normal TCP stack, acking every second segment or after 200ms, which is
+    what limits a connection to one segment in flight.
+
+    This builds with the default testing=1 which leaves the network out,
+    enable it with TESTMODULES= %w(libs/network) in rakefile.defaults.
+*/
+
+extern "C" void harness_appcall(void);
+#define UIP_APPCALL harness_appcall
+
+#include "uip.c"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "easyunit/test.h"
+
+extern "C" void uip_log(char *m)
+{
+    printf("uIP log message: %s\n", m);
+}
+
+// no UDP in the harness
+extern "C" void dhcpc_appcall(void)
+{
+}
+
+// one way latency of the simulated link in ms
+#define LINK_DELAY 1
+// the peer acks at least every second segment or after this many ms
+#define DELAYED_ACK 200
+// the window the peer advertises
+#define PEER_WINDOW 8192
+#define PEER_PORT 4000
+#define HOST_PORT 5000
+
+namespace {
+
+// a segment on the simulated wire, only the headers are kept, the payload is checked when it is sent
+struct Segment {
+    uint32_t when;
+    uint32_t seq, ack;
+    uint16_t len;
+    uint16_t wnd;
+    uint8_t flags;
+};
+
+struct Wire {
+    Segment q[32];
+    int n;
+    void push(const Segment& s) { if(n < 32) q[n++]= s; }
+    bool pop(uint32_t now, Segment& s) {
+        if(n == 0 || q[0].when > now) return false;
+        s= q[0];
+        memmove(&q[0], &q[1], --n * sizeof(Segment));
+        return true;
+    }
+};
+
+struct {
+    uint32_t total;     // bytes to send
+    uint32_t pos;       // first byte not yet acknowledged
+    uint16_t last;      // size of the segment in flight
+    bool closing;
+} app;
+
+struct {
+    uint32_t iss, snd_nxt, rcv_nxt;
+    uint32_t base;      // sequence number of the first byte of the stream
+    uint32_t received;
+    int unacked;        // segments received but not acked
+    uint32_t ack_due;   // time the delayed ack is due, 0 when none
+    bool established;
+    bool fin;
+    bool corrupt;
+    int drop;           // drop this data segment from uIP, 0 for none
+    int data_segs;
+} peer;
+
+Wire to_peer, to_host;
+uint32_t now;
+
+uint8_t pattern(uint32_t i)
+{
+    return (uint8_t)(i * 31 + (i >> 8));
+}
+
+uint32_t get32(const u8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void put32(u8_t *p, uint32_t v)
+{
+    p[0]= v >> 24; p[1]= v >> 16; p[2]= v >> 8; p[3]= v;
+}
+
+// take whatever uIP left in uip_buf and put it on the wire to the peer
+void host_output()
+{
+    if(uip_len == 0) return;
+
+    Segment s;
+    s.when= now + LINK_DELAY;
+    s.seq= get32(BUF->seqno);
+    s.ack= get32(BUF->ackno);
+    s.flags= BUF->flags;
+    s.wnd= (BUF->wnd[0] << 8) | BUF->wnd[1];
+    s.len= uip_len - UIP_IPH_LEN - ((BUF->tcpoffset >> 4) << 2);
+
+    if(s.len > 0) {
+        // check the payload against the stream here, as its position is known from the sequence number
+        const u8_t *data= &uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + ((BUF->tcpoffset >> 4) << 2)];
+        uint32_t off= s.seq - peer.base;
+        for (int i = 0; i < s.len; i++) {
+            if(data[i] != pattern(off + i)) peer.corrupt= true;
+        }
+        if(++peer.data_segs == peer.drop) {
+            uip_len= 0;
+            return;
+        }
+    }
+
+    to_peer.push(s);
+    uip_len= 0;
+}
+
+void peer_send(uint8_t flags, uint16_t len= 0)
+{
+    Segment s;
+    s.when= now + LINK_DELAY;
+    s.seq= peer.snd_nxt;
+    s.ack= peer.rcv_nxt;
+    s.flags= flags;
+    s.wnd= PEER_WINDOW;
+    s.len= len;
+    to_host.push(s);
+    if(flags & (TCP_SYN | TCP_FIN)) peer.snd_nxt++;
+    peer.unacked= 0;
+    peer.ack_due= 0;
+}
+
+// build the frame for a peer segment in uip_buf and give it to uIP
+void host_input(const Segment& s)
+{
+    memset(uip_buf, 0, UIP_LLH_LEN + UIP_TCPIP_HLEN + 4);
+    uip_buf[12]= 0x08; // IP ethertype
+
+    int optlen= (s.flags & TCP_SYN) ? 4 : 0;
+    int iplen= UIP_TCPIP_HLEN + optlen;
+
+    BUF->vhl= 0x45;
+    BUF->len[0]= iplen >> 8;
+    BUF->len[1]= iplen & 0xff;
+    BUF->ttl= UIP_TTL;
+    BUF->proto= UIP_PROTO_TCP;
+    uip_ipaddr(BUF->srcipaddr, 10, 0, 0, 2);
+    uip_ipaddr_copy(BUF->destipaddr, uip_hostaddr);
+    BUF->srcport= HTONS(PEER_PORT);
+    BUF->destport= HTONS(HOST_PORT);
+    put32(BUF->seqno, s.seq);
+    put32(BUF->ackno, s.ack);
+    BUF->tcpoffset= ((UIP_TCPH_LEN + optlen) / 4) << 4;
+    BUF->flags= s.flags;
+    BUF->wnd[0]= s.wnd >> 8;
+    BUF->wnd[1]= s.wnd & 0xff;
+    if(optlen > 0) {
+        BUF->optdata[0]= TCP_OPT_MSS;
+        BUF->optdata[1]= TCP_OPT_MSS_LEN;
+        BUF->optdata[2]= 1460 / 256;
+        BUF->optdata[3]= 1460 & 255;
+    }
+    BUF->ipchksum= 0;
+    BUF->ipchksum= ~(uip_ipchksum());
+    BUF->tcpchksum= 0;
+    BUF->tcpchksum= ~(uip_tcpchksum());
+
+    uip_len= UIP_LLH_LEN + iplen;
+    uip_input();
+    host_output();
+}
+
+// the remote end, a plain receiver with delayed acks
+void peer_input(const Segment& s)
+{
+    if((s.flags & TCP_CTL) == (TCP_SYN | TCP_ACK)) {
+        peer.rcv_nxt= peer.base= s.seq + 1;
+        peer.established= true;
+        peer_send(TCP_ACK);
+        return;
+    }
+    if(!peer.established) return;
+
+    if(s.seq != peer.rcv_nxt) {
+        // out of order, ack what we have straight away
+        peer_send(TCP_ACK);
+        return;
+    }
+
+    if(s.len > 0) {
+        peer.rcv_nxt += s.len;
+        peer.received += s.len;
+        if(++peer.unacked >= 2) {
+            peer_send(TCP_ACK);
+        } else if(peer.ack_due == 0) {
+            peer.ack_due= now + DELAYED_ACK;
+        }
+    }
+
+    if(s.flags & TCP_FIN) {
+        peer.rcv_nxt++;
+        peer.fin= true;
+        peer_send(TCP_FIN | TCP_ACK);
+    }
+}
+
+// what Network::on_idle does for connections with room in their send buffer
+void poll_send_buffers()
+{
+    for (int i = 0; i < UIP_CONNS; i++) {
+        if(uip_sndbuf_pollable(&uip_conns[i])) {
+            uip_poll_conn(&uip_conns[i]);
+            host_output();
+        }
+    }
+}
+
+// sends total bytes from uIP to the peer and returns the simulated time it took in ms, or 0 on failure
+uint32_t transfer(uint32_t total, int nbufs, int drop)
+{
+    static u8_t bufs[2][2 * UIP_TCP_MSS];
+
+    uip_init();
+    uip_ipaddr_t ip;
+    uip_ipaddr(ip, 10, 0, 0, 1);
+    uip_sethostaddr(ip);
+    uip_ipaddr(ip, 255, 255, 255, 0);
+    uip_setnetmask(ip);
+    for (int i = 0; i < nbufs; i++) {
+        uip_sndbuf_add(bufs[i], sizeof(bufs[i]));
+    }
+    uip_listen(HTONS(HOST_PORT));
+
+    memset(&app, 0, sizeof(app));
+    memset(&peer, 0, sizeof(peer));
+    app.total= total;
+    peer.iss= peer.snd_nxt= 1000;
+    peer.drop= drop;
+    to_peer.n= to_host.n= 0;
+    now= 0;
+
+    peer_send(TCP_SYN);
+
+    for (now = 0; now < 120000; now++) {
+        Segment s;
+        while(to_host.pop(now, s)) host_input(s);
+        while(to_peer.pop(now, s)) peer_input(s);
+        if(peer.ack_due != 0 && now >= peer.ack_due) peer_send(TCP_ACK);
+
+        if(now % 500 == 0) {
+            for (int i = 0; i < UIP_CONNS; i++) {
+                uip_periodic(i);
+                host_output();
+            }
+        }
+        poll_send_buffers();
+
+        if(peer.fin) break;
+    }
+
+    if(!peer.fin || peer.corrupt || peer.received != total || app.pos != total) return 0;
+    return now;
+}
+
+}
+
+// the application, a bulk sender written the usual uIP way with one segment in flight
+void harness_appcall(void)
+{
+    if(uip_aborted() || uip_timedout() || uip_closed()) return;
+
+    if(uip_acked()) {
+        app.pos += app.last;
+        app.last= 0;
+    }
+
+    if(uip_rexmit()) {
+        for (int i = 0; i < app.last; i++) ((u8_t *)uip_appdata)[i]= pattern(app.pos + i);
+        uip_send(uip_appdata, app.last);
+        return;
+    }
+
+    if(app.last > 0) return;
+
+    if(app.pos < app.total) {
+        uint32_t n= app.total - app.pos;
+        if(n > uip_mss()) n= uip_mss();
+        for (uint32_t i = 0; i < n; i++) ((u8_t *)uip_appdata)[i]= pattern(app.pos + i);
+        uip_send(uip_appdata, n);
+        app.last= n;
+
+    } else if(!app.closing) {
+        app.closing= true;
+        uip_close();
+    }
+}
+
+TEST(UipSndbuf,throughput)
+{
+    const uint32_t total= 64 * 1024;
+    uint32_t t0= transfer(total, 0, 0);
+    uint32_t t1= transfer(total, 1, 0);
+    printf("one segment in flight: %lu bytes in %lums, with a send buffer: %lu bytes in %lums\n",
+        (unsigned long)total, (unsigned long)t0, (unsigned long)total, (unsigned long)t1);
+
+    ASSERT_TRUE(t0 > 0);
+    ASSERT_TRUE(t1 > 0);
+    // without the buffer every segment waits for the peers delayed ack
+    ASSERT_TRUE(t1 * 10 < t0);
+}
+
+TEST(UipSndbuf,lost_segment)
+{
+    // the fifth data segment is dropped and has to be resent from the buffer, the data must still arrive intact
+    const uint32_t total= 32 * 1024;
+    uint32_t t= transfer(total, 1, 5);
+    printf("with a lost segment: %lu bytes in %lums\n", (unsigned long)total, (unsigned long)t);
+    ASSERT_TRUE(t > 0);
+}
+
+TEST(UipSndbuf,no_free_buffer)
+{
+    // a connection that does not get a buffer falls back to one segment in flight
+    const uint32_t total= 8 * 1024;
+    ASSERT_TRUE(transfer(total, 0, 3) > 0);
+}
@@ -0,0 +1,92 @@
+#include "DeltaCalibrationSolver.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "easyunit/test.h"
+
+typedef DeltaCalibrationSolver::geometry_t geometry_t;
+
+// the Z the machine thinks it is at when the probe triggers on a flat bed at Z 0,
+// when it thinks it has geometry g but actually has geometry actual
+static float trigger_z(const geometry_t& g, const geometry_t& actual, float x, float y)
+{
+    double home_g[3], home_actual[3];
+    DeltaCalibrationSolver::carriage_heights(g, 0, 0, 0, home_g);
+    DeltaCalibrationSolver::carriage_heights(actual, 0, 0, 0, home_actual);
+
+    double lo = -5, hi = 5;
+    for (int i = 0; i < 60; ++i) {
+        double z = (lo + hi) / 2, h[3];
+        DeltaCalibrationSolver::carriage_heights(g, x, y, z, h);
+        for (int j = 0; j < 3; ++j) h[j] += home_actual[j] - home_g[j] + g.trim[j] - actual.trim[j];
+        if(DeltaCalibrationSolver::effector_z(actual, h) > 0) hi = z; else lo = z;
+    }
+    return (lo + hi) / 2;
+}
+
+static void probe(DeltaCalibrationSolver& solver, const geometry_t& g, const geometry_t& actual)
+{
+    float r = 100;
+    solver.add_point(0, 0, trigger_z(g, actual, 0, 0));
+    for (int i = 0; i < 6; ++i) {
+        float a = i * M_PI / 3;
+        solver.add_point(r * sinf(a), r * cosf(a), trigger_z(g, actual, r * sinf(a), r * cosf(a)));
+        a += M_PI / 6;
+        solver.add_point(r / 2 * sinf(a), r / 2 * cosf(a), trigger_z(g, actual, r / 2 * sinf(a), r / 2 * cosf(a)));
+    }
+}
+
+static const geometry_t configured{250, 124, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+static const geometry_t actual{250.8F, 124.6F, {0, 0, 0}, {0.3F, -0.2F, 0}, {-0.4F, -0.1F, -0.7F}};
+
+TEST(DeltaCalibrationSolver,kinematics)
+{
+    double h[3];
+    DeltaCalibrationSolver::carriage_heights(actual, 10, 20, 3, h);
+    ASSERT_EQUALS_DELTA(3.0, DeltaCalibrationSolver::effector_z(actual, h), 0.0001);
+}
+
+TEST(DeltaCalibrationSolver,seven_factors)
+{
+    DeltaCalibrationSolver solver(configured);
+    probe(solver, configured, actual);
+
+    float before, after;
+    ASSERT_TRUE(solver.solve(7, before, after));
+    printf("7 factors: deviation before %f after %f\n", before, after);
+    ASSERT_TRUE(before > 0.1F);
+    ASSERT_TRUE(after < 0.001F);
+
+    const geometry_t& g = solver.get_geometry();
+    ASSERT_EQUALS_DELTA(actual.arm_length, g.arm_length, 0.01F);
+    ASSERT_EQUALS_DELTA(actual.arm_radius, g.arm_radius, 0.01F);
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQUALS_DELTA(actual.tower_angle[i], g.tower_angle[i], 0.01F);
+        ASSERT_EQUALS_DELTA(actual.trim[i], g.trim[i], 0.01F);
+    }
+}
+
+TEST(DeltaCalibrationSolver,fewer_factors)
+{
+    float previous = 1;
+    for (int factors : {4, 6}) {
+        DeltaCalibrationSolver solver(configured);
+        probe(solver, configured, actual);
+
+        float before, after;
+        ASSERT_TRUE(solver.solve(factors, before, after));
+        printf("%d factors: deviation before %f after %f\n", factors, before, after);
+        ASSERT_TRUE(after < before);
+        ASSERT_TRUE(after < previous);
+        previous = after;
+    }
+}
+
+TEST(DeltaCalibrationSolver,bad_factors)
+{
+    DeltaCalibrationSolver solver(configured);
+    probe(solver, configured, actual);
+    float before, after;
+    ASSERT_TRUE(!solver.solve(5, before, after));
+}